@@ -32,9 +32,18 @@ OPCODES = {
     'muli': 0x10,   # muli rd, rs, imm8
     'divi': 0x11,   # divi rd, rs, imm8
     
+    # Atomic instructions (aligned 32-bit words)
+    'cas': 0x12,    # cas rd, rs1, rs2
+    'fadd': 0x13,   # fadd rd, rs1, rs2
+    'fence': 0x14,
+    
     # System instructions
     'syscall': 0x20,
     'hypercall': 0x21,
+    'ipi': 0x22,
+    'livt': 0x23,
+    'iret': 0x24,
+    'stimer': 0x25,
     
     # Virtualization instructions
     'vmenter': 0x30,
@@ -106,9 +115,9 @@ def assemble(asm_text):
         opcode = OPCODES[opcode_str]
         
         # Parse operands
-        if opcode_str == 'halt':
+        if opcode_str in ['halt', 'fence']:
             binary.extend(struct.pack('BBBB', opcode, 0, 0, 0))
-        elif opcode_str in ['add', 'sub', 'mul', 'div']:
+        elif opcode_str in ['add', 'sub', 'mul', 'div', 'cas', 'fadd']:
             # Format: add r0, r1, r2
             rd = parse_register(parts[1].rstrip(','))
             rs1 = parse_register(parts[2].rstrip(','))
@@ -165,7 +174,7 @@ def assemble(asm_text):
                     binary.extend(struct.pack('BBBB', opcode, rd, rs1, rs2))
                 except:
                     raise ValueError(f"Invalid {opcode_str} syntax: {line}")
-        elif opcode_str in ['vmcause', 'vmtrapcfg', 'ldpgtr', 'ldhptr']:
+        elif opcode_str in ['vmcause', 'vmtrapcfg', 'ldpgtr', 'ldhptr', 'ipi', 'livt', 'stimer']:
             # Format: vmcause r0  (single register operand)
             rd = parse_register(parts[1])
             binary.extend(struct.pack('BBBB', opcode, rd, 0, 0))
@@ -173,7 +182,7 @@ def assemble(asm_text):
             # Format: vmenter r0  (VMCS pointer in register)
             rd = parse_register(parts[1]) if len(parts) > 1 else 0
             binary.extend(struct.pack('BBBB', opcode, rd, 0, 0))
-        elif opcode_str == 'tlbflushv':
+        elif opcode_str in ['tlbflushv', 'iret']:
             # Format: tlbflushv (no operands)
             binary.extend(struct.pack('BBBB', opcode, 0, 0, 0))
         elif opcode_str in ['syscall', 'hypercall']:
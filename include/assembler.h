@@ -0,0 +1,25 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "vobj.h"
+
+/* ============================================
+   vISA ASSEMBLER
+   ============================================
+
+   Accepts the same syntax as examples/assembler.py, plus directives:
+     .text / .data / .bss     Switch section (default .text)
+     .byte v, ...             Emit bytes (.data)
+     .word v, ...             Emit 32-bit big-endian words (.data)
+     .space n                 Reserve n zero bytes (.data or .bss)
+     .entry LABEL             Entry point (default: address 0)
+   Labels (NAME:) in any section become symbols. */
+
+#define ASM_MAX_LABELS 1024
+
+/* Assemble source text into an image; on failure error holds "line N: ..." */
+bool visa_assemble(const char* source, vobj_image_t* image, char* error, size_t error_size);
+
+#endif /* ASSEMBLER_H */
@@ -0,0 +1,68 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "vmlimits.h"
+
+/* ============================================
+   IDLE GUEST MEMORY COMPRESSION
+   ============================================ */
+
+struct hypervisor_t;
+
+#define COMPRESS_DEFAULT_IDLE_MS 1000    /* VM idle this long before its cold pages go */
+#define COMPRESS_DEFAULT_PAGES 256       /* Pages examined per wake-up */
+#define COMPRESS_SLEEP_MS 20             /* Pause between batches */
+#define COMPRESS_MAX_SIZE (PAGE_SIZE * 3 / 4)  /* Pages that do not shrink below this stay */
+
+/* A compressed guest page. While compressed, the page's EPT entry is not
+   present and its host_page points here. */
+typedef struct {
+    uint16_t size;
+    uint8_t data[];
+} compressed_page_t;
+
+typedef struct {
+    uint64_t pages_compressed;   /* Pages currently compressed */
+    uint64_t compressed_bytes;   /* Pool bytes holding them */
+    uint64_t bytes_reclaimed;    /* pages_compressed * PAGE_SIZE - compressed_bytes */
+    uint64_t page_ins;           /* Faults that decompressed a page */
+    uint64_t page_in_ns;         /* Summed decompression latency */
+    uint64_t page_in_max_ns;
+    uint64_t incompressible;     /* Cold pages left resident because they did not shrink */
+    uint64_t sweeps;             /* Passes over an idle VM's page table */
+    uint64_t scan_ns;            /* Compressor CPU time */
+} compress_stats_t;
+
+typedef struct compress_t {
+    struct hypervisor_t* hv;
+    pthread_t thread;
+    pthread_mutex_t lock;     /* Tunables, cursors, statistics */
+    pthread_cond_t wake;
+    bool running;
+
+    uint64_t idle_ns;
+    uint32_t pages_to_scan;
+
+    /* Per boot vCPU slot: position in the current sweep and when the last
+       sweep finished */
+    uint32_t cursor[MAX_GUESTS];
+    uint64_t swept_ns[MAX_GUESTS];
+
+    uint64_t incompressible;
+    uint64_t sweeps;
+    uint64_t scan_ns;
+} compress_t;
+
+/* ============ LZ CODEC ============ */
+/* Byte-oriented LZ77 (LZ4-style sequences, 64 KB window). compress returns the
+   encoded size, or 0 if it would exceed capacity; decompress returns false
+   unless the input decodes to exactly dst_size bytes. */
+uint32_t lz_compress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t capacity);
+bool lz_decompress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t dst_size);
+
+void compress_destroy(compress_t* compress);
+
+#endif /* COMPRESS_H */
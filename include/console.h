@@ -0,0 +1,58 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "vmlimits.h"
+
+/* ============================================
+   BUFFERED GUEST CONSOLE
+   ============================================ */
+
+struct hypervisor_t;
+
+#define CONSOLE_BUFFER_SIZE 4096     /* Per-guest ring; also the largest single print */
+
+/* One guest's output channel. The scheduler thread appends to the ring; the
+   drain thread empties it. A print that does not fit is parked in `pending`
+   and the guest blocks until the drain thread has made room for it. */
+typedef struct {
+    uint8_t ring[CONSOLE_BUFFER_SIZE];
+    uint32_t head;
+    uint32_t count;
+
+    uint8_t pending[CONSOLE_BUFFER_SIZE];
+    uint32_t pending_length;
+    bool waiting;             /* Guest blocked on WAIT_CONSOLE until pending is queued */
+
+    FILE* out;                /* Per-guest log, or NULL for the multiplexed stream */
+    bool line_start;          /* Multiplexed stream: next byte starts a line */
+
+    uint64_t bytes;           /* Bytes accepted from the guest */
+    uint64_t prints;
+    uint64_t stalls;          /* Prints that blocked on a full buffer */
+} console_channel_t;
+
+typedef struct console_t {
+    struct hypervisor_t* hv;
+    pthread_t thread;
+    pthread_mutex_t lock;     /* Rings, pending prints, running */
+    pthread_cond_t wake;
+    bool running;
+
+    FILE* stream;             /* Multiplexed destination for guests without a log; NULL = config.output */
+    char* log_prefix;         /* Per-guest logs are <prefix><id>.log (NULL = multiplex) */
+    console_channel_t channels[MAX_GUESTS];
+} console_t;
+
+/* ============ CONSOLE API ============ */
+/* Queue a guest print. Returns false if it did not fit: the bytes are kept as
+   the channel's pending print and the caller must block the guest on
+   WAIT_CONSOLE; the drain thread completes it with the byte count. */
+bool console_write(console_t* console, uint32_t guest_id, const uint8_t* data, uint32_t length);
+
+void console_destroy(console_t* console);
+
+#endif /* CONSOLE_H */
@@ -0,0 +1,54 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ucontext.h>
+
+/* ============================================
+   EXIT HANDLER COROUTINES
+   ============================================ */
+
+struct hypervisor_t;
+struct guest_vm_t;
+
+#define FIBER_STACK_SIZE (64 * 1024)
+#define FIBER_IO_MAX (64 * 1024)     /* I/O scratch per vCPU; also the largest single transfer */
+
+/* Exit handler that may suspend; returns the value delivered in r0 */
+typedef uint32_t (*fiber_handler_t)(struct hypervisor_t* hv, struct guest_vm_t* guest);
+
+typedef enum {
+    FIBER_IDLE = 0,           /* No handler in progress */
+    FIBER_RUNNING = 1,        /* Handler executing on the scheduler thread */
+    FIBER_SUSPENDED = 2,      /* Handler waiting; the vCPU is GUEST_BLOCKED */
+    FIBER_DONE = 3            /* Handler returned; result is final */
+} fiber_state_t;
+
+/* One per vCPU, created on its first slow exit. A handler runs on the fiber's
+   own stack so it can wait in the middle of its work while the scheduler
+   thread runs other guests; the wakeup that ends the wait switches back in. */
+typedef struct fiber_t {
+    ucontext_t context;
+    ucontext_t host;          /* Scheduler context the fiber returns to */
+    uint8_t* stack;
+    fiber_state_t state;
+    fiber_handler_t handler;
+    struct hypervisor_t* hv;
+    struct guest_vm_t* guest;
+    uint32_t result;          /* Wakeup value on resume, handler result when done */
+    uint8_t* buffer;          /* FIBER_IO_MAX bytes; lives as long as the fiber */
+
+    uint64_t runs;            /* Handlers started */
+    uint64_t suspends;        /* Waits inside handlers */
+} fiber_t;
+
+/* ============ FIBER API ============ */
+fiber_t* fiber_create(void);
+void fiber_destroy(fiber_t* fiber);
+
+/* Inside a handler: switch back to the scheduler until the fiber is resumed;
+   returns the wakeup value. The caller must have parked the guest first. */
+uint32_t fiber_suspend(fiber_t* fiber);
+
+#endif /* FIBER_H */
@@ -0,0 +1,67 @@
+#ifndef GRANT_H
+#define GRANT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================
+   INTER-GUEST GRANT TABLES
+   ============================================ */
+
+#define GRANT_MAX_ENTRIES 16           /* Grants one VM can have outstanding */
+#define GRANT_WRITABLE 0x80000000u     /* HYPERCALL_GRANT r3 flag: the peer may write */
+#define GRANT_INVALID 0xFFFFFFFFu      /* Hypercall result when a grant request is refused */
+
+/* EPT changes a grant makes, in the form recordings log them. The owner
+   pins and unpins its own pages; the peer maps and unmaps the owner's. */
+typedef enum {
+    GRANT_OP_PIN = 0,
+    GRANT_OP_UNPIN = 1,
+    GRANT_OP_MAP_RO = 2,
+    GRANT_OP_MAP_RW = 3,
+    GRANT_OP_UNMAP = 4
+} grant_op_t;
+
+/* A range of the owner's guest physical pages lent to one peer VM. While
+   granted the pages are pinned to the owner's private backing: they are never
+   merged, compressed or executed, so both EPTs can point at the same host
+   page for as long as the grant lives. */
+typedef struct {
+    bool in_use;
+    bool writable;            /* Peer mapping is writable */
+    bool mapped;              /* The peer has mapped it at peer_page */
+    uint32_t peer;            /* Boot vCPU slot of the peer VM */
+    uint32_t first_page;      /* Owner guest physical page */
+    uint32_t nr_pages;
+    uint32_t peer_page;
+} grant_entry_t;
+
+/* Per VM, on the boot vCPU; created by the first grant or mapping */
+typedef struct grant_table_t {
+    grant_entry_t entries[GRANT_MAX_ENTRIES];   /* Indexed by grant ref */
+    uint32_t pages_granted;   /* Own pages pinned for peers */
+    uint32_t pages_mapped;    /* Peers' pages mapped into this VM */
+    uint64_t maps;
+    uint64_t revokes;
+    uint64_t notifies;        /* Doorbells rung by this VM */
+} grant_table_t;
+
+/* ============ SPSC RING LAYOUT ============ */
+/* The guest-side protocol for a channel over one granted region, shared by
+   a producer and a consumer. Indices are free-running big-endian byte counts;
+   data bytes live at GRANT_RING_DATA + index % capacity, where the capacity
+   is a power of two that both sides agree on. Each index has a single writer;
+   the indices and the wake word each sit in their own 64-byte line.
+
+   Producer: store the payload, then publish it with `fadd` on TAIL (a full
+   barrier). If WAKE is set, clear it and ring the consumer with
+   HYPERCALL_NOTIFY.
+   Consumer: read TAIL with `fadd` of 0, consume up to it, then release the
+   space with `fadd` on HEAD. When the ring is empty, set WAKE, re-read TAIL,
+   and only call HYPERCALL_WAIT_NOTIFY if it is still empty. */
+#define GRANT_RING_HEAD 0              /* Consumer index */
+#define GRANT_RING_TAIL 64             /* Producer index */
+#define GRANT_RING_WAKE 128            /* Non-zero while the consumer sleeps */
+#define GRANT_RING_DATA 192
+
+#endif /* GRANT_H */
@@ -0,0 +1,65 @@
+#ifndef IOPOOL_H
+#define IOPOOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "waitqueue.h"
+
+/* ============================================
+   ASYNCHRONOUS HOST I/O THREAD POOL
+   ============================================ */
+
+struct hypervisor_t;
+
+#define IOPOOL_DEFAULT_THREADS 4
+#define IOPOOL_MAX_THREADS 32
+
+typedef enum {
+    IO_READ = 0,              /* pread into buffer */
+    IO_WRITE = 1              /* pwrite from buffer */
+} io_op_t;
+
+/* Owned by the submitter until its completion is posted; the result (bytes
+   transferred, or 0xFFFFFFFF on error) is delivered as a wakeup for
+   (event, key) through hypervisor_async_complete */
+typedef struct io_request_t {
+    io_op_t op;
+    int fd;
+    uint8_t* buffer;
+    uint32_t length;
+    uint64_t offset;
+    wait_event_t event;
+    uint32_t key;
+    uint64_t submit_ns;
+    struct io_request_t* next;
+} io_request_t;
+
+typedef struct iopool_t {
+    struct hypervisor_t* hv;
+    pthread_t threads[IOPOOL_MAX_THREADS];
+    uint32_t nr_threads;
+
+    pthread_mutex_t lock;     /* Queue, running and statistics */
+    pthread_cond_t wake;
+    bool running;
+    io_request_t* head;
+    io_request_t** tail;
+
+    /* Statistics */
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t latency_ns;      /* Submit to completion, summed */
+    uint32_t in_flight;
+    uint32_t max_in_flight;
+} iopool_t;
+
+/* ============ I/O POOL API ============ */
+/* Queue a request; it is counted as an outstanding async operation so the
+   scheduler never reports the waiting guest as deadlocked */
+void iopool_submit(iopool_t* pool, io_request_t* request);
+
+void iopool_destroy(iopool_t* pool);
+
+#endif /* IOPOOL_H */
@@ -3,20 +3,45 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "vmlimits.h"
+#include "scheduler.h"
+#include "waitqueue.h"
+#include "spmd.h"
+#include "vobj.h"
+#include "ksm.h"
+#include "replay.h"
+#include "console.h"
+#include "placement.h"
+#include "fiber.h"
+#include "iopool.h"
+#include "mmio.h"
+#include "compress.h"
+#include "perf.h"
+#include "grant.h"
+#include "verify.h"
+#include "visa.h"
 
 /* ============================================
    HYPERVISOR VIRTUALIZATION SUPPORT 
    ============================================ */
 
 /* ISA Configuration */
-#define REGISTER_COUNT 32
 #define MEMORY_SIZE (64 * 1024)      /* 64 KB host physical memory */
-#define GUEST_VIRT_MEMORY_SIZE (4 * 1024 * 1024)  /* 4 MB guest virtual space */
-#define GUEST_PHYS_MEMORY_SIZE (16 * 1024)         /* 16 KB guest physical space */
-#define PAGE_SIZE 4096               /* 4 KB pages */
-#define MAX_GUESTS 4                 /* Max guest VMs */
+#define GUEST_VIRT_MEMORY_SIZE (4 * 1024 * 1024)  /* Minimum guest virtual space (4 MB) */
+#define GUEST_PHYS_MEMORY_SIZE (16 * 1024)         /* Default guest physical space (16 KB) */
+#define GUEST_MAX_MEMORY_SIZE (2048u * 1024 * 1024) /* Largest guest physical space (2 GB) */
+#define MAX_VCPUS 4                  /* Max vCPUs per guest VM */
 #define INSTRUCTION_SIZE 4           /* 4 bytes per instruction */
 
+/* Preemption / Basic-Block Execution */
+#define DEFAULT_TIME_QUANTUM 10000   /* Instructions per slice before VMCAUSE_TIMER */
+#define MAX_BLOCK_INSTRUCTIONS 32    /* Longest decoded basic block */
+#define BLOCK_CACHE_SIZE 128         /* Decoded blocks cached per guest */
+
+#define GUEST_MAILBOX_SIZE 16        /* Pending inter-guest messages per guest */
+#define LOG_LINE_MAX 512             /* Longest log line built with log_append */
+
 /* ============ EXECUTION MODES ============ */
 typedef enum {
     MODE_HOST = 0,      /* Hypervisor/Host mode */
@@ -57,6 +82,9 @@ typedef enum {
     VMTRAPCFG_PAGE_FAULT = (1 << 3),         /* Trap page faults */
 } vmtrapcfg_bits_t;
 
+#define VMTRAPCFG_BITS 4
+#define VMTRAPCFG_DEFAULT VMTRAPCFG_PRIVILEGED_INSTR  /* Everything else runs inline */
+
 /* ============ INTERRUPT TYPES ============ */
 typedef enum {
     IRQ_SYSCALL = 0x01,
@@ -67,6 +95,11 @@ typedef enum {
     IRQ_IO = 0x06
 } interrupt_type_t;
 
+/* In-guest delivery: the table loaded by LIVT holds one big-endian handler
+   address per vector (0 = not handled). Delivery pushes the return PC and
+   then an information word (faulting PC or address, timer tick count). */
+#define IRQ_VECTORS 8
+
 /* ============ INSTRUCTION TYPES ============ */
 typedef enum {
     /* Standard instructions */
@@ -89,10 +122,19 @@ typedef enum {
     OP_SUBI = 0x0F,    /* subi rd, rs, imm8 - subtract immediate */
     OP_MULI = 0x10,    /* muli rd, rs, imm8 - multiply immediate */
     OP_DIVI = 0x11,    /* divi rd, rs, imm8 - divide immediate */
+
+    /* Atomic instructions on aligned big-endian 32-bit words (sequentially consistent) */
+    OP_CAS = 0x12,     /* cas rd, rs1, rs2 - if [rs1] == rd then [rs1] = rs2; rd = old [rs1] */
+    OP_FADD = 0x13,    /* fadd rd, rs1, rs2 - rd = [rs1]; [rs1] += rs2 */
+    OP_FENCE = 0x14,   /* fence - full memory barrier */
     
     /* System instructions */
     OP_SYSCALL = 0x20,     /* System call */
     OP_HYPERCALL = 0x21,   /* Hypercall */
+    OP_IPI = 0x22,         /* Inter-processor interrupt: ipi rd (target vCPU in rd) */
+    OP_LIVT = 0x23,        /* Load interrupt vector table: livt rd (0 = none) */
+    OP_IRET = 0x24,        /* Return from interrupt handler: iret */
+    OP_STIMER = 0x25,      /* Virtual timer: stimer rd (IRQ_TIMER every rd instructions, 0 = off) */
     
     /* ============ VIRTUALIZATION ISA INSTRUCTIONS ============ */
     OP_VMENTER = 0x30,      /* Enter guest: vmenter vmcs_ptr */
@@ -107,11 +149,25 @@ typedef enum {
 } opcode_t;
 
 /* ============ HYPERCALL TYPES ============ */
+/* `hypercall rN`: number in rN, arguments in r1-r3, result in r0 */
 typedef enum {
-    HYPERCALL_PRINT = 1,
+    HYPERCALL_PRINT = 1,       /* Print r2 bytes at r1 to the console; r0 = bytes */
     HYPERCALL_READ_MEM = 2,
     HYPERCALL_WRITE_MEM = 3,
-    HYPERCALL_EXIT = 4
+    HYPERCALL_EXIT = 4,
+    HYPERCALL_SLEEP = 5,       /* Block for r1 microseconds (0 = yield) */
+    HYPERCALL_SEND = 6,        /* Send r2 to guest r1; r0 = 1 if delivered */
+    HYPERCALL_RECV = 7,        /* Block until a message arrives; r0 = message */
+    HYPERCALL_VCPU_ID = 8,     /* r0 = index of the calling vCPU within its VM */
+    HYPERCALL_WAIT_IPI = 9,    /* Block until an IPI arrives; r0 = mask of sending vCPUs */
+    HYPERCALL_DISK_READ = 10,  /* r1=address, r2=length, r3=disk offset; r0 = bytes read */
+    HYPERCALL_DISK_WRITE = 11, /* r1=address, r2=length, r3=disk offset; r0 = bytes written */
+    HYPERCALL_GRANT = 12,      /* Lend r3 pages at r2 to guest r1 (| GRANT_WRITABLE); r0 = grant ref */
+    HYPERCALL_GRANT_MAP = 13,  /* Map grant r2 of guest r1 at r3; r0 = pages */
+    HYPERCALL_GRANT_UNMAP = 14,   /* Unmap grant r2 of guest r1; r0 = pages */
+    HYPERCALL_GRANT_REVOKE = 15,  /* End grant r1, unmapping it from the peer; r0 = pages */
+    HYPERCALL_NOTIFY = 16,     /* Ring guest r1's doorbell; r0 = 1 if delivered */
+    HYPERCALL_WAIT_NOTIFY = 17 /* Block until a doorbell rings; r0 = mask of ringing guests */
 } hypercall_number_t;
 
 /* Instruction Structure (32-bit) */
@@ -122,6 +178,18 @@ typedef struct {
     uint8_t rs2;     /* source register 2 */
 } instruction_t;
 
+/* ============ DECODED BASIC BLOCK ============ */
+/* Straight-line run of instructions ending at a control transfer, exit-causing
+   instruction or page boundary. Preemption budgets are charged per block. */
+typedef struct {
+    uint32_t start_pc;        /* Guest virtual address of first instruction */
+    uint32_t length;          /* Number of decoded instructions */
+    uint32_t exits;           /* Bit per instruction trapped by the config it was decoded under */
+    bool valid;
+    bool verified;            /* Decoded from verified code: runs without operand checks */
+    instruction_t instrs[MAX_BLOCK_INSTRUCTIONS];
+} decoded_block_t;
+
 /* ============ GUEST PAGE TABLE ============ */
 typedef struct {
     uint32_t guest_physical_page;  /* Guest physical page (translated by guest) */
@@ -139,11 +207,27 @@ typedef struct {
 } host_page_table_entry_t;
 
 /* ============ EXTENDED PAGE TABLE (EPT/NPT) ============ */
-/* Maps guest physical → host physical (hypervisor-managed) */
+/* Maps guest physical → host physical (hypervisor-managed). Every entry maps a
+   host page: untouched pages share the read-only zero page, and the first write
+   to a non-writable entry faults in the guest's own backing page. Entries that
+   are not present must not be dereferenced directly: MMIO pages (which map the
+   zero page for non-device accesses) and compressed pages (host_page is the
+   compressed_page_t) both go through guest_memory_page_in. Granted pages
+   (grant.c) map the owner's backing in both VMs. Verified code pages
+   (verify.c) are kept read-only, so the first write after verification
+   faults and withdraws it. */
 typedef struct {
+    uint8_t* host_page;            /* Host address backing this guest page */
     uint32_t host_physical_page;
     bool present;
     bool writable;
+    bool code;                     /* Decoded into the block cache */
+    bool shared;                   /* Mapped to a merged KSM page (read-only) */
+    bool mmio;                     /* Device page (never present): LOAD/STORE go to the MMIO map */
+    bool grant;                    /* Lent to or borrowed from another VM: pinned, never executed */
+    bool verified;                 /* Code slots proven safe; write-protected while set */
+    bool reverify;                 /* Written since it was verified: check again at the next decode */
+    uint8_t verify_writes;         /* Writes that withdrew verification (capped at VERIFY_MAX_REWRITES) */
 } ept_entry_t;
 
 /* ============ VIRTUAL MACHINE CONTROL STRUCTURE (VMCS) ============ */
@@ -186,7 +270,8 @@ typedef struct {
     privilege_level_t priv;   /* Guest privilege level */
     
     /* Guest Memory Management */
-    guest_page_table_entry_t guest_page_table[GUEST_VIRT_MEMORY_SIZE / PAGE_SIZE];
+    guest_page_table_entry_t* guest_page_table;  /* One entry per virtual page */
+    uint32_t guest_page_count;
     uint32_t guest_pgtbl_root;    /* Guest page table base (CR3 equiv) */
     
     /* Host Memory Management */
@@ -202,21 +287,102 @@ typedef struct {
     /* Guest State */
     guest_state_t state;
     vmcause_t last_exit_cause;  /* Last VMEXIT reason */
+
+    /* In-guest interrupts: raised by the executor, delivered at block boundaries */
+    uint32_t ivt_base;        /* Guest address of the vector table (0 = none) */
+    uint32_t irq_pending;     /* Bit per interrupt_type_t */
+    uint32_t irq_info[IRQ_VECTORS];  /* Word pushed with each pending vector */
+    bool irq_masked;          /* Inside a handler (set on delivery, cleared by IRET) */
+    uint32_t timer_period;    /* Guest instructions between timer ticks (0 = off) */
+    uint32_t timer_next;      /* instruction_count of the next tick */
+    uint32_t timer_ticks;
+    uint32_t irq_delivered[IRQ_VECTORS];
+
+    /* Exit policy (vmcs.trap_config): sensitive events by trap bit */
+    uint64_t trap_inline[VMTRAPCFG_BITS];  /* Emulated without leaving the dispatcher */
+    uint64_t trap_exits[VMTRAPCFG_BITS];
+    bool trap_acked;          /* The exit at trap_acked_pc was taken; it runs inline when resumed */
+    uint32_t trap_acked_pc;
+    uint32_t trap_attempts;   /* Trap exits taken; the instruction retires on its inline rerun */
     
 } vcpu_t;
 
 /* ============ GUEST VM ============ */
-typedef struct {
-    uint32_t vm_id;
+/* One schedulable vCPU context. A guest VM with N vCPUs occupies N slots;
+   the boot vCPU's slot owns the memory and the others alias it. */
+typedef struct guest_vm_t {
+    uint32_t vm_id;           /* Slot index (unique per vCPU) */
+    struct hypervisor_t* hv;  /* Owning instance */
     vcpu_t vcpu;              /* Virtual CPU */
+
+    /* SMP: secondary vCPUs point vm at the boot vCPU, which lists them all */
+    struct guest_vm_t* vm;
+    uint32_t vcpu_index;      /* 0 for the boot vCPU */
+    uint32_t nr_vcpus;        /* Boot vCPU only */
+    struct guest_vm_t* vcpus[MAX_VCPUS];
+    uint32_t ipi_pending;     /* Bit per sending vCPU index, cleared by HYPERCALL_WAIT_IPI */
     
-    /* Guest Memory */
-    uint8_t guest_memory[GUEST_PHYS_MEMORY_SIZE];  /* Guest physical memory */
-    ept_entry_t ept[GUEST_PHYS_MEMORY_SIZE / PAGE_SIZE];  /* Extended page table */
+    /* Guest Memory (memory.c): host backing is reserved up front and
+       populated on first write. Secondary vCPUs share the boot vCPU's
+       mapping; counters and the lock are only used on the boot vCPU. */
+    uint8_t* memory_base;     /* mmap reservation of memory_size bytes */
+    uint32_t memory_size;     /* Guest physical bytes (page multiple) */
+    ept_entry_t* ept;         /* Extended page table, memory_size / PAGE_SIZE entries */
+    uint32_t resident_pages;  /* Pages with private host backing */
+    uint32_t shared_pages;    /* Pages mapped to merged KSM pages */
+    uint32_t cow_breaks;      /* Writes that un-shared a merged page */
+    uint32_t compressed_pages;  /* Pages held compressed (compress.c) */
+    uint64_t compressed_bytes;
+    uint64_t page_ins;        /* Accesses that decompressed a page */
+    uint64_t page_in_ns;
+    uint64_t page_in_max_ns;
+    pthread_mutex_t mem_lock; /* Held while executing; the KSM scanner only trylocks */
+    int32_t home_node;        /* NUMA node memory is bound to (PLACEMENT_NODE_NONE = any) */
     
+    /* Decoded block cache (invalidated by TLBFLUSHV and writes to code pages) */
+    decoded_block_t block_cache[BLOCK_CACHE_SIZE];
+    uint32_t code_page_list[BLOCK_CACHE_SIZE];  /* Guest physical pages with ept[].code set */
+    uint32_t nr_code_pages;
+
+    /* Scheduling */
+    sched_entity_t sched;
+    uint64_t last_run_ns;     /* End of the vCPU's last slice (idle detection) */
+    wait_entity_t wait;       /* Wait queue linkage while GUEST_BLOCKED */
+
+    /* Slow exits (fiber.c): the handler coroutine, created on first use */
+    fiber_t* fiber;
+    int disk_fd;              /* Boot vCPU only: HYPERCALL_DISK_* backing file, -1 if none */
+    mmio_map_t* mmio;         /* Boot vCPU only: device ranges (NULL until the first device) */
+    grant_table_t* grants;    /* Boot vCPU only: pages lent and borrowed (NULL until the first grant) */
+
+    /* Code verification (verify.c), boot vCPU only */
+    bool verify;              /* Code pages are verified at load and again after writes */
+    uint32_t verified_pages;  /* Code pages currently verified */
+    uint32_t verify_runs;     /* Page verifications, including re-verification after writes */
+    uint32_t verify_failures;
+
+    /* Inter-guest messages (HYPERCALL_SEND / HYPERCALL_RECV) */
+    uint32_t mailbox[GUEST_MAILBOX_SIZE];
+    uint32_t mailbox_head;
+    uint32_t mailbox_count;
+    uint32_t notify_pending;  /* Bit per guest slot that rang, cleared by HYPERCALL_WAIT_NOTIFY */
+
+    /* Preemption budget, checked at basic-block boundaries (0 = unlimited) */
+    uint32_t quantum_instructions;
+    uint64_t quantum_ns;
+
+    /* Loaded image identity (guests with equal images can run in lockstep) */
+    uint64_t image_hash;
+    uint32_t image_size;      /* Code + data bytes loaded */
+    uint32_t code_size;       /* Code section bytes (whole image for raw binaries) */
+    bool spmd_ejected;        /* Left lockstep at its PC; the next slice runs scalar */
+    vobj_symbol_t* symbols;   /* Symbol table from .isa/.vobj images (NULL for raw) */
+    uint32_t symbol_count;
+
     /* Metadata */
     guest_state_t state;
-    uint32_t instruction_count;
+    uint32_t instruction_count;  /* Retired */
+    uint32_t steps;              /* Retired plus trapped attempts: the clock replay slices run by */
 } guest_vm_t;
 
 /* ============ HOST HYPERVISOR ============ */
@@ -231,11 +397,49 @@ typedef struct hypervisor_t {
     
     /* Host memory */
     uint8_t host_memory[MEMORY_SIZE];
+    /* Absorbs host-side writes to MMIO pages (CALL pushes, exit handler copies),
+       where only guest STOREs reach devices, and every write to a read-only grant */
+    uint8_t mmio_sink[PAGE_SIZE];
     host_page_table_entry_t host_page_table[MEMORY_SIZE / PAGE_SIZE];
     
     /* Scheduling */
+    scheduler_t scheduler;
+    waitq_t waitq;            /* Blocked guests, keyed by the event they wait for */
     uint32_t tick_count;
     bool halted;
+    bool spmd;                /* Batch guests sharing an image and PC in lockstep */
+
+    /* Same-page merging scanner (NULL until started) */
+    ksm_t* ksm;
+
+    /* Idle memory compressor (NULL until started) */
+    compress_t* compress;
+
+    /* CPU pinning, NUMA topology and memory policy */
+    placement_t placement;
+
+    /* Buffered guest console (NULL until started or first printed to) */
+    console_t* console;
+
+    /* Active recording or replay (NULL when neither) */
+    replay_t* replay;
+
+    /* Host I/O threads for asynchronous exit handlers (NULL until first used) */
+    iopool_t* iopool;
+
+    /* Host performance counters by guest and phase (NULL unless enabled) */
+    perf_t* perf;
+
+    /* Debugging */
+    bool trace;               /* Print every executed guest instruction */
+    bool verify;              /* Verify the code of guests created from now on (default on) */
+
+    /* Host output and embedding callbacks (log.c, visa.c). A stdio instance
+       logs to stdout (errors to stderr) and multiplexes guest consoles to
+       stdout; an embedded one only calls what config provides. */
+    bool stdio;
+    visa_config_t config;
+    char last_error[LOG_LINE_MAX];
 } hypervisor_t;
 
 /* ============ HYPERVISOR ISA INSTRUCTION HANDLERS ============ */
@@ -262,18 +466,270 @@ void isa_ldhptr(hypervisor_t* hv, uint32_t host_pgtbl);
 void isa_tlbflushv(hypervisor_t* hv);
 
 /* ============ HYPERVISOR CORE API ============ */
-hypervisor_t* hypervisor_create(void);
+hypervisor_t* hypervisor_create(void);  /* Stdio instance, as used by the vISA binary */
+hypervisor_t* hypervisor_create_with(const visa_config_t* config);  /* NULL config = stdio */
 void hypervisor_destroy(hypervisor_t* hv);
 
 /* Guest VM Management */
+/* Images may be assembly source (.isa), a vISA object (.vobj) or a raw binary.
+   memory_size is rounded up to whole pages (0 = GUEST_PHYS_MEMORY_SIZE). */
 uint32_t hypervisor_create_guest(hypervisor_t* hv, const char* guest_image);
+uint32_t hypervisor_create_guest_sized(hypervisor_t* hv, const char* guest_image, uint32_t memory_size);
+uint32_t hypervisor_create_guest_from_object(hypervisor_t* hv, const vobj_image_t* image,
+                                             uint32_t memory_size);
+/* As above, but *status says why 0 was returned. `name` labels errors; a
+   buffer is assembled when `source` is set (it must then be NUL-terminated). */
+uint32_t hypervisor_load_guest_file(hypervisor_t* hv, const char* path, uint32_t memory_size,
+                                    visa_status_t* status);
+uint32_t hypervisor_load_guest_buffer(hypervisor_t* hv, const char* name, const uint8_t* buf, size_t size,
+                                      bool source, uint32_t memory_size, visa_status_t* status);
+/* Give a guest nr_vcpus vCPUs in total. Secondaries start at the entry point
+   with the boot vCPU's registers and are scheduled independently. */
+bool hypervisor_set_vcpus(hypervisor_t* hv, uint32_t guest_id, uint32_t nr_vcpus);
+/* Deliver an IPI from `from` to vCPU `target` of its VM; false if no such vCPU */
+bool hypervisor_send_ipi(hypervisor_t* hv, guest_vm_t* from, uint32_t target);
 void hypervisor_run_guest(hypervisor_t* hv, uint32_t guest_id);
 
+/* Set a guest's preemption quantum (instructions and/or wall-clock ns, 0 = unlimited) */
+void hypervisor_set_quantum(hypervisor_t* hv, uint32_t guest_id,
+                            uint32_t instructions, uint64_t nanoseconds);
+
+/* Set which sensitive events of a vCPU exit (vmtrapcfg_bits_t); the rest are
+   emulated inline. Decoded blocks are recompiled under the new policy. */
+void hypervisor_set_trap_config(hypervisor_t* hv, uint32_t guest_id, uint32_t trap_config);
+
+/* Run one time slice of a guest until it exits or its quantum expires.
+   Returns the exit cause (VMCAUSE_TIMER on preemption, VMCAUSE_NONE on HALT). */
+vmcause_t hypervisor_run_slice(hypervisor_t* hv, guest_vm_t* guest);
+vmcause_t hypervisor_run_slice_budget(hypervisor_t* hv, guest_vm_t* guest,
+                                      uint32_t instructions, uint64_t nanoseconds);
+/* Run exactly `instructions` instructions, stopping mid-block if needed (replay).
+   A VMCAUSE_TIMER exit is taken only when `preempt` is set. */
+vmcause_t hypervisor_run_slice_exact(hypervisor_t* hv, guest_vm_t* guest,
+                                     uint32_t instructions, bool preempt);
+
+/* Handle a VMEXIT; returns true if the guest should be scheduled again */
+bool hypervisor_handle_exit(hypervisor_t* hv, guest_vm_t* guest, vmcause_t cause);
+
+/* Deliver `result` in r0 and VMRESUME the guest; every resume after a VMEXIT
+   goes through here so recordings capture the injected value */
+void hypervisor_resume_guest(hypervisor_t* hv, guest_vm_t* guest, uint32_t result);
+
+/* Scheduling (scheduler.c) */
+void hypervisor_set_scheduler(hypervisor_t* hv, sched_policy_t policy);
+void hypervisor_set_sched_params(hypervisor_t* hv, uint32_t guest_id, uint32_t weight, uint32_t cpu_cap);
+uint32_t hypervisor_run(hypervisor_t* hv);  /* Run until all guests stop; returns slices run */
+uint64_t hypervisor_time_ns(void);          /* Monotonic host clock */
+uint64_t hypervisor_hash_bytes(const uint8_t* data, size_t size);  /* FNV-1a 64 */
+
+/* Blocking and wakeups (waitqueue.c). Park/wake run on the scheduler thread;
+   post_wakeup and async_* may be called from any host thread. */
+void hypervisor_block_guest(hypervisor_t* hv, guest_vm_t* guest, wait_event_t event, uint32_t key);
+void hypervisor_sleep_guest(hypervisor_t* hv, guest_vm_t* guest, uint64_t deadline_ns);
+uint32_t hypervisor_wake(hypervisor_t* hv, wait_event_t event, uint32_t key, uint32_t result);
+void hypervisor_post_wakeup(hypervisor_t* hv, wait_event_t event, uint32_t key, uint32_t result);
+void hypervisor_async_begin(hypervisor_t* hv);
+void hypervisor_async_complete(hypervisor_t* hv, wait_event_t event, uint32_t key, uint32_t result);
+uint32_t hypervisor_poll_events(hypervisor_t* hv);  /* Apply expired timers and posted wakeups */
+bool hypervisor_idle_wait(hypervisor_t* hv, uint64_t max_wait_ns);  /* false if nothing can wake */
+
+/* Lockstep batch mode (spmd.c): run the guest the scheduler picked, together
+   with queued guests sharing its image and PC, as one SPMD batch bounded by
+   the smallest lane quantum and `nanoseconds`. Accounts every lane with the
+   scheduler; returns the number of lanes, or 0 (nothing run) if none joined. */
+uint32_t hypervisor_run_lockstep(hypervisor_t* hv, guest_vm_t* leader, uint64_t nanoseconds);
+
+/* Hypercalls (hypercall.c); returns true if the guest is still runnable */
+bool hypervisor_handle_hypercall(hypervisor_t* hv, guest_vm_t* guest);
+bool hypervisor_handle_ipi(hypervisor_t* hv, guest_vm_t* guest);  /* IPI instruction exit */
+
 /* Memory Translation */
 uint32_t guest_translate_address(guest_vm_t* guest, uint32_t guest_virt_addr);
 uint32_t host_translate_address(hypervisor_t* hv, uint32_t guest_phys_addr);
 
+/* Guest physical memory (memory.c) */
+bool guest_memory_init(guest_vm_t* guest, uint32_t memory_size);
+void guest_memory_destroy(guest_vm_t* guest);
+uint8_t* guest_memory_fault(guest_vm_t* guest, uint32_t page);  /* Demand-zero / copy-on-write */
+void guest_memory_map_mmio(guest_vm_t* guest, uint32_t page);  /* Turn a page over to devices */
+bool guest_memory_is_private(const guest_vm_t* guest, uint32_t page);  /* Own writable backing */
+bool guest_memory_compress(guest_vm_t* guest, uint32_t page, uint8_t* scratch);  /* false = did not shrink */
+uint8_t* guest_memory_page_in(guest_vm_t* guest, uint32_t page);  /* Not-present access fault */
+const uint8_t* guest_memory_zero_page(void);
+void guest_memory_release(guest_vm_t* guest, uint32_t page);  /* Return backing page to the host */
+void guest_memory_discard(guest_vm_t* guest, uint32_t page);  /* Remap a private page to the zero page */
+void guest_memory_pin_grant(guest_vm_t* guest, uint32_t page, bool pinned);  /* Lend / take back a page */
+void guest_memory_map_grant(guest_vm_t* guest, uint32_t page, uint8_t* host_page, bool writable);
+void guest_memory_unmap_grant(guest_vm_t* guest, uint32_t page);  /* Back to the zero page */
+void guest_memory_write(guest_vm_t* guest, uint32_t guest_phys_addr, const uint8_t* src, uint32_t size);
+void guest_vcpu_attach(guest_vm_t* vm, guest_vm_t* vcpu);  /* Share vm's memory (vm == vcpu: new VM) */
+/* Copy between a host buffer and guest virtual memory on behalf of an exit
+   handler; false if any byte is unmapped. Writes are logged when recording. */
+bool hypervisor_copy_to_guest(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_virt_addr,
+                              const uint8_t* src, uint32_t size);
+bool hypervisor_copy_from_guest(guest_vm_t* guest, uint32_t guest_virt_addr, uint8_t* dst, uint32_t size);
+uint64_t hypervisor_guest_resident_bytes(hypervisor_t* hv, uint32_t guest_id);
+void hypervisor_memory_report(hypervisor_t* hv);
+
+/* Same-page merging (ksm.c): a background thread scans pages_to_scan pages
+   every sleep_ms and merges identical pages across guests copy-on-write.
+   Calling start again while running retunes the scan rate. */
+bool hypervisor_ksm_start(hypervisor_t* hv, uint32_t pages_to_scan, uint32_t sleep_ms);
+void hypervisor_ksm_stop(hypervisor_t* hv);
+void hypervisor_ksm_stats(hypervisor_t* hv, ksm_stats_t* stats);
+
+/* Idle memory compression (compress.c): a background thread finds VMs whose
+   vCPUs have not run for idle_ms and sweeps their page tables. Pages accessed
+   since the previous sweep get their accessed bit cleared; the rest are
+   compressed and their backing returned to the host. The next access to a
+   compressed page decompresses it. */
+bool hypervisor_compress_start(hypervisor_t* hv, uint32_t idle_ms, uint32_t pages_to_scan);
+void hypervisor_compress_stop(hypervisor_t* hv);
+void hypervisor_compress_stats(hypervisor_t* hv, compress_stats_t* stats);
+
+/* Guest console (console.c): HYPERCALL_PRINT copies into a per-guest buffer
+   that a host thread drains to <log_prefix><id>.log, or to stdout with
+   "[Gn]" line tags when log_prefix is NULL. A guest whose buffer is full
+   blocks on WAIT_CONSOLE; it never waits on the host stream itself. */
+bool hypervisor_console_start(hypervisor_t* hv, const char* log_prefix);
+void hypervisor_console_stop(hypervisor_t* hv);  /* Drain all output and join */
+bool hypervisor_console_print(hypervisor_t* hv, guest_vm_t* guest, uint32_t* result);  /* false = block */
+bool hypervisor_console_putc(hypervisor_t* hv, guest_vm_t* guest, uint8_t byte);  /* false = dropped */
+
+/* Asynchronous exits (fiber.c, iopool.c): a handler run with
+   hypervisor_run_handler executes on the vCPU's coroutine. When it awaits
+   host I/O the vCPU blocks on WAIT_HYPERCALL and the scheduler thread moves
+   on to other guests; the completion switches back into the handler, whose
+   return value is delivered in r0. */
+bool hypervisor_run_handler(hypervisor_t* hv, guest_vm_t* guest, fiber_handler_t handler);
+bool hypervisor_resume_handler(hypervisor_t* hv, guest_vm_t* guest, uint32_t result);  /* false = no handler waiting */
+uint32_t hypervisor_await_io(hypervisor_t* hv, guest_vm_t* guest, io_request_t* request);
+bool hypervisor_iopool_start(hypervisor_t* hv, uint32_t nr_threads);  /* 0 = default */
+void hypervisor_iopool_stop(hypervisor_t* hv);  /* Finish queued I/O and join */
+bool hypervisor_attach_disk(hypervisor_t* hv, uint32_t guest_id, const char* path);
+
+/* Memory-mapped I/O (mmio.c, devices.c): devices claim guest physical ranges
+   and every page a range touches stops being RAM. Guest LOADs and STOREs to
+   those pages call the device inline, without a VMEXIT; instruction fetch
+   faults there and other accesses see a zero page. Registration takes the VM's
+   memory lock, so devices may be added while guests run (but not from inside
+   a device callback). */
+bool hypervisor_mmio_register(hypervisor_t* hv, uint32_t guest_id, uint32_t base, uint32_t size,
+                              const mmio_ops_t* ops, void* opaque);
+bool hypervisor_add_device(hypervisor_t* hv, uint32_t guest_id, const char* name, uint32_t base);
+bool guest_mmio_map(guest_vm_t* vm, uint32_t base, uint32_t size,
+                    const mmio_ops_t* ops, void* opaque);  /* Caller holds mem_lock */
+uint8_t guest_mmio_read(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_phys_addr);
+void guest_mmio_write(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_phys_addr, uint8_t value);
+void hypervisor_mmio_report(hypervisor_t* hv);
+
+/* Host output (log.c). Messages are whole lines; levels below the
+   instance's log_level are dropped before they are formatted. */
+typedef struct {
+    char text[LOG_LINE_MAX];
+    size_t length;
+} log_line_t;
+
+void hypervisor_log(hypervisor_t* hv, visa_log_level_t level, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+bool hypervisor_log_enabled(const hypervisor_t* hv, visa_log_level_t level);
+void log_append(log_line_t* line, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Code verification (verify.c): every instruction slot of the image's code
+   section is checked once at load. Blocks decoded from pages that pass run
+   without per-instruction operand checks. Verified pages are write-protected;
+   a write withdraws verification and the page is checked again the next time
+   a block is decoded from it. Caller holds mem_lock. */
+void guest_verify_image(guest_vm_t* vm);
+bool guest_verify_page(guest_vm_t* vm, uint32_t page, bool report);
+void guest_verify_withdraw(guest_vm_t* vm, uint32_t page);  /* Page contents change */
+
+/* Grant tables (grant.c): a guest lends a page-aligned range of its physical
+   memory to one peer VM, which maps it into its own physical address space.
+   Both EPTs then point at the owner's host pages, so data written by one
+   side is seen by the other without a copy or an exit. Guests and VMs are
+   named by slot index, as for HYPERCALL_SEND. Calls take the memory locks
+   of the VMs involved, lowest slot first. */
+uint32_t hypervisor_grant(hypervisor_t* hv, guest_vm_t* owner, uint32_t peer_id,
+                          uint32_t guest_phys_addr, uint32_t nr_pages, bool writable);  /* Grant ref */
+uint32_t hypervisor_grant_map(hypervisor_t* hv, guest_vm_t* peer, uint32_t owner_id,
+                              uint32_t ref, uint32_t guest_phys_addr);  /* Pages mapped */
+uint32_t hypervisor_grant_unmap(hypervisor_t* hv, guest_vm_t* peer, uint32_t owner_id, uint32_t ref);
+uint32_t hypervisor_grant_revoke(hypervisor_t* hv, guest_vm_t* owner, uint32_t ref);
+bool hypervisor_notify(hypervisor_t* hv, guest_vm_t* from, uint32_t target);  /* Ring a doorbell */
+/* Remap vm's pages for one grant step; caller holds both VMs' mem_lock */
+void guest_grant_apply(guest_vm_t* vm, grant_op_t op, uint32_t page, uint32_t nr_pages,
+                       guest_vm_t* owner, uint32_t owner_page);
+void hypervisor_grant_report(hypervisor_t* hv);
+
+/* Placement (placement.c): guests take their home node from
+   placement.guest_node when created and bind their RAM to it before the image
+   is loaded. Unless pinned, the worker moves to a guest's home node before
+   running its slice. */
+bool hypervisor_pin_worker(hypervisor_t* hv, const cpu_set_t* cpus);
+void hypervisor_place_vcpu(hypervisor_t* hv, guest_vm_t* guest);
+int32_t hypervisor_next_home_node(hypervisor_t* hv);
+void hypervisor_placement_report(hypervisor_t* hv);
+
+/* Host performance counters (perf.c): the execution thread's cycles,
+   instructions, branch and cache misses are read at every slice, decode-miss,
+   exit and idle boundary and charged to the guest and phase that ran. With
+   sample_period set, one block in that many is also bracketed by reads and
+   charged to its opcodes. Without perf_event_open only time is attributed. */
+bool hypervisor_perf_start(hypervisor_t* hv, uint32_t sample_period);  /* 0 = no opcode sampling */
+void hypervisor_perf_report(hypervisor_t* hv);
+
+/* Record/replay (replay.c): a recording snapshots every guest, then logs slice
+   lengths, injected r0 values and hypervisor state changes. Replay restores the
+   snapshot into an empty hypervisor and re-executes the log, checking each
+   slice against its recorded register fingerprint. */
+bool hypervisor_record_start(hypervisor_t* hv, const char* path);
+void hypervisor_record_stop(hypervisor_t* hv);
+bool hypervisor_replay(hypervisor_t* hv, const char* path);
+
+/* Byte access to guest physical memory; callers bounds-check against memory_size */
+static inline uint8_t guest_read8(guest_vm_t* guest, uint32_t guest_phys_addr) {
+    const ept_entry_t* entry = &guest->ept[guest_phys_addr / PAGE_SIZE];
+    const uint8_t* page = __builtin_expect(entry->present, 1)
+        ? entry->host_page : guest_memory_page_in(guest, guest_phys_addr / PAGE_SIZE);
+    return page[guest_phys_addr % PAGE_SIZE];
+}
+
+static inline void guest_write8(guest_vm_t* guest, uint32_t guest_phys_addr, uint8_t value) {
+    ept_entry_t* entry = &guest->ept[guest_phys_addr / PAGE_SIZE];
+    uint8_t* page = entry->writable ? entry->host_page
+                                    : guest_memory_fault(guest, guest_phys_addr / PAGE_SIZE);
+    page[guest_phys_addr % PAGE_SIZE] = value;
+}
+
+/* Guest LOAD/STORE: as above, but MMIO pages go to their device. RAM pays the
+   same present test as guest_read8; stores only look at the mmio bit after
+   the writable check has failed. */
+static inline uint8_t guest_load8(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_phys_addr) {
+    const ept_entry_t* entry = &guest->ept[guest_phys_addr / PAGE_SIZE];
+    if (__builtin_expect(!entry->present, 0)) {
+        if (entry->mmio) return guest_mmio_read(hv, guest, guest_phys_addr);
+        return guest_memory_page_in(guest, guest_phys_addr / PAGE_SIZE)[guest_phys_addr % PAGE_SIZE];
+    }
+    return entry->host_page[guest_phys_addr % PAGE_SIZE];
+}
+
+static inline void guest_store8(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_phys_addr, uint8_t value) {
+    ept_entry_t* entry = &guest->ept[guest_phys_addr / PAGE_SIZE];
+    if (__builtin_expect(entry->writable, 1)) {
+        entry->host_page[guest_phys_addr % PAGE_SIZE] = value;
+    } else if (entry->mmio) {
+        guest_mmio_write(hv, guest, guest_phys_addr, value);
+    } else {
+        guest_memory_fault(guest, guest_phys_addr / PAGE_SIZE)[guest_phys_addr % PAGE_SIZE] = value;
+    }
+}
+
+/* Drop every decoded block of the guest's VM (EPT remaps, self-modifying code) */
+void block_cache_flush(guest_vm_t* guest);
+
 /* Debugging */
+const char* isa_opcode_name(uint8_t opcode);
 void hypervisor_dump_state(hypervisor_t* hv);
 void guest_dump_state(guest_vm_t* guest);
 
@@ -0,0 +1,83 @@
+#ifndef KSM_H
+#define KSM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "vmlimits.h"
+
+/* ============================================
+   SAME-PAGE MERGING (KSM)
+   ============================================ */
+
+struct hypervisor_t;
+
+#define KSM_DEFAULT_PAGES_TO_SCAN 100   /* Pages examined per wake-up */
+#define KSM_DEFAULT_SLEEP_MS 20         /* Pause between batches */
+#define KSM_HASH_BUCKETS 4096
+#define KSM_NO_CANDIDATE 0xFFFFFFFFu
+
+/* A merged, read-only host page shared by every guest page with its contents.
+   data must stay the first member: EPT entries point at it directly. Guests
+   only ever drop references (copy-on-write); the scanner frees unused pages. */
+typedef struct ksm_page_t {
+    uint8_t data[PAGE_SIZE];
+    uint32_t refcount;
+    uint32_t hash;
+    struct ksm_page_t* next;  /* Stable table chain */
+} ksm_page_t;
+
+/* Page seen once with this hash; merged when a second page matches it */
+typedef struct {
+    uint32_t guest_id;
+    uint32_t page;
+    uint32_t hash;
+    uint32_t next;            /* Index of next candidate in the bucket */
+} ksm_candidate_t;
+
+typedef struct {
+    uint64_t pages_shared;    /* Merged host pages in use */
+    uint64_t pages_sharing;   /* Guest pages mapped to them */
+    uint64_t pages_zeroed;    /* Private all-zero pages returned to the zero page */
+    uint64_t cow_breaks;      /* Writes that un-shared a merged page */
+    uint64_t bytes_saved;     /* (pages_sharing - pages_shared) * PAGE_SIZE */
+    uint64_t pages_scanned;
+    uint64_t full_scans;
+    uint64_t scan_ns;         /* Scanner CPU time spent hashing and merging */
+} ksm_stats_t;
+
+typedef struct ksm_t {
+    struct hypervisor_t* hv;
+    pthread_t thread;
+    pthread_mutex_t lock;     /* Stable table, candidates, cursor, tunables */
+    pthread_cond_t wake;
+    bool running;
+
+    uint32_t pages_to_scan;
+    uint32_t sleep_ms;
+
+    ksm_page_t* stable[KSM_HASH_BUCKETS];
+    uint32_t unstable[KSM_HASH_BUCKETS];
+    ksm_candidate_t* candidates;
+    uint32_t nr_candidates;
+    uint32_t candidate_capacity;
+
+    uint32_t** checksums;     /* Per guest: last hash per page (changed pages are skipped) */
+    uint32_t cursor_guest;
+    uint32_t cursor_page;
+    uint32_t zero_hash;
+
+    ksm_stats_t stats;
+} ksm_t;
+
+/* ============ KSM API ============ */
+/* Vectorizable 32-bit hash of one page */
+uint32_t ksm_page_hash(const uint8_t* page);
+
+/* Drop a guest's reference to a merged page (called on copy-on-write) */
+void ksm_page_put(uint8_t* host_page);
+
+/* Free merged pages; the scanner must be stopped and guest memory released */
+void ksm_destroy(ksm_t* ksm);
+
+#endif /* KSM_H */
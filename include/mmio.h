@@ -0,0 +1,63 @@
+#ifndef MMIO_H
+#define MMIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================
+   MEMORY-MAPPED I/O
+   ============================================ */
+
+struct hypervisor_t;
+struct guest_vm_t;
+
+#define MMIO_MAX_REGIONS 64          /* Device ranges per guest VM */
+#define MMIO_UNASSIGNED 0xFF         /* Read from an MMIO page outside every device range */
+
+/* Device callbacks, called on the execution thread with the VM's memory lock
+   held. Accesses are single bytes; offset is relative to the region base.
+   A missing read reads 0 and a missing write is ignored. */
+typedef struct mmio_ops_t {
+    const char* name;
+    uint8_t (*read)(void* opaque, struct guest_vm_t* guest, uint32_t offset);
+    void (*write)(void* opaque, struct guest_vm_t* guest, uint32_t offset, uint8_t value);
+    void (*release)(void* opaque);    /* Optional: free device state with the VM */
+} mmio_ops_t;
+
+typedef struct {
+    uint32_t base;            /* Guest physical address */
+    uint32_t size;
+    const mmio_ops_t* ops;    /* NULL while replaying: reads come from the recording */
+    void* opaque;
+    uint64_t reads;
+    uint64_t writes;
+} mmio_region_t;
+
+/* Per-VM range index: regions sorted by base, never overlapping. Every page
+   a region touches has its EPT mmio bit set, so RAM accesses never look here. */
+typedef struct {
+    mmio_region_t regions[MMIO_MAX_REGIONS];
+    uint32_t count;
+    uint32_t last;            /* Index of the most recent hit, tried first */
+    uint64_t unassigned;      /* Accesses to MMIO pages that hit no region */
+} mmio_map_t;
+
+/* ============ RANGE INDEX ============ */
+/* Insert keeping the index sorted; false if full or overlapping */
+bool mmio_map_insert(mmio_map_t* map, uint32_t base, uint32_t size, const mmio_ops_t* ops, void* opaque);
+mmio_region_t* mmio_map_find(mmio_map_t* map, uint32_t guest_phys_addr);
+void mmio_map_destroy(mmio_map_t* map);  /* Release device state and free the map */
+
+/* ============ BUILT-IN DEVICES ============ */
+/* Device models that hypervisor_add_device (and --device=NAME@ADDR) can
+   instantiate; create returns the opaque handed to the callbacks */
+typedef struct {
+    const char* name;
+    uint32_t size;            /* Bytes of guest physical address space claimed */
+    void* (*create)(struct hypervisor_t* hv);
+    const mmio_ops_t* ops;
+} mmio_device_t;
+
+const mmio_device_t* mmio_device_lookup(const char* name);  /* NULL if unknown */
+
+#endif /* MMIO_H */
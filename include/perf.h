@@ -0,0 +1,88 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "vmlimits.h"
+
+/* ============================================
+   HOST PERFORMANCE COUNTERS
+   ============================================ */
+
+struct hypervisor_t;
+
+#define PERF_HOST MAX_GUESTS          /* Row for work done for no guest in particular */
+#define PERF_DEFAULT_SAMPLE_PERIOD 64 /* Blocks between per-opcode samples */
+
+/* Hardware events counted on the execution thread (user mode only) */
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    PERF_NR_COUNTERS
+} perf_counter_t;
+
+/* What the execution thread is doing. Every switch reads the counters and
+   charges the delta to the guest and phase that just ended. */
+typedef enum {
+    PERF_PHASE_DISPATCH,      /* Executing decoded guest blocks */
+    PERF_PHASE_TRANSLATE,     /* Decoding a block on a block cache miss */
+    PERF_PHASE_EXIT,          /* VM exit handlers, including resumed coroutines */
+    PERF_PHASE_SCHED,         /* Run loop: picking, accounting, event polling */
+    PERF_PHASE_IDLE,          /* Waiting with nothing runnable */
+    PERF_NR_PHASES
+} perf_phase_t;
+
+typedef struct {
+    uint64_t count[PERF_NR_COUNTERS];
+    uint64_t ns;
+    uint64_t entries;         /* Switches into this phase */
+} perf_bucket_t;
+
+typedef struct {
+    uint64_t count[PERF_NR_COUNTERS];
+    uint64_t ns;
+    uint64_t executed;        /* Guest instructions of this opcode in sampled blocks */
+} perf_opcode_t;
+
+typedef struct perf_t {
+    /* Counter group on the execution thread; fd -1 where the event is missing */
+    int fds[PERF_NR_COUNTERS];
+    int leader;                      /* Group leader fd, -1 if nothing opened */
+    uint32_t nr_open;
+    int slot[PERF_NR_COUNTERS];      /* Position of each event in a group read */
+
+    /* Open phase and the readings it started from */
+    uint32_t guest;                  /* Guest slot or PERF_HOST */
+    perf_phase_t phase;
+    uint64_t last[PERF_NR_COUNTERS];
+    uint64_t last_ns;
+
+    perf_bucket_t buckets[MAX_GUESTS + 1][PERF_NR_PHASES];
+
+    /* Per-opcode sampling (0 = off): one block in sample_period is bracketed
+       by counter reads and its cost split over the opcodes it executed */
+    uint32_t sample_period;
+    uint32_t countdown;
+    uint64_t samples;
+    uint64_t overhead[PERF_NR_COUNTERS];  /* Cost of one reading, taken off each sample */
+    uint64_t overhead_ns;
+    perf_opcode_t opcodes[256];
+} perf_t;
+
+/* ============ PERF API ============ */
+perf_t* perf_create(struct hypervisor_t* hv, uint32_t sample_period);  /* NULL only when out of memory */
+void perf_destroy(perf_t* perf);
+
+/* Close the open phase and start `phase` on behalf of `guest` */
+void perf_switch(perf_t* perf, uint32_t guest, perf_phase_t phase);
+
+/* A sampled block is about to run: returns true once every sample_period
+   calls, after closing the phase so the block starts from fresh readings */
+bool perf_sample_begin(perf_t* perf);
+
+/* Charge the sampled block to the open phase and to its opcodes */
+void perf_sample_end(perf_t* perf, const uint8_t* opcodes, uint32_t executed);
+
+#endif /* PERF_H */
@@ -0,0 +1,60 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+#include <pthread.h>
+
+/* ============================================
+   CPU AND NUMA PLACEMENT
+   ============================================ */
+
+struct guest_vm_t;
+
+#define PLACEMENT_MAX_NODES 64
+#define PLACEMENT_NODE_NONE (-1)     /* No home node: memory follows first touch */
+#define PLACEMENT_NODE_AUTO (-2)     /* Spread new guests round-robin over nodes */
+#define PLACEMENT_HUGE_PAGE_SIZE (2u * 1024 * 1024)
+
+typedef struct {
+    /* Host topology, read from /sys/devices/system/node (one node if absent) */
+    uint32_t nr_nodes;
+    cpu_set_t node_cpus[PLACEMENT_MAX_NODES];
+
+    /* Execution (scheduler) thread */
+    cpu_set_t worker_cpus;
+    bool worker_pinned;       /* --cpus: never migrate the worker */
+    int32_t worker_node;      /* Node the worker is currently bound to, -1 if unbound */
+    uint64_t node_switches;   /* Worker moved to another guest's home node */
+
+    /* KSM scanner and console drain threads */
+    cpu_set_t helper_cpus;
+    bool helpers_pinned;
+
+    /* Policy for guests created from now on */
+    int32_t guest_node;       /* Node, PLACEMENT_NODE_NONE or PLACEMENT_NODE_AUTO */
+    uint32_t next_auto_node;
+    bool huge_pages;          /* madvise(MADV_HUGEPAGE) guest RAM */
+} placement_t;
+
+/* ============ PLACEMENT API ============ */
+void placement_init(placement_t* placement);
+
+/* Parse "0-3,8,10-11" into a CPU set; false on syntax error or empty set */
+bool placement_parse_cpus(const char* text, cpu_set_t* cpus);
+
+/* Apply the helper CPU set to a newly created host thread */
+void placement_pin_helper(struct hypervisor_t* hv, pthread_t thread);
+
+/* Bind [addr, addr + size) to prefer `node` (takes effect at first touch) and
+   optionally enable transparent huge pages on it */
+void placement_bind_memory(struct hypervisor_t* hv, void* addr, size_t size,
+                           int32_t node, bool huge_pages);
+
+/* Fraction of a guest's resident pages that live on its home node (0-100),
+   or -1 if it has no home node or the kernel cannot tell */
+int32_t placement_local_percent(const struct guest_vm_t* guest);
+
+#endif /* PLACEMENT_H */
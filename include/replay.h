@@ -0,0 +1,78 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* ============================================
+   DETERMINISTIC RECORD / REPLAY
+   ============================================ */
+
+struct guest_vm_t;
+
+#define REPLAY_MAGIC 0x4C505256u      /* "VRPL" little-endian */
+#define REPLAY_VERSION 7
+#define REPLAY_BUFFER_SIZE (64 * 1024)
+
+/* Guest execution is deterministic between hypervisor interventions, so a
+   recording holds only a snapshot of every guest at record start plus the
+   inputs the hypervisor injected afterwards, in the order it injected them.
+   Event records are a type byte followed by LEB128 fields. */
+typedef enum {
+    REPLAY_EVENT_END = 0,
+    REPLAY_EVENT_SLICE = 1,   /* guest, steps, flags, fingerprint (u32) */
+    REPLAY_EVENT_RESUME = 2,  /* guest, r0 value delivered on resume */
+    REPLAY_EVENT_STATE = 3,   /* guest, state set by the hypervisor */
+    REPLAY_EVENT_WRITE = 4,   /* guest, physical address, length, bytes written by an exit handler */
+    REPLAY_EVENT_MMIO_MAP = 5,  /* guest, base, size of a device added after the snapshot */
+    REPLAY_EVENT_MMIO_READ = 6, /* guest, byte a device returned; precedes the slice that read it */
+    REPLAY_EVENT_GRANT = 7      /* guest, grant_op_t, page, pages, owner guest, owner page */
+} replay_event_t;
+
+#define REPLAY_SLICE_PREEMPTED 0x01   /* Slice ended on VMCAUSE_TIMER */
+
+typedef enum {
+    REPLAY_MODE_RECORD = 0,
+    REPLAY_MODE_REPLAY = 1
+} replay_mode_t;
+
+typedef struct replay_t {
+    replay_mode_t mode;
+    FILE* file;
+    char* buffer;             /* stdio buffer for the log */
+
+    uint64_t events;
+    uint64_t slices;
+    uint64_t steps;           /* Instructions retired plus trapped attempts */
+    uint64_t bytes;
+
+    /* Replay: device reads logged ahead of the slice being replayed,
+       as vm_id << 8 | value */
+    uint32_t* mmio_reads;
+    uint32_t mmio_count;
+    uint32_t mmio_next;
+    uint32_t mmio_capacity;
+    bool mmio_mismatch;       /* A read had no matching log entry */
+} replay_t;
+
+/* ============ RECORDING HOOKS ============ */
+/* Called by the hypervisor core while recording; no-ops during replay */
+void replay_record_slice(replay_t* replay, const struct guest_vm_t* guest,
+                         uint32_t steps, bool preempted);
+void replay_record_resume(replay_t* replay, const struct guest_vm_t* guest, uint32_t value);
+void replay_record_state(replay_t* replay, const struct guest_vm_t* guest);
+void replay_record_write(replay_t* replay, const struct guest_vm_t* guest, uint32_t guest_phys_addr,
+                         const uint8_t* data, uint32_t size);
+
+void replay_record_mmio_map(replay_t* replay, const struct guest_vm_t* guest, uint32_t base, uint32_t size);
+void replay_record_grant(replay_t* replay, const struct guest_vm_t* guest, uint32_t op, uint32_t page,
+                         uint32_t nr_pages, const struct guest_vm_t* owner, uint32_t owner_page);
+/* Every MMIO read goes through here: recording logs the device's value,
+   replay substitutes the logged one (devices are not modelled in replay) */
+uint8_t replay_mmio_read(replay_t* replay, const struct guest_vm_t* guest, uint8_t value);
+
+/* Cheap digest of a guest's register state, checked after every replayed slice */
+uint32_t replay_fingerprint(const struct guest_vm_t* guest);
+
+#endif /* REPLAY_H */
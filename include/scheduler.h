@@ -0,0 +1,90 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================
+   GUEST SCHEDULER
+   ============================================ */
+
+struct guest_vm_t;
+struct hypervisor_t;
+
+/* Fair-share tuning (CFS-style, all times in host nanoseconds) */
+#define SCHED_DEFAULT_WEIGHT 1024            /* Weight of a default-priority guest */
+#define SCHED_LATENCY_NS 6000000ULL          /* Target period in which every guest runs once */
+#define SCHED_MIN_GRANULARITY_NS 750000ULL   /* Shortest slice regardless of load */
+#define SCHED_CAP_PERIOD_NS 100000000ULL     /* CPU cap accounting period (100 ms) */
+
+/* ============ SCHEDULING POLICIES ============ */
+typedef enum {
+    SCHED_POLICY_ROUND_ROBIN = 0,   /* FIFO, slice = guest quantum */
+    SCHED_POLICY_FAIR_SHARE = 1     /* Weighted virtual runtime, slice scales with load */
+} sched_policy_t;
+
+/* ============ PER-GUEST SCHEDULING ENTITY ============ */
+typedef struct {
+    uint64_t vruntime;        /* Runtime scaled by SCHED_DEFAULT_WEIGHT / weight */
+    uint32_t weight;          /* Relative CPU share */
+    uint32_t cpu_cap;         /* Max percent of one host CPU (0 = uncapped) */
+    uint64_t cap_used_ns;     /* Runtime charged in cap period cap_period */
+    uint64_t cap_period;
+    uint64_t total_runtime_ns;
+    int32_t queue_index;      /* Slot in run queue, -1 when not queued */
+    bool throttled;           /* Out of cap quota until the period ends */
+} sched_entity_t;
+
+typedef struct scheduler_t scheduler_t;
+
+/* Policy operations; the run queue storage is owned by scheduler_t */
+typedef struct {
+    const char* name;
+    void (*enqueue)(scheduler_t* sched, struct guest_vm_t* guest);
+    struct guest_vm_t* (*pick_next)(scheduler_t* sched);  /* Dequeues the guest */
+    uint64_t (*slice_ns)(scheduler_t* sched, struct guest_vm_t* guest);  /* 0 = guest quantum */
+    void (*account)(scheduler_t* sched, struct guest_vm_t* guest, uint64_t ran_ns);
+} sched_ops_t;
+
+struct scheduler_t {
+    const sched_ops_t* ops;
+    sched_policy_t policy;
+
+    /* Run queue: FIFO ring for round-robin, binary min-heap on vruntime for fair share */
+    struct guest_vm_t** queue;
+    uint32_t capacity;
+    uint32_t head;            /* Ring start (round-robin only) */
+    uint32_t nr_queued;
+
+    uint64_t total_weight;    /* Sum of weights of runnable guests (queued + running) */
+    uint32_t nr_running;
+    uint64_t min_vruntime;    /* Monotonic floor for newly queued guests */
+
+    /* CPU cap bandwidth control */
+    struct guest_vm_t** throttled;
+    uint32_t nr_throttled;
+    uint64_t cap_period_start_ns;
+    uint64_t cap_period;      /* Incremented every SCHED_CAP_PERIOD_NS */
+};
+
+/* ============ SCHEDULER API ============ */
+bool scheduler_init(scheduler_t* sched, sched_policy_t policy, uint32_t capacity);
+void scheduler_destroy(scheduler_t* sched);
+const sched_ops_t* scheduler_ops_for(sched_policy_t policy);
+
+/* Make a guest runnable / remove it from the runnable set */
+void scheduler_enqueue(scheduler_t* sched, struct guest_vm_t* guest);
+void scheduler_remove(scheduler_t* sched, struct guest_vm_t* guest);
+
+/* Pick the next guest to run; returns NULL if nothing is runnable. When only
+   throttled guests remain, *wait_ns is set to the time until quota refills. */
+struct guest_vm_t* scheduler_pick_next(scheduler_t* sched, uint64_t now_ns, uint64_t* wait_ns);
+
+/* Dequeue a queued guest to run alongside the picked one. Like a picked guest
+   it stays runnable and goes back through scheduler_account(). */
+bool scheduler_take(scheduler_t* sched, struct guest_vm_t* guest);
+
+/* Charge a finished slice and decide where the guest goes next */
+void scheduler_account(scheduler_t* sched, struct guest_vm_t* guest, uint64_t ran_ns, bool runnable);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,54 @@
+#ifndef SPMD_H
+#define SPMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================
+   LOCKSTEP (SPMD) BATCH EXECUTION
+   ============================================ */
+
+struct guest_vm_t;
+
+#define SPMD_MIN_LANES 2             /* Smaller groups run on the scalar engine */
+#define SPMD_LANE_ALIGN 8            /* Lane stride granularity for host SIMD */
+
+/* Guests running the same image in lockstep. Registers are stored as
+   struct-of-arrays columns so one decoded instruction updates every lane of
+   the executing group with a single vectorizable loop. Lanes whose PCs diverge
+   form sub-groups; the group with the lowest PC always executes next, so
+   lanes merge again as soon as their PCs reconverge. */
+typedef struct {
+    struct guest_vm_t** lanes;
+    uint32_t nr_lanes;
+    uint32_t stride;          /* nr_lanes rounded up to SPMD_LANE_ALIGN */
+
+    uint32_t* regs;           /* regs[reg * stride + lane] */
+    uint32_t* pc;
+    uint32_t* sp;
+    uint32_t* mask;           /* 0xFFFFFFFF for lanes in the executing group */
+    uint32_t* taken;          /* Per-lane branch outcome scratch */
+    uint32_t* retired;        /* Instructions retired per lane since last write-back */
+    uint8_t* live;            /* Lane still executing in lockstep */
+    uint32_t nr_live;
+
+    uint32_t code_size;       /* Stores below this eject the lane (code must stay shared) */
+
+    /* Statistics */
+    uint64_t steps;           /* Instructions decoded and dispatched */
+    uint64_t lane_instructions;
+    uint64_t splits;          /* Branches whose outcome differed across the group */
+    uint64_t merges;          /* Steps where a larger group re-formed */
+    uint32_t ejected;         /* Lanes handed back to the scalar engine */
+} spmd_batch_t;
+
+/* ============ SPMD API ============ */
+bool spmd_batch_init(spmd_batch_t* batch, struct guest_vm_t** guests, uint32_t count);
+void spmd_batch_destroy(spmd_batch_t* batch);
+
+/* Run the batch for up to max_steps dispatches and until host time deadline_ns
+   (0 = no limit; lanes still stop when they halt or are ejected), then write
+   lane state back to the guests */
+uint64_t spmd_batch_run(spmd_batch_t* batch, uint64_t max_steps, uint64_t deadline_ns);
+
+#endif /* SPMD_H */
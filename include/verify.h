@@ -0,0 +1,27 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================
+   GUEST CODE VERIFIER
+   ============================================ */
+
+#define VERIFY_MAX_REWRITES 8        /* Writes after which a code page stays unverified */
+
+/* Why an instruction fails verification */
+typedef enum {
+    VERIFY_OK = 0,
+    VERIFY_BAD_OPCODE,        /* Not an instruction: would exit as illegal */
+    VERIFY_BAD_REGISTER,      /* A register operand is out of range */
+    VERIFY_BAD_IMMEDIATE,     /* divi by zero */
+    VERIFY_BAD_TARGET         /* Static jump/call target outside the code section */
+} verify_status_t;
+
+/* Check one encoded instruction (opcode, rd, rs1, rs2). Static targets must
+   be instruction slots below code_size. */
+verify_status_t verify_instruction(const uint8_t* bytes, uint32_t code_size);
+const char* verify_status_name(verify_status_t status);
+
+#endif /* VERIFY_H */
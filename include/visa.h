@@ -0,0 +1,128 @@
+#ifndef VISA_H
+#define VISA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ============================================
+   vISA EMBEDDING API
+   ============================================
+
+   Link visa_core and include only this header to run guests in-process.
+   Each visa_t is an independent hypervisor: instances share no mutable
+   state, so a process may create as many as it likes and drive each from
+   its own thread. Calls on one instance must not overlap, except where a
+   function says otherwise.
+
+   An instance never writes to stdout or stderr. Diagnostics go to the log
+   callback, guest console output to the output callback; either may be NULL
+   to discard it. */
+
+typedef struct hypervisor_t visa_t;
+
+#define VISA_REGISTER_COUNT 32       /* Must equal REGISTER_COUNT */
+
+typedef enum {
+    VISA_OK = 0,
+    VISA_ERR_INVALID,         /* Bad argument or unknown guest */
+    VISA_ERR_NO_MEMORY,
+    VISA_ERR_LIMIT,           /* No free guest slot */
+    VISA_ERR_IMAGE,           /* Image does not parse or does not fit guest memory */
+    VISA_ERR_IO,              /* Host file could not be read */
+    VISA_ERR_DEADLOCK         /* visa_run ended with guests blocked forever */
+} visa_status_t;
+
+typedef enum {
+    VISA_LOG_DEBUG = 0,       /* Per slice and per instruction (--trace) detail */
+    VISA_LOG_INFO,            /* Lifecycle and reports */
+    VISA_LOG_WARN,            /* Guest faults, deadlocks, rejected guest requests */
+    VISA_LOG_ERROR            /* A host call failed; also kept for visa_last_error */
+} visa_log_level_t;
+
+/* What the embedder wants done with a VM exit */
+typedef enum {
+    VISA_EXIT_DEFAULT = 0,    /* Handle it as the hypervisor normally would */
+    VISA_EXIT_STOP            /* Stop the guest now */
+} visa_exit_action_t;
+
+/* A VM exit as the exit callback sees it, before the hypervisor handles it */
+typedef struct {
+    uint32_t cause;           /* vmcause_t: 0 = halted, 1 = privileged instruction, 6 = preempted, ... */
+    uint32_t qualification;   /* Cause-specific, e.g. opcode << 8 | rd for instruction exits */
+    uint32_t pc;
+    uint64_t instructions;    /* Retired by this guest so far */
+} visa_exit_t;
+
+/* `text` is one or more whole lines, each ending in '\n' */
+typedef void (*visa_log_fn)(void* user, visa_log_level_t level, const char* text);
+
+/* Guest console bytes (HYPERCALL_PRINT, uart). Called on the console thread,
+   not the thread running visa_run. */
+typedef void (*visa_output_fn)(void* user, uint32_t guest_id, const char* data, size_t length);
+
+/* Called on every VM exit, on the thread running visa_run */
+typedef visa_exit_action_t (*visa_exit_fn)(void* user, visa_t* visa, uint32_t guest_id,
+                                           const visa_exit_t* exit);
+
+/* Called for every hypercall before the built-in ones, with r1-r3 in args.
+   Return true with *result set to resume the guest with r0 = *result;
+   false leaves the hypercall to the hypervisor. */
+typedef bool (*visa_hypercall_fn)(void* user, visa_t* visa, uint32_t guest_id, uint32_t number,
+                                  const uint32_t args[3], uint32_t* result);
+
+typedef struct {
+    visa_log_fn log;
+    visa_log_level_t log_level;   /* Lowest level passed to log */
+    visa_output_fn output;
+    visa_exit_fn on_exit;
+    visa_hypercall_fn on_hypercall;
+    void* user;                   /* First argument of every callback */
+} visa_config_t;
+
+/* Guest state after (or between) runs */
+typedef struct {
+    uint32_t state;           /* guest_state_t: 0 = stopped, 1 = running, 2 = blocked */
+    uint32_t pc;
+    uint32_t last_exit_cause;
+    uint64_t instructions;
+    uint32_t registers[VISA_REGISTER_COUNT];
+} visa_guest_info_t;
+
+/* ============ INSTANCES ============ */
+/* config may be NULL: no callbacks, nothing logged */
+visa_status_t visa_create(const visa_config_t* config, visa_t** out);
+void visa_destroy(visa_t* visa);
+
+/* Message of the last VISA_LOG_ERROR on this instance ("" if none) */
+const char* visa_last_error(const visa_t* visa);
+const char* visa_status_string(visa_status_t status);
+
+/* ============ GUESTS ============ */
+/* Guest ids are 1-based. memory_size 0 = the default guest memory size. */
+
+/* Load a file: assembly (.isa), a vISA object (.vobj) or a raw binary */
+visa_status_t visa_load_file(visa_t* visa, const char* path, uint32_t memory_size, uint32_t* guest_id);
+
+/* Load a vISA object or raw binary from memory; the bytes are copied */
+visa_status_t visa_load_image(visa_t* visa, const void* image, size_t size, uint32_t memory_size,
+                              uint32_t* guest_id);
+
+/* Assemble NUL-terminated source and load it */
+visa_status_t visa_load_source(visa_t* visa, const char* source, uint32_t memory_size, uint32_t* guest_id);
+
+/* Preemption quantum (instructions and/or wall-clock ns, 0 = unlimited) */
+visa_status_t visa_set_quantum(visa_t* visa, uint32_t guest_id, uint32_t instructions, uint64_t nanoseconds);
+
+visa_status_t visa_guest_info(visa_t* visa, uint32_t guest_id, visa_guest_info_t* info);
+
+/* Copy to or from guest memory at guest addresses, translated as the guest
+   itself would; fails if any part of the range is unmapped */
+visa_status_t visa_read_memory(visa_t* visa, uint32_t guest_id, uint32_t addr, void* buf, size_t size);
+visa_status_t visa_write_memory(visa_t* visa, uint32_t guest_id, uint32_t addr, const void* buf, size_t size);
+
+/* ============ EXECUTION ============ */
+/* Run every loaded guest until all have stopped */
+visa_status_t visa_run(visa_t* visa);
+
+#endif /* VISA_H */
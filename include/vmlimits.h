@@ -0,0 +1,14 @@
+#ifndef VMLIMITS_H
+#define VMLIMITS_H
+
+/* ============================================
+   CORE LIMITS
+   ============================================ */
+
+/* Sizes the subsystem headers lay out their tables by. Included first by
+   isa.h, so every subsystem sees the same values the core does. */
+#define REGISTER_COUNT 32
+#define PAGE_SIZE 4096               /* 4 KB pages */
+#define MAX_GUESTS 8                 /* Max vCPU contexts across all guest VMs */
+
+#endif /* VMLIMITS_H */
@@ -0,0 +1,75 @@
+#ifndef VOBJ_H
+#define VOBJ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ============================================
+   vISA GUEST OBJECT FORMAT (.vobj)
+   ============================================
+
+   File layout (all fields little-endian):
+     header      VOBJ_HEADER_SIZE bytes
+     code        code_size bytes, loaded at guest address 0
+     data        data_size bytes, loaded at VOBJ_ALIGN(code_size)
+     symbols     symbol_count * VOBJ_SYMBOL_SIZE bytes
+   bss (bss_size bytes) follows data in guest memory and is zero-filled by the
+   loader; it takes no space in the file. content_hash is FNV-1a 64 over the
+   code, data and symbol bytes as stored in the file. */
+
+#define VOBJ_MAGIC 0x4A424F56u        /* "VOBJ" */
+#define VOBJ_VERSION 1
+#define VOBJ_HEADER_SIZE 40
+#define VOBJ_SYMBOL_NAME_MAX 32       /* Including the terminating NUL */
+#define VOBJ_SYMBOL_SIZE (VOBJ_SYMBOL_NAME_MAX + 8)
+#define VOBJ_ALIGN(x) (((x) + 3u) & ~3u)
+
+/* ============ SECTIONS ============ */
+typedef enum {
+    VOBJ_SECTION_CODE = 0,
+    VOBJ_SECTION_DATA = 1,
+    VOBJ_SECTION_BSS = 2
+} vobj_section_t;
+
+typedef struct {
+    char name[VOBJ_SYMBOL_NAME_MAX];
+    uint32_t value;           /* Guest address */
+    uint8_t section;          /* vobj_section_t */
+} vobj_symbol_t;
+
+/* In-memory image; code/data either own their buffers (assembler output) or
+   point into a caller's file buffer (vobj_decode) */
+typedef struct {
+    const uint8_t* code;
+    uint32_t code_size;
+    const uint8_t* data;
+    uint32_t data_size;
+    uint32_t bss_size;
+    uint32_t entry;
+    vobj_symbol_t* symbols;
+    uint32_t symbol_count;
+    uint64_t content_hash;
+    bool owns_sections;
+} vobj_image_t;
+
+/* ============ OBJECT API ============ */
+bool vobj_is_object(const uint8_t* buf, size_t size);
+
+/* Serialize an image; *out is malloc'd and must be freed by the caller */
+bool vobj_encode(vobj_image_t* image, uint8_t** out, size_t* out_size);
+
+/* Parse and verify an object; sections reference buf, which must outlive image */
+bool vobj_decode(const uint8_t* buf, size_t size, vobj_image_t* image, char* error, size_t error_size);
+
+void vobj_free(vobj_image_t* image);
+
+/* Guest address where each section is loaded */
+uint32_t vobj_data_base(const vobj_image_t* image);
+uint32_t vobj_bss_base(const vobj_image_t* image);
+uint64_t vobj_memory_size(const vobj_image_t* image);  /* Highest loaded address + 1 */
+
+/* Symbol whose address is the closest one at or below addr (NULL if none) */
+const vobj_symbol_t* vobj_find_symbol(const vobj_symbol_t* symbols, uint32_t count, uint32_t addr);
+
+#endif /* VOBJ_H */
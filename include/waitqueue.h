@@ -0,0 +1,75 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* ============================================
+   EVENT WAIT QUEUES FOR BLOCKED GUESTS
+   ============================================ */
+
+struct guest_vm_t;
+
+#define WAITQ_BUCKETS 64             /* Hash buckets for (event, key) waits */
+
+/* ============ WAIT EVENTS ============ */
+typedef enum {
+    WAIT_NONE = 0,
+    WAIT_HYPERCALL = 1,     /* Completion of an asynchronous hypercall (key = guest id) */
+    WAIT_IO_RING = 2,       /* I/O ring completion (key = ring id) */
+    WAIT_TIMER = 3,         /* Host-time deadline */
+    WAIT_MESSAGE = 4,       /* Inter-guest message (key = receiving guest id) */
+    WAIT_CONSOLE = 5,       /* Room in the guest's console buffer (key = guest id) */
+    WAIT_IPI = 6,           /* Inter-processor interrupt (key = receiving vCPU slot) */
+    WAIT_NOTIFY = 7         /* Grant channel doorbell (key = receiving guest slot) */
+} wait_event_t;
+
+/* ============ PER-GUEST WAIT STATE ============ */
+typedef struct {
+    wait_event_t event;       /* WAIT_NONE when not parked */
+    uint32_t key;
+    uint64_t deadline_ns;     /* WAIT_TIMER only */
+    struct guest_vm_t* next;  /* Bucket chain */
+    int32_t timer_index;      /* Slot in timer heap, -1 if none */
+} wait_entity_t;
+
+/* Wakeup posted from another host thread, applied by the scheduler thread */
+typedef struct {
+    wait_event_t event;
+    uint32_t key;
+    uint32_t result;
+} wait_wakeup_t;
+
+typedef struct {
+    struct guest_vm_t* buckets[WAITQ_BUCKETS];
+    uint32_t nr_waiters;
+
+    /* WAIT_TIMER guests: binary min-heap on deadline */
+    struct guest_vm_t** timers;
+    uint32_t nr_timers;
+    uint32_t capacity;
+
+    /* Cross-thread wakeups, signalled through event_fd */
+    pthread_mutex_t lock;
+    wait_wakeup_t* pending;
+    uint32_t nr_pending;
+    uint32_t pending_capacity;
+    uint32_t nr_async;        /* Outstanding operations that will post a wakeup */
+    int event_fd;
+    int epoll_fd;
+    int timer_fd;
+
+    /* Statistics */
+    uint64_t wakeups;
+    uint64_t idle_ns;
+} waitq_t;
+
+/* ============ WAIT QUEUE API ============ */
+bool waitq_init(waitq_t* waitq, uint32_t capacity);
+void waitq_destroy(waitq_t* waitq);
+
+/* Earliest pending timer deadline, or 0 if none */
+uint64_t waitq_next_deadline(const waitq_t* waitq);
+
+#endif /* WAITQUEUE_H */
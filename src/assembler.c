@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <strings.h>
+#include "../include/assembler.h"
+#include "../include/isa.h"
+
+/* ============ INSTRUCTION TABLE ============ */
+/* Operand formats mirror examples/assembler.py so both tools emit identical
+   code for existing programs. */
+
+typedef enum {
+    FMT_NONE,          /* halt, ret, iret, tlbflushv */
+    FMT_RRR,           /* add rd, rs1, rs2 */
+    FMT_RR,            /* mov rd, rs1 */
+    FMT_STORE,         /* store rs1, rs2  (memory[rs1] = rs2) */
+    FMT_RI,            /* movi rd, imm8 */
+    FMT_RRI,           /* addi rd, rs1, imm8 */
+    FMT_JUMP,          /* jmp label */
+    FMT_BRANCH,        /* jeq label|rd, rs1, rs2 */
+    FMT_R,             /* vmcause rd */
+    FMT_OPT_R,         /* hypercall [rd] */
+    FMT_CALL           /* call [label|rd] */
+} operand_format_t;
+
+typedef struct {
+    const char* mnemonic;
+    uint8_t opcode;
+    operand_format_t format;
+} asm_opcode_t;
+
+static const asm_opcode_t asm_opcodes[] = {
+    { "add", OP_ADD, FMT_RRR },       { "sub", OP_SUB, FMT_RRR },
+    { "mul", OP_MUL, FMT_RRR },       { "div", OP_DIV, FMT_RRR },
+    { "mov", OP_MOV, FMT_RR },        { "load", OP_LOAD, FMT_RR },
+    { "store", OP_STORE, FMT_STORE },
+    { "jmp", OP_JMP, FMT_JUMP },      { "jeq", OP_JEQ, FMT_BRANCH },
+    { "jne", OP_JNE, FMT_BRANCH },    { "call", OP_CALL, FMT_CALL },
+    { "ret", OP_RET, FMT_NONE },
+    { "movi", OP_MOVI, FMT_RI },      { "addi", OP_ADDI, FMT_RRI },
+    { "subi", OP_SUBI, FMT_RRI },     { "muli", OP_MULI, FMT_RRI },
+    { "divi", OP_DIVI, FMT_RRI },
+    { "cas", OP_CAS, FMT_RRR },       { "fadd", OP_FADD, FMT_RRR },
+    { "fence", OP_FENCE, FMT_NONE },
+    { "syscall", OP_SYSCALL, FMT_OPT_R },
+    { "hypercall", OP_HYPERCALL, FMT_OPT_R },
+    { "ipi", OP_IPI, FMT_R },
+    { "livt", OP_LIVT, FMT_R },     { "iret", OP_IRET, FMT_NONE },
+    { "stimer", OP_STIMER, FMT_R },
+    { "vmenter", OP_VMENTER, FMT_OPT_R },
+    { "vmresume", OP_VMRESUME, FMT_OPT_R },
+    { "vmcause", OP_VMCAUSE, FMT_R }, { "vmtrapcfg", OP_VMTRAPCFG, FMT_R },
+    { "ldpgtr", OP_LDPGTR, FMT_R },   { "ldhptr", OP_LDHPTR, FMT_R },
+    { "tlbflushv", OP_TLBFLUSHV, FMT_NONE },
+    { "halt", OP_HALT, FMT_NONE },
+};
+
+#define ASM_OPCODE_COUNT (sizeof(asm_opcodes) / sizeof(asm_opcodes[0]))
+#define ASM_MAX_LINE 256
+#define ASM_MAX_OPERANDS 64         /* Includes the mnemonic or directive */
+
+/* ============ ASSEMBLER STATE ============ */
+
+typedef struct {
+    char name[VOBJ_SYMBOL_NAME_MAX];
+    vobj_section_t section;
+    uint32_t offset;          /* Offset within its section */
+} asm_label_t;
+
+typedef struct {
+    int pass;                 /* 1 = collect labels and sizes, 2 = emit */
+    int line_no;
+    vobj_section_t section;
+    uint32_t offset[3];       /* Current offset per section */
+
+    asm_label_t labels[ASM_MAX_LABELS];
+    uint32_t label_count;
+    char entry_label[VOBJ_SYMBOL_NAME_MAX];
+
+    uint8_t* code;
+    uint8_t* data;
+    uint32_t code_size, data_size, bss_size;
+
+    char* error;
+    size_t error_size;
+} asm_state_t;
+
+static bool asm_error(asm_state_t* as, const char* fmt, ...) {
+    int n = snprintf(as->error, as->error_size, "line %d: ", as->line_no);
+    if (n >= 0 && (size_t)n < as->error_size) {
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(as->error + n, as->error_size - (size_t)n, fmt, ap);
+        va_end(ap);
+    }
+    return false;
+}
+
+static const asm_opcode_t* find_opcode(const char* mnemonic) {
+    for (size_t i = 0; i < ASM_OPCODE_COUNT; i++) {
+        if (strcasecmp(asm_opcodes[i].mnemonic, mnemonic) == 0) return &asm_opcodes[i];
+    }
+    return NULL;
+}
+
+static const asm_label_t* find_label(const asm_state_t* as, const char* name) {
+    for (uint32_t i = 0; i < as->label_count; i++) {
+        if (strcmp(as->labels[i].name, name) == 0) return &as->labels[i];
+    }
+    return NULL;
+}
+
+/* Final guest address of a label (valid once pass 1 has sized every section) */
+static uint32_t label_address(const asm_state_t* as, const asm_label_t* label) {
+    uint32_t data_base = VOBJ_ALIGN(as->code_size);
+    switch (label->section) {
+        case VOBJ_SECTION_DATA: return data_base + label->offset;
+        case VOBJ_SECTION_BSS:  return VOBJ_ALIGN(data_base + as->data_size) + label->offset;
+        default:                return label->offset;
+    }
+}
+
+/* ============ OPERAND PARSING ============ */
+
+static bool parse_number(const char* text, long* value) {
+    if (*text == '#') text++;
+    if (*text == '\0') return false;
+    char* end;
+    *value = strtol(text, &end, 0);
+    return *end == '\0';
+}
+
+static bool parse_register(asm_state_t* as, const char* text, uint8_t* reg) {
+    long value;
+    if ((text[0] == 'r' || text[0] == 'R') && parse_number(text + 1, &value)) {
+        /* Register */
+    } else if (!parse_number(text, &value)) {
+        return asm_error(as, "invalid register '%s'", text);
+    }
+    if (value < 0 || value >= REGISTER_COUNT) {
+        return asm_error(as, "register '%s' out of range", text);
+    }
+    *reg = (uint8_t)value;
+    return true;
+}
+
+/* 8-bit immediates; a label is accepted when its address fits (e.g. small .data) */
+static bool parse_immediate(asm_state_t* as, const char* text, uint8_t* imm) {
+    long value;
+    if (parse_number(text, &value)) {
+        *imm = (uint8_t)(value & 0xFF);
+        return true;
+    }
+    if (as->pass == 1) {
+        *imm = 0;
+        return true;
+    }
+    const asm_label_t* label = find_label(as, text);
+    if (!label) return asm_error(as, "invalid immediate '%s'", text);
+    uint32_t addr = label_address(as, label);
+    if (addr > 0xFF) return asm_error(as, "label '%s' (0x%X) does not fit in imm8", text, addr);
+    *imm = (uint8_t)addr;
+    return true;
+}
+
+/* Branch targets are encoded as an instruction index in rd; labels resolve to
+   their code address / INSTRUCTION_SIZE, anything else is a register/index */
+static bool parse_target(asm_state_t* as, const char* text, uint8_t* rd) {
+    if (as->pass == 1) {
+        *rd = 0;
+        return true;
+    }
+    const asm_label_t* label = find_label(as, text);
+    if (!label) return parse_register(as, text, rd);
+    if (label->section != VOBJ_SECTION_CODE) {
+        return asm_error(as, "branch target '%s' is not in .text", text);
+    }
+    uint32_t index = label_address(as, label) / INSTRUCTION_SIZE;
+    if (index > 0xFF) return asm_error(as, "branch target '%s' out of range", text);
+    *rd = (uint8_t)index;
+    return true;
+}
+
+static bool parse_value(asm_state_t* as, const char* text, uint32_t* value) {
+    long number;
+    if (parse_number(text, &number)) {
+        *value = (uint32_t)number;
+        return true;
+    }
+    if (as->pass == 1) {
+        *value = 0;
+        return true;
+    }
+    const asm_label_t* label = find_label(as, text);
+    if (!label) return asm_error(as, "invalid value '%s'", text);
+    *value = label_address(as, label);
+    return true;
+}
+
+/* Split "a, b c" into operand tokens in place; -1 if there are too many */
+static int split_operands(char* text, char** operands) {
+    int count = 0;
+    while (*text) {
+        while (*text == ',' || isspace((unsigned char)*text)) *text++ = '\0';
+        if (*text == '\0') break;
+        if (count == ASM_MAX_OPERANDS) return -1;
+        operands[count++] = text;
+        while (*text && *text != ',' && !isspace((unsigned char)*text)) text++;
+    }
+    return count;
+}
+
+/* ============ INSTRUCTIONS ============ */
+
+static bool assemble_instruction(asm_state_t* as, const asm_opcode_t* op, char** operands, int count) {
+    static const int required[] = {
+        [FMT_NONE] = 0, [FMT_RRR] = 3, [FMT_RR] = 2, [FMT_STORE] = 2, [FMT_RI] = 2,
+        [FMT_RRI] = 3, [FMT_JUMP] = 1, [FMT_BRANCH] = 3, [FMT_R] = 1, [FMT_OPT_R] = 0,
+        [FMT_CALL] = 0
+    };
+
+    if (as->section != VOBJ_SECTION_CODE) {
+        return asm_error(as, "instruction '%s' outside .text", op->mnemonic);
+    }
+    if (count < required[op->format]) {
+        return asm_error(as, "'%s' expects %d operand(s)", op->mnemonic, required[op->format]);
+    }
+
+    uint8_t rd = 0, rs1 = 0, rs2 = 0;
+    bool ok = true;
+
+    switch (op->format) {
+        case FMT_NONE:
+            break;
+        case FMT_RRR:
+            ok = parse_register(as, operands[0], &rd) && parse_register(as, operands[1], &rs1) &&
+                 parse_register(as, operands[2], &rs2);
+            break;
+        case FMT_RR:
+            ok = parse_register(as, operands[0], &rd) && parse_register(as, operands[1], &rs1);
+            break;
+        case FMT_STORE:
+            ok = parse_register(as, operands[0], &rs1) && parse_register(as, operands[1], &rs2);
+            break;
+        case FMT_RI:
+            ok = parse_register(as, operands[0], &rd) && parse_immediate(as, operands[1], &rs2);
+            break;
+        case FMT_RRI:
+            ok = parse_register(as, operands[0], &rd) && parse_register(as, operands[1], &rs1) &&
+                 parse_immediate(as, operands[2], &rs2);
+            break;
+        case FMT_JUMP:
+            ok = parse_target(as, operands[0], &rd);
+            break;
+        case FMT_BRANCH:
+            ok = parse_target(as, operands[0], &rd) && parse_register(as, operands[1], &rs1) &&
+                 parse_register(as, operands[2], &rs2);
+            break;
+        case FMT_R:
+            ok = parse_register(as, operands[0], &rd);
+            break;
+        case FMT_OPT_R:
+            ok = count == 0 || parse_register(as, operands[0], &rd);
+            break;
+        case FMT_CALL:
+            ok = count == 0 || parse_target(as, operands[0], &rd);
+            break;
+    }
+    if (!ok) return false;
+
+    if (as->pass == 2) {
+        uint8_t* p = as->code + as->offset[VOBJ_SECTION_CODE];
+        p[0] = op->opcode;
+        p[1] = rd;
+        p[2] = rs1;
+        p[3] = rs2;
+    }
+    as->offset[VOBJ_SECTION_CODE] += INSTRUCTION_SIZE;
+    return true;
+}
+
+/* ============ DIRECTIVES ============ */
+
+static bool assemble_directive(asm_state_t* as, const char* name, char** operands, int count) {
+    if (strcmp(name, ".text") == 0) {
+        as->section = VOBJ_SECTION_CODE;
+    } else if (strcmp(name, ".data") == 0) {
+        as->section = VOBJ_SECTION_DATA;
+    } else if (strcmp(name, ".bss") == 0) {
+        as->section = VOBJ_SECTION_BSS;
+    } else if (strcmp(name, ".entry") == 0) {
+        if (count != 1 || strlen(operands[0]) >= VOBJ_SYMBOL_NAME_MAX) {
+            return asm_error(as, ".entry expects one label");
+        }
+        strcpy(as->entry_label, operands[0]);
+    } else if (strcmp(name, ".space") == 0) {
+        long size;
+        if (count != 1 || !parse_number(operands[0], &size) || size < 0 || size > GUEST_MAX_MEMORY_SIZE) {
+            return asm_error(as, ".space expects a byte count");
+        }
+        if (as->section == VOBJ_SECTION_CODE) return asm_error(as, ".space not allowed in .text");
+        as->offset[as->section] += (uint32_t)size;  /* .data is zero-initialised */
+    } else if (strcmp(name, ".byte") == 0 || strcmp(name, ".word") == 0) {
+        uint32_t width = name[1] == 'b' ? 1 : 4;
+        if (as->section != VOBJ_SECTION_DATA) return asm_error(as, "%s only allowed in .data", name);
+        for (int i = 0; i < count; i++) {
+            uint32_t value = 0;
+            if (!parse_value(as, operands[i], &value)) return false;
+            if (as->pass == 2) {
+                uint8_t* p = as->data + as->offset[VOBJ_SECTION_DATA];
+                for (uint32_t b = 0; b < width; b++) {
+                    p[b] = (uint8_t)(value >> (8 * (width - 1 - b)));  /* Big-endian, like instruction words */
+                }
+            }
+            as->offset[VOBJ_SECTION_DATA] += width;
+        }
+    } else {
+        return asm_error(as, "unknown directive '%s'", name);
+    }
+    return true;
+}
+
+/* ============ LINE PROCESSING ============ */
+
+static bool define_label(asm_state_t* as, const char* name) {
+    if (as->pass == 2) return true;
+    if (*name == '\0' || strlen(name) >= VOBJ_SYMBOL_NAME_MAX) {
+        return asm_error(as, "invalid label '%s'", name);
+    }
+    if (find_label(as, name)) return asm_error(as, "duplicate label '%s'", name);
+    if (as->label_count >= ASM_MAX_LABELS) return asm_error(as, "too many labels");
+
+    asm_label_t* label = &as->labels[as->label_count++];
+    strcpy(label->name, name);
+    label->section = as->section;
+    label->offset = as->offset[as->section];
+    return true;
+}
+
+static bool assemble_line(asm_state_t* as, char* line) {
+    char* comment = strchr(line, ';');
+    if (comment) *comment = '\0';
+
+    /* Optional leading label: "NAME:" */
+    char* text = line;
+    while (isspace((unsigned char)*text)) text++;
+    char* colon = strchr(text, ':');
+    if (colon) {
+        *colon = '\0';
+        char* end = colon;
+        while (end > text && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (!define_label(as, text)) return false;
+        text = colon + 1;
+    }
+
+    char* operands[ASM_MAX_OPERANDS];
+    int count = split_operands(text, operands);
+    if (count < 0) return asm_error(as, "too many operands");
+    if (count == 0) return true;
+
+    if (operands[0][0] == '.') {
+        return assemble_directive(as, operands[0], operands + 1, count - 1);
+    }
+
+    const asm_opcode_t* op = find_opcode(operands[0]);
+    if (!op) return asm_error(as, "unknown opcode '%s'", operands[0]);
+    return assemble_instruction(as, op, operands + 1, count - 1);
+}
+
+static bool assemble_pass(asm_state_t* as, const char* source, int pass) {
+    as->pass = pass;
+    as->line_no = 0;
+    as->section = VOBJ_SECTION_CODE;
+    memset(as->offset, 0, sizeof(as->offset));
+
+    const char* p = source;
+    while (*p) {
+        const char* eol = strchr(p, '\n');
+        size_t len = eol ? (size_t)(eol - p) : strlen(p);
+        char line[ASM_MAX_LINE];
+
+        as->line_no++;
+        if (len >= sizeof(line)) return asm_error(as, "line too long");
+        memcpy(line, p, len);
+        line[len] = '\0';
+
+        if (!assemble_line(as, line)) return false;
+        p += len + (eol ? 1 : 0);
+    }
+    return true;
+}
+
+/* ============ ASSEMBLER API ============ */
+
+bool visa_assemble(const char* source, vobj_image_t* image, char* error, size_t error_size) {
+    memset(image, 0, sizeof(*image));
+
+    asm_state_t* as = calloc(1, sizeof(asm_state_t));
+    if (!as) {
+        snprintf(error, error_size, "out of memory");
+        return false;
+    }
+    as->error = error;
+    as->error_size = error_size;
+
+    bool ok = assemble_pass(as, source, 1);
+    if (ok) {
+        as->code_size = as->offset[VOBJ_SECTION_CODE];
+        as->data_size = as->offset[VOBJ_SECTION_DATA];
+        as->bss_size = as->offset[VOBJ_SECTION_BSS];
+        as->code = calloc(1, as->code_size ? as->code_size : 1);
+        as->data = calloc(1, as->data_size ? as->data_size : 1);
+        ok = as->code && as->data;
+        if (!ok) snprintf(error, error_size, "out of memory");
+    }
+    if (ok) ok = assemble_pass(as, source, 2);
+
+    uint32_t entry = 0;
+    if (ok && as->entry_label[0]) {
+        const asm_label_t* label = find_label(as, as->entry_label);
+        if (!label || label->section != VOBJ_SECTION_CODE) {
+            snprintf(error, error_size, "entry label '%s' not found in .text", as->entry_label);
+            ok = false;
+        } else {
+            entry = label_address(as, label);
+        }
+    }
+
+    if (ok && as->label_count > 0) {
+        image->symbols = calloc(as->label_count, sizeof(vobj_symbol_t));
+        if (!image->symbols) {
+            snprintf(error, error_size, "out of memory");
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        free(as->code);
+        free(as->data);
+        free(as);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < as->label_count; i++) {
+        strcpy(image->symbols[i].name, as->labels[i].name);
+        image->symbols[i].value = label_address(as, &as->labels[i]);
+        image->symbols[i].section = (uint8_t)as->labels[i].section;
+    }
+    image->symbol_count = as->label_count;
+    image->code = as->code;
+    image->code_size = as->code_size;
+    image->data = as->data;
+    image->data_size = as->data_size;
+    image->bss_size = as->bss_size;
+    image->entry = entry;
+    image->owns_sections = true;
+    free(as);
+
+    /* Hash exactly what an encoded object would carry */
+    uint8_t* encoded;
+    size_t encoded_size;
+    if (!vobj_encode(image, &encoded, &encoded_size)) {
+        snprintf(error, error_size, "out of memory");
+        vobj_free(image);
+        return false;
+    }
+    free(encoded);
+    return true;
+}
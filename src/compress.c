@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "../include/isa.h"
+
+/* ============ LZ CODEC ============ */
+/* A sequence is a token (literal count << 4 | match length - 4), extra length
+   bytes for either nibble that is 15, the literals, then a 16-bit
+   little-endian match offset. The last sequence has literals only. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 0xFFFF
+
+static uint32_t lz_load32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t lz_hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Lengths of 15 and up continue in 255-valued bytes plus a final remainder */
+static bool lz_put_length(uint8_t** out, const uint8_t* end, uint32_t length) {
+    for (; length >= 255; length -= 255) {
+        if (*out == end) return false;
+        *(*out)++ = 255;
+    }
+    if (*out == end) return false;
+    *(*out)++ = (uint8_t)length;
+    return true;
+}
+
+static bool lz_put_sequence(uint8_t** out, const uint8_t* end, const uint8_t* literals,
+                            uint32_t nr_literals, uint32_t offset, uint32_t match_length) {
+    uint32_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    if (*out == end) return false;
+    *(*out)++ = (uint8_t)((nr_literals < 15 ? nr_literals : 15) << 4 | (match_code < 15 ? match_code : 15));
+    if (nr_literals >= 15 && !lz_put_length(out, end, nr_literals - 15)) return false;
+
+    if ((uint32_t)(end - *out) < nr_literals) return false;
+    memcpy(*out, literals, nr_literals);
+    *out += nr_literals;
+    if (!match_length) return true;
+
+    if (end - *out < 2) return false;
+    *(*out)++ = (uint8_t)offset;
+    *(*out)++ = (uint8_t)(offset >> 8);
+    return match_code < 15 || lz_put_length(out, end, match_code - 15);
+}
+
+uint32_t lz_compress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS];  /* Last position + 1 per hash, 0 = none */
+    memset(table, 0, sizeof(table));
+
+    uint8_t* out = dst;
+    const uint8_t* end = dst + capacity;
+    uint32_t anchor = 0;
+    uint32_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= size) {
+        uint32_t value = lz_load32(src + pos);
+        uint32_t* slot = &table[lz_hash(value)];
+        uint32_t candidate = *slot;
+        *slot = pos + 1;
+        if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+            lz_load32(src + candidate - 1) != value) {
+            pos++;
+            continue;
+        }
+
+        uint32_t match = candidate - 1;
+        uint32_t length = LZ_MIN_MATCH;
+        while (pos + length < size && src[match + length] == src[pos + length]) length++;
+        if (!lz_put_sequence(&out, end, src + anchor, pos - anchor, pos - match, length)) return 0;
+        pos += length;
+        anchor = pos;
+    }
+    if (!lz_put_sequence(&out, end, src + anchor, size - anchor, 0, 0)) return 0;
+    return (uint32_t)(out - dst);
+}
+
+static bool lz_get_length(const uint8_t* src, uint32_t size, uint32_t* in, uint32_t* length) {
+    uint8_t byte;
+    do {
+        if (*in == size) return false;
+        byte = src[(*in)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz_decompress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t dst_size) {
+    uint32_t in = 0, out = 0;
+    while (in < size) {
+        uint8_t token = src[in++];
+        uint32_t nr_literals = token >> 4;
+        if (nr_literals == 15 && !lz_get_length(src, size, &in, &nr_literals)) return false;
+        if (nr_literals > size - in || nr_literals > dst_size - out) return false;
+        memcpy(dst + out, src + in, nr_literals);
+        in += nr_literals;
+        out += nr_literals;
+        if (in == size) break;  /* Last sequence */
+
+        if (size - in < 2) return false;
+        uint32_t offset = src[in] | (uint32_t)src[in + 1] << 8;
+        in += 2;
+        uint32_t length = token & 0x0F;
+        if (length == 15 && !lz_get_length(src, size, &in, &length)) return false;
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || length > dst_size - out) return false;
+
+        /* Byte by byte: the match may overlap what it is producing */
+        for (uint32_t i = 0; i < length; i++, out++) dst[out] = dst[out - offset];
+    }
+    return out == dst_size;
+}
+
+/* ============ IDLE DETECTION ============ */
+
+/* A VM is idle once none of its vCPUs has run for idle_ns. Only ever
+   called with the VM's memory lock held, so no slice is in progress. */
+static bool vm_is_idle(const guest_vm_t* vm, uint64_t now, uint64_t idle_ns, uint64_t* last_run) {
+    *last_run = 0;
+    for (uint32_t v = 0; v < vm->nr_vcpus; v++) {
+        uint64_t ran = __atomic_load_n(&vm->vcpus[v]->last_run_ns, __ATOMIC_RELAXED);
+        if (ran > *last_run) *last_run = ran;
+    }
+    return now - *last_run >= idle_ns;
+}
+
+/* ============ SWEEPS ============ */
+
+/* Continue the sweep of one idle VM for up to budget page table entries.
+   Returns the entries examined. */
+static uint32_t sweep_vm(compress_t* compress, guest_vm_t* vm, uint32_t slot, uint32_t budget,
+                         uint8_t* scratch) {
+    vcpu_t* vcpu = &vm->vcpu;
+    uint32_t nr_pages = vm->memory_size / PAGE_SIZE;
+    uint32_t examined = 0;
+
+    while (compress->cursor[slot] < vcpu->guest_page_count && examined < budget) {
+        guest_page_table_entry_t* pte = &vcpu->guest_page_table[compress->cursor[slot]++];
+        examined++;
+        if (!pte->present || pte->guest_physical_page >= nr_pages) continue;
+
+        /* Touched since the last sweep: warm for one more idle period */
+        if (pte->accessed) {
+            pte->accessed = false;
+            continue;
+        }
+        if (!guest_memory_is_private(vm, pte->guest_physical_page)) continue;
+        if (!guest_memory_compress(vm, pte->guest_physical_page, scratch)) compress->incompressible++;
+    }
+    return examined;
+}
+
+static void scan_batch(compress_t* compress, uint8_t* scratch) {
+    hypervisor_t* hv = compress->hv;
+    uint32_t guest_count = __atomic_load_n(&hv->guest_count, __ATOMIC_ACQUIRE);
+    uint32_t budget = compress->pages_to_scan;
+
+    for (uint32_t i = 0; i < guest_count && budget > 0; i++) {
+        guest_vm_t* vm = &hv->guests[i];
+        if (vm->vm != vm) continue;  /* Secondary vCPUs share the boot vCPU's memory */
+        /* A VM holding its lock is running; it is not idle */
+        if (pthread_mutex_trylock(&vm->mem_lock) != 0) continue;
+
+        uint64_t now = hypervisor_time_ns();
+        uint64_t last_run;
+        if (!vm_is_idle(vm, now, compress->idle_ns, &last_run)) {
+            compress->cursor[i] = 0;  /* Ran since: start the next sweep afresh */
+        } else if (compress->cursor[i] > 0 || now - compress->swept_ns[i] >= compress->idle_ns ||
+                   compress->swept_ns[i] < last_run) {
+            budget -= sweep_vm(compress, vm, i, budget, scratch);
+            if (compress->cursor[i] >= vm->vcpu.guest_page_count) {
+                compress->cursor[i] = 0;
+                compress->swept_ns[i] = now;
+                compress->sweeps++;
+            }
+        }
+        pthread_mutex_unlock(&vm->mem_lock);
+    }
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void* compress_thread(void* arg) {
+    compress_t* compress = arg;
+    uint8_t* scratch = malloc(COMPRESS_MAX_SIZE);
+    if (!scratch) return NULL;
+
+    pthread_mutex_lock(&compress->lock);
+    while (compress->running) {
+        uint64_t start = thread_cpu_ns();
+        scan_batch(compress, scratch);
+        compress->scan_ns += thread_cpu_ns() - start;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = (uint64_t)deadline.tv_nsec + (uint64_t)COMPRESS_SLEEP_MS * 1000000ULL;
+        deadline.tv_sec += (time_t)(ns / 1000000000ULL);
+        deadline.tv_nsec = (long)(ns % 1000000000ULL);
+        while (compress->running &&
+               pthread_cond_timedwait(&compress->wake, &compress->lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&compress->lock);
+    free(scratch);
+    return NULL;
+}
+
+/* ============ COMPRESSOR API ============ */
+
+bool hypervisor_compress_start(hypervisor_t* hv, uint32_t idle_ms, uint32_t pages_to_scan) {
+    if (idle_ms == 0) idle_ms = COMPRESS_DEFAULT_IDLE_MS;
+    if (pages_to_scan == 0) pages_to_scan = COMPRESS_DEFAULT_PAGES;
+
+    compress_t* compress = hv->compress;
+    if (compress && compress->running) {
+        pthread_mutex_lock(&compress->lock);
+        compress->idle_ns = (uint64_t)idle_ms * 1000000ULL;
+        compress->pages_to_scan = pages_to_scan;
+        pthread_mutex_unlock(&compress->lock);
+        return true;
+    }
+
+    if (!compress) {
+        compress = calloc(1, sizeof(compress_t));
+        if (!compress) return false;
+        compress->hv = hv;
+        pthread_mutex_init(&compress->lock, NULL);
+        pthread_cond_init(&compress->wake, NULL);
+        hv->compress = compress;
+    }
+
+    compress->idle_ns = (uint64_t)idle_ms * 1000000ULL;
+    compress->pages_to_scan = pages_to_scan;
+    compress->running = true;
+    if (pthread_create(&compress->thread, NULL, compress_thread, compress) != 0) {
+        compress->running = false;
+        hypervisor_log(hv, VISA_LOG_ERROR, "[COMPRESS] Failed to start compressor thread\n");
+        return false;
+    }
+    placement_pin_helper(hv, compress->thread);
+
+    hypervisor_log(hv, VISA_LOG_INFO,
+                   "[COMPRESS] Compressing cold pages of guests idle for %u ms (%u pages every %u ms)\n", idle_ms,
+                   pages_to_scan, COMPRESS_SLEEP_MS);
+    return true;
+}
+
+void hypervisor_compress_stop(hypervisor_t* hv) {
+    compress_t* compress = hv->compress;
+    if (!compress || !compress->running) return;
+
+    pthread_mutex_lock(&compress->lock);
+    compress->running = false;
+    pthread_cond_signal(&compress->wake);
+    pthread_mutex_unlock(&compress->lock);
+    pthread_join(compress->thread, NULL);
+}
+
+/* Compressed pages belong to their guests and are freed with guest memory */
+void compress_destroy(compress_t* compress) {
+    if (!compress) return;
+    pthread_cond_destroy(&compress->wake);
+    pthread_mutex_destroy(&compress->lock);
+    free(compress);
+}
+
+void hypervisor_compress_stats(hypervisor_t* hv, compress_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    compress_t* compress = hv->compress;
+    if (!compress) return;
+
+    pthread_mutex_lock(&compress->lock);
+    stats->incompressible = compress->incompressible;
+    stats->sweeps = compress->sweeps;
+    stats->scan_ns = compress->scan_ns;
+    pthread_mutex_unlock(&compress->lock);
+
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* vm = &hv->guests[i];
+        if (vm->vm != vm) continue;
+        pthread_mutex_lock(&vm->mem_lock);
+        stats->pages_compressed += vm->compressed_pages;
+        stats->compressed_bytes += vm->compressed_bytes;
+        stats->page_ins += vm->page_ins;
+        stats->page_in_ns += vm->page_in_ns;
+        if (vm->page_in_max_ns > stats->page_in_max_ns) stats->page_in_max_ns = vm->page_in_max_ns;
+        pthread_mutex_unlock(&vm->mem_lock);
+    }
+    stats->bytes_reclaimed = stats->pages_compressed * PAGE_SIZE - stats->compressed_bytes;
+}
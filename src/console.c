@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ RING BUFFER ============ */
+
+static void ring_put(console_channel_t* channel, const uint8_t* data, uint32_t length) {
+    uint32_t tail = (channel->head + channel->count) % CONSOLE_BUFFER_SIZE;
+    uint32_t first = CONSOLE_BUFFER_SIZE - tail < length ? CONSOLE_BUFFER_SIZE - tail : length;
+    memcpy(channel->ring + tail, data, first);
+    memcpy(channel->ring, data + first, length - first);
+    channel->count += length;
+}
+
+/* Move everything buffered into `out` (CONSOLE_BUFFER_SIZE bytes) */
+static uint32_t ring_take(console_channel_t* channel, uint8_t* out) {
+    uint32_t length = channel->count;
+    uint32_t first = CONSOLE_BUFFER_SIZE - channel->head < length ? CONSOLE_BUFFER_SIZE - channel->head : length;
+    memcpy(out, channel->ring + channel->head, first);
+    memcpy(out + first, channel->ring, length - first);
+    channel->head = 0;
+    channel->count = 0;
+    return length;
+}
+
+bool console_write(console_t* console, uint32_t guest_id, const uint8_t* data, uint32_t length) {
+    console_channel_t* channel = &console->channels[guest_id];
+
+    pthread_mutex_lock(&console->lock);
+    channel->prints++;
+    bool fits = CONSOLE_BUFFER_SIZE - channel->count >= length;
+    if (fits) {
+        ring_put(channel, data, length);
+        channel->bytes += length;
+    } else {
+        memcpy(channel->pending, data, length);
+        channel->pending_length = length;
+        channel->waiting = true;
+        channel->stalls++;
+        /* Counted under the lock so the drain thread cannot complete it first */
+        hypervisor_async_begin(console->hv);
+    }
+    pthread_cond_signal(&console->wake);
+    pthread_mutex_unlock(&console->lock);
+    return fits;
+}
+
+/* ============ DRAIN THREAD ============ */
+
+static void channel_emit(console_t* console, uint32_t guest_id, const uint8_t* data, uint32_t length) {
+    console_channel_t* channel = &console->channels[guest_id];
+    if (channel->out) {
+        fwrite(data, 1, length, channel->out);
+        return;
+    }
+
+    /* Embedded: the host gets raw bytes and does its own tagging */
+    if (!console->stream) {
+        const visa_config_t* config = &console->hv->config;
+        if (config->output) config->output(config->user, guest_id + 1, (const char*)data, length);
+        return;
+    }
+
+    /* Multiplexed: tag every line with its guest */
+    for (uint32_t i = 0; i < length; i++) {
+        if (channel->line_start) fprintf(console->stream, "[G%u] ", guest_id);
+        fputc(data[i], console->stream);
+        channel->line_start = data[i] == '\n';
+    }
+}
+
+static bool console_has_output(const console_t* console) {
+    for (uint32_t i = 0; i < MAX_GUESTS; i++) {
+        if (console->channels[i].count || console->channels[i].waiting) return true;
+    }
+    return false;
+}
+
+/* Host writes happen outside the lock, so a slow stdout or disk only ever
+   stalls this thread; guests stall only once their own ring is full */
+static void* console_thread(void* arg) {
+    console_t* console = arg;
+    uint8_t* chunk = malloc(CONSOLE_BUFFER_SIZE);
+    if (!chunk) return NULL;
+
+    pthread_mutex_lock(&console->lock);
+    for (;;) {
+        while (console->running && !console_has_output(console)) {
+            pthread_cond_wait(&console->wake, &console->lock);
+        }
+        if (!console_has_output(console)) break;  /* Stopped and fully drained */
+
+        for (uint32_t id = 0; id < MAX_GUESTS; id++) {
+            console_channel_t* channel = &console->channels[id];
+            if (!channel->count && !channel->waiting) continue;
+
+            uint32_t length = ring_take(channel, chunk);
+
+            /* The ring is empty now, so a parked print always fits */
+            if (channel->waiting) {
+                uint32_t pending = channel->pending_length;
+                ring_put(channel, channel->pending, pending);
+                channel->bytes += pending;
+                channel->waiting = false;
+                hypervisor_async_complete(console->hv, WAIT_CONSOLE, id, pending);
+            }
+
+            pthread_mutex_unlock(&console->lock);
+            channel_emit(console, id, chunk, length);
+            pthread_mutex_lock(&console->lock);
+        }
+
+        pthread_mutex_unlock(&console->lock);
+        if (console->stream) fflush(console->stream);
+        for (uint32_t id = 0; id < MAX_GUESTS; id++) {
+            if (console->channels[id].out) fflush(console->channels[id].out);
+        }
+        pthread_mutex_lock(&console->lock);
+    }
+    pthread_mutex_unlock(&console->lock);
+
+    free(chunk);
+    return NULL;
+}
+
+/* ============ HYPERVISOR INTERFACE ============ */
+
+bool hypervisor_console_start(hypervisor_t* hv, const char* log_prefix) {
+    if (hv->console) return true;
+
+    console_t* console = calloc(1, sizeof(console_t));
+    if (!console) return false;
+    console->hv = hv;
+    console->stream = hv->stdio ? stdout : NULL;
+    for (uint32_t i = 0; i < MAX_GUESTS; i++) {
+        console->channels[i].line_start = true;
+    }
+
+    if (log_prefix) {
+        console->log_prefix = strdup(log_prefix);
+        if (!console->log_prefix) {
+            free(console);
+            return false;
+        }
+    }
+    pthread_mutex_init(&console->lock, NULL);
+    pthread_cond_init(&console->wake, NULL);
+
+    console->running = true;
+    if (pthread_create(&console->thread, NULL, console_thread, console) != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[CONSOLE] Failed to start drain thread\n");
+        console->running = false;
+        console_destroy(console);
+        return false;
+    }
+    placement_pin_helper(hv, console->thread);
+
+    hv->console = console;
+    hypervisor_log(hv, VISA_LOG_INFO, "[CONSOLE] Guest output %s%s\n",
+                   log_prefix ? "logged to " : console->stream ? "multiplexed to stdout" : "passed to the host",
+                   log_prefix ? log_prefix : "");
+    return true;
+}
+
+/* Open a guest's log on its first print (scheduler thread, before queueing) */
+static bool console_open_log(console_t* console, uint32_t guest_id) {
+    console_channel_t* channel = &console->channels[guest_id];
+    if (!console->log_prefix || channel->out) return true;
+
+    size_t size = strlen(console->log_prefix) + 16;
+    char* path = malloc(size);
+    if (!path) return false;
+    snprintf(path, size, "%s%u.log", console->log_prefix, guest_id);
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        hypervisor_log(console->hv, VISA_LOG_ERROR, "[CONSOLE] Cannot open %s\n", path);
+        free(path);
+        return false;
+    }
+    free(path);
+
+    pthread_mutex_lock(&console->lock);
+    channel->out = out;
+    pthread_mutex_unlock(&console->lock);
+    return true;
+}
+
+/* HYPERCALL_PRINT r1=guest virtual address, r2=length; r0 = bytes printed.
+   Prints longer than the console buffer are truncated to it. */
+bool hypervisor_console_print(hypervisor_t* hv, guest_vm_t* guest, uint32_t* result) {
+    if (!hv->console && !hypervisor_console_start(hv, NULL)) {
+        *result = 0xFFFFFFFF;
+        return true;
+    }
+
+    uint32_t addr = guest->vcpu.registers[1];
+    uint32_t length = guest->vcpu.registers[2];
+    if (length > CONSOLE_BUFFER_SIZE) length = CONSOLE_BUFFER_SIZE;
+
+    /* Copied under the memory lock: the compressor may own the pages */
+    uint8_t data[CONSOLE_BUFFER_SIZE];
+    if (!hypervisor_copy_from_guest(guest, addr, data, length)) {
+        *result = 0xFFFFFFFF;
+        return true;
+    }
+
+    if (!console_open_log(hv->console, guest->vm_id)) {
+        *result = 0xFFFFFFFF;
+        return true;
+    }
+
+    if (console_write(hv->console, guest->vm_id, data, length)) {
+        *result = length;
+        return true;
+    }
+    return false;
+}
+
+/* One byte from a device model (the UART), which cannot park the guest in the
+   middle of an instruction: a byte that does not fit is dropped instead */
+bool hypervisor_console_putc(hypervisor_t* hv, guest_vm_t* guest, uint8_t byte) {
+    if (!hv->console && !hypervisor_console_start(hv, NULL)) return false;
+    console_t* console = hv->console;
+    if (!console_open_log(console, guest->vm_id)) return false;
+
+    console_channel_t* channel = &console->channels[guest->vm_id];
+    pthread_mutex_lock(&console->lock);
+    bool fits = !channel->waiting && channel->count < CONSOLE_BUFFER_SIZE;
+    if (fits) {
+        ring_put(channel, &byte, 1);
+        channel->bytes++;
+        /* Wake the drain thread per line rather than per byte */
+        if (byte == '\n' || channel->count >= CONSOLE_BUFFER_SIZE / 2) {
+            channel->prints++;
+            pthread_cond_signal(&console->wake);
+        }
+    }
+    pthread_mutex_unlock(&console->lock);
+    return fits;
+}
+
+void hypervisor_console_stop(hypervisor_t* hv) {
+    console_t* console = hv->console;
+    if (!console || !console->running) return;
+
+    pthread_mutex_lock(&console->lock);
+    console->running = false;
+    pthread_cond_signal(&console->wake);
+    pthread_mutex_unlock(&console->lock);
+    pthread_join(console->thread, NULL);
+
+    for (uint32_t id = 0; id < MAX_GUESTS; id++) {
+        console_channel_t* channel = &console->channels[id];
+        if (!channel->prints) continue;
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[CONSOLE] Guest %u: %llu bytes in %llu prints, %llu stalls on a full buffer\n", id,
+                       (unsigned long long)channel->bytes, (unsigned long long)channel->prints,
+                       (unsigned long long)channel->stalls);
+    }
+}
+
+void console_destroy(console_t* console) {
+    if (!console) return;
+    for (uint32_t id = 0; id < MAX_GUESTS; id++) {
+        if (console->channels[id].out) fclose(console->channels[id].out);
+    }
+    free(console->log_prefix);
+    pthread_cond_destroy(&console->wake);
+    pthread_mutex_destroy(&console->lock);
+    free(console);
+}
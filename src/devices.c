@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ UART ============ */
+/* Offset 0: transmit (writes go to the guest's console channel, reads 0)
+   Offset 1: line status, bit 0 = transmitter ready (always set) */
+
+#define UART_TX 0
+#define UART_STATUS 1
+#define UART_STATUS_TX_READY 0x01
+
+typedef struct {
+    hypervisor_t* hv;
+    uint64_t dropped;         /* Bytes the console had no room for */
+} uart_t;
+
+static void* uart_create(hypervisor_t* hv) {
+    uart_t* uart = calloc(1, sizeof(uart_t));
+    if (uart) uart->hv = hv;
+    return uart;
+}
+
+static uint8_t uart_read(void* opaque __attribute__((unused)), guest_vm_t* guest __attribute__((unused)),
+                         uint32_t offset) {
+    return offset == UART_STATUS ? UART_STATUS_TX_READY : 0;
+}
+
+static void uart_write(void* opaque, guest_vm_t* guest, uint32_t offset, uint8_t value) {
+    uart_t* uart = opaque;
+    if (offset == UART_TX && !hypervisor_console_putc(uart->hv, guest, value)) uart->dropped++;
+}
+
+static void uart_release(void* opaque) {
+    uart_t* uart = opaque;
+    if (uart->dropped) {
+        hypervisor_log(uart->hv, VISA_LOG_WARN, "[MMIO] uart: %llu bytes dropped on a full console\n",
+                       (unsigned long long)uart->dropped);
+    }
+    free(uart);
+}
+
+static const mmio_ops_t uart_ops = {
+    .name = "uart",
+    .read = uart_read,
+    .write = uart_write,
+    .release = uart_release,
+};
+
+/* ============ SCRATCH REGISTERS ============ */
+/* 256 bytes of device-side storage; exercises the dispatch path on its own */
+
+#define SCRATCH_SIZE 256
+
+static void* scratch_create(hypervisor_t* hv __attribute__((unused))) {
+    return calloc(1, SCRATCH_SIZE);
+}
+
+static uint8_t scratch_read(void* opaque, guest_vm_t* guest __attribute__((unused)), uint32_t offset) {
+    return ((uint8_t*)opaque)[offset];
+}
+
+static void scratch_write(void* opaque, guest_vm_t* guest __attribute__((unused)), uint32_t offset,
+                          uint8_t value) {
+    ((uint8_t*)opaque)[offset] = value;
+}
+
+static const mmio_ops_t scratch_ops = {
+    .name = "scratch",
+    .read = scratch_read,
+    .write = scratch_write,
+    .release = free,
+};
+
+/* ============ DEVICE TABLE ============ */
+
+static const mmio_device_t devices[] = {
+    { "uart", 2, uart_create, &uart_ops },
+    { "scratch", SCRATCH_SIZE, scratch_create, &scratch_ops },
+};
+
+const mmio_device_t* mmio_device_lookup(const char* name) {
+    for (size_t i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+        if (strcmp(devices[i].name, name) == 0) return &devices[i];
+    }
+    return NULL;
+}
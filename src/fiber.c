@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ COROUTINE SWITCHING ============ */
+
+/* makecontext only passes ints, so the entry point picks its fiber up here */
+static __thread fiber_t* fiber_starting;
+
+static void fiber_entry(void) {
+    fiber_t* fiber = fiber_starting;
+    fiber->result = fiber->handler(fiber->hv, fiber->guest);
+    fiber->state = FIBER_DONE;
+    /* Returning follows uc_link back to the scheduler */
+}
+
+fiber_t* fiber_create(void) {
+    fiber_t* fiber = calloc(1, sizeof(fiber_t));
+    if (!fiber) return NULL;
+    fiber->stack = malloc(FIBER_STACK_SIZE);
+    fiber->buffer = malloc(FIBER_IO_MAX);
+    if (!fiber->stack || !fiber->buffer) {
+        fiber_destroy(fiber);
+        return NULL;
+    }
+    return fiber;
+}
+
+void fiber_destroy(fiber_t* fiber) {
+    if (!fiber) return;
+    free(fiber->stack);
+    free(fiber->buffer);
+    free(fiber);
+}
+
+/* Point fiber_starting's context at fiber_entry on a fresh stack. Only the
+   thread-local is used after getcontext, so nothing here can be clobbered. */
+static void fiber_prepare(void) {
+    getcontext(&fiber_starting->context);
+    fiber_starting->context.uc_stack.ss_sp = fiber_starting->stack;
+    fiber_starting->context.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber_starting->context.uc_link = &fiber_starting->host;
+    makecontext(&fiber_starting->context, fiber_entry, 0);
+}
+
+uint32_t fiber_suspend(fiber_t* fiber) {
+    fiber->state = FIBER_SUSPENDED;
+    fiber->suspends++;
+    swapcontext(&fiber->context, &fiber->host);
+    return fiber->result;
+}
+
+/* Run the fiber until its handler returns or suspends. A finished handler
+   resumes the guest with its result; returns true if the guest is runnable. */
+static bool fiber_switch(hypervisor_t* hv, guest_vm_t* guest, fiber_t* fiber) {
+    fiber->state = FIBER_RUNNING;
+    swapcontext(&fiber->host, &fiber->context);
+
+    if (fiber->state != FIBER_DONE) return false;  /* Waiting; the guest is parked */
+    fiber->state = FIBER_IDLE;
+    hypervisor_resume_guest(hv, guest, fiber->result);
+    return true;
+}
+
+/* ============ HYPERVISOR INTERFACE ============ */
+
+bool hypervisor_run_handler(hypervisor_t* hv, guest_vm_t* guest, fiber_handler_t handler) {
+    fiber_t* fiber = guest->fiber;
+    if (!fiber) {
+        fiber = guest->fiber = fiber_create();
+        if (!fiber) {
+            hypervisor_log(hv, VISA_LOG_ERROR, "[IO] Guest %u: out of memory for exit handler\n", guest->vm_id);
+            hypervisor_resume_guest(hv, guest, 0xFFFFFFFF);
+            return true;
+        }
+    }
+
+    fiber->handler = handler;
+    fiber->hv = hv;
+    fiber->guest = guest;
+    fiber->runs++;
+    fiber_starting = fiber;
+    fiber_prepare();
+    return fiber_switch(hv, guest, fiber);
+}
+
+bool hypervisor_resume_handler(hypervisor_t* hv, guest_vm_t* guest, uint32_t result) {
+    fiber_t* fiber = guest->fiber;
+    if (!fiber || fiber->state != FIBER_SUSPENDED) return false;
+
+    fiber->result = result;
+    fiber_switch(hv, guest, fiber);
+    return true;
+}
+
+uint32_t hypervisor_await_io(hypervisor_t* hv, guest_vm_t* guest, io_request_t* request) {
+    if (!hv->iopool && !hypervisor_iopool_start(hv, 0)) return 0xFFFFFFFF;
+
+    request->event = WAIT_HYPERCALL;
+    request->key = guest->vm_id;
+    hypervisor_block_guest(hv, guest, WAIT_HYPERCALL, guest->vm_id);
+    iopool_submit(hv->iopool, request);
+    return fiber_suspend(guest->fiber);
+}
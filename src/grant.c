@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ HELPERS ============ */
+
+static guest_vm_t* grant_vm(hypervisor_t* hv, uint32_t vm_id) {
+    return vm_id < hv->guest_count ? hv->guests[vm_id].vm : NULL;
+}
+
+static grant_table_t* grant_table(guest_vm_t* vm) {
+    if (!vm->grants) vm->grants = calloc(1, sizeof(grant_table_t));
+    return vm->grants;
+}
+
+/* Grants touch two VMs; locking in slot order keeps the execution thread
+   from deadlocking against itself or host callers */
+static void grant_lock(guest_vm_t* a, guest_vm_t* b) {
+    if (a->vm_id > b->vm_id) {
+        guest_vm_t* t = a;
+        a = b;
+        b = t;
+    }
+    pthread_mutex_lock(&a->mem_lock);
+    pthread_mutex_lock(&b->mem_lock);
+}
+
+static void grant_unlock(guest_vm_t* a, guest_vm_t* b) {
+    pthread_mutex_unlock(&a->mem_lock);
+    pthread_mutex_unlock(&b->mem_lock);
+}
+
+/* Page-aligned, inside guest memory, and neither device nor granted pages */
+static bool grant_range_ok(const guest_vm_t* vm, uint32_t guest_phys_addr, uint32_t nr_pages) {
+    if (guest_phys_addr % PAGE_SIZE != 0 || nr_pages == 0 ||
+        (uint64_t)guest_phys_addr + (uint64_t)nr_pages * PAGE_SIZE > vm->memory_size) {
+        return false;
+    }
+    for (uint32_t i = 0; i < nr_pages; i++) {
+        const ept_entry_t* entry = &vm->ept[guest_phys_addr / PAGE_SIZE + i];
+        if (entry->mmio || entry->grant) return false;
+    }
+    return true;
+}
+
+/* Entry `ref` of owner's table if it is lent to peer, else NULL */
+static grant_entry_t* grant_entry(guest_vm_t* owner, guest_vm_t* peer, uint32_t ref) {
+    if (!owner->grants || ref >= GRANT_MAX_ENTRIES) return NULL;
+    grant_entry_t* entry = &owner->grants->entries[ref];
+    return entry->in_use && entry->peer == peer->vm_id ? entry : NULL;
+}
+
+static void grant_record(hypervisor_t* hv, guest_vm_t* vm, grant_op_t op, uint32_t page, uint32_t nr_pages,
+                         guest_vm_t* owner, uint32_t owner_page) {
+    if (hv->replay) replay_record_grant(hv->replay, vm, op, page, nr_pages, owner, owner_page);
+}
+
+/* ============ EPT UPDATES ============ */
+
+/* Pages leaving ordinary RAM may hold decoded blocks, so those go too */
+void guest_grant_apply(guest_vm_t* vm, grant_op_t op, uint32_t page, uint32_t nr_pages,
+                       guest_vm_t* owner, uint32_t owner_page) {
+    vm = vm->vm;
+    bool flush = false;
+    for (uint32_t i = 0; i < nr_pages; i++) {
+        flush |= vm->ept[page + i].code;
+        switch (op) {
+            case GRANT_OP_PIN:
+            case GRANT_OP_UNPIN:
+                guest_memory_pin_grant(vm, page + i, op == GRANT_OP_PIN);
+                break;
+            case GRANT_OP_MAP_RO:
+            case GRANT_OP_MAP_RW:
+                guest_memory_map_grant(vm, page + i, owner->vm->ept[owner_page + i].host_page,
+                                       op == GRANT_OP_MAP_RW);
+                break;
+            case GRANT_OP_UNMAP:
+                guest_memory_unmap_grant(vm, page + i);
+                break;
+        }
+    }
+    if (flush) block_cache_flush(vm);
+}
+
+/* Caller holds both locks */
+static void grant_unmap_locked(hypervisor_t* hv, guest_vm_t* owner, guest_vm_t* peer, grant_entry_t* entry) {
+    guest_grant_apply(peer, GRANT_OP_UNMAP, entry->peer_page, entry->nr_pages, NULL, 0);
+    grant_record(hv, peer, GRANT_OP_UNMAP, entry->peer_page, entry->nr_pages, owner, entry->first_page);
+    peer->grants->pages_mapped -= entry->nr_pages;
+    entry->mapped = false;
+}
+
+/* ============ GRANT OPERATIONS ============ */
+
+uint32_t hypervisor_grant(hypervisor_t* hv, guest_vm_t* owner, uint32_t peer_id,
+                          uint32_t guest_phys_addr, uint32_t nr_pages, bool writable) {
+    owner = owner->vm;
+    guest_vm_t* peer = grant_vm(hv, peer_id);
+    if (!peer || peer == owner) return GRANT_INVALID;
+
+    uint32_t ref = GRANT_INVALID;
+    pthread_mutex_lock(&owner->mem_lock);
+    grant_table_t* table = grant_range_ok(owner, guest_phys_addr, nr_pages) ? grant_table(owner) : NULL;
+    for (uint32_t i = 0; table && i < GRANT_MAX_ENTRIES; i++) {
+        if (!table->entries[i].in_use) {
+            ref = i;
+            break;
+        }
+    }
+    if (ref != GRANT_INVALID) {
+        grant_entry_t* entry = &table->entries[ref];
+        memset(entry, 0, sizeof(*entry));
+        entry->in_use = true;
+        entry->writable = writable;
+        entry->peer = peer->vm_id;
+        entry->first_page = guest_phys_addr / PAGE_SIZE;
+        entry->nr_pages = nr_pages;
+
+        guest_grant_apply(owner, GRANT_OP_PIN, entry->first_page, nr_pages, NULL, 0);
+        grant_record(hv, owner, GRANT_OP_PIN, entry->first_page, nr_pages, NULL, 0);
+        table->pages_granted += nr_pages;
+    }
+    pthread_mutex_unlock(&owner->mem_lock);
+    return ref;
+}
+
+uint32_t hypervisor_grant_map(hypervisor_t* hv, guest_vm_t* peer, uint32_t owner_id,
+                              uint32_t ref, uint32_t guest_phys_addr) {
+    peer = peer->vm;
+    guest_vm_t* owner = grant_vm(hv, owner_id);
+    if (!owner || owner == peer) return GRANT_INVALID;
+
+    uint32_t result = GRANT_INVALID;
+    grant_lock(owner, peer);
+    grant_entry_t* entry = grant_entry(owner, peer, ref);
+    if (entry && !entry->mapped && grant_range_ok(peer, guest_phys_addr, entry->nr_pages) && grant_table(peer)) {
+        grant_op_t op = entry->writable ? GRANT_OP_MAP_RW : GRANT_OP_MAP_RO;
+        entry->peer_page = guest_phys_addr / PAGE_SIZE;
+        entry->mapped = true;
+        guest_grant_apply(peer, op, entry->peer_page, entry->nr_pages, owner, entry->first_page);
+        grant_record(hv, peer, op, entry->peer_page, entry->nr_pages, owner, entry->first_page);
+        peer->grants->pages_mapped += entry->nr_pages;
+        owner->grants->maps++;
+        result = entry->nr_pages;
+    }
+    grant_unlock(owner, peer);
+    return result;
+}
+
+uint32_t hypervisor_grant_unmap(hypervisor_t* hv, guest_vm_t* peer, uint32_t owner_id, uint32_t ref) {
+    peer = peer->vm;
+    guest_vm_t* owner = grant_vm(hv, owner_id);
+    if (!owner || owner == peer) return GRANT_INVALID;
+
+    uint32_t result = GRANT_INVALID;
+    grant_lock(owner, peer);
+    grant_entry_t* entry = grant_entry(owner, peer, ref);
+    if (entry && entry->mapped) {
+        grant_unmap_locked(hv, owner, peer, entry);
+        result = entry->nr_pages;
+    }
+    grant_unlock(owner, peer);
+    return result;
+}
+
+/* The owner can end a grant at any time: a peer still mapping it is left
+   with zero pages where the shared ones were */
+uint32_t hypervisor_grant_revoke(hypervisor_t* hv, guest_vm_t* owner, uint32_t ref) {
+    owner = owner->vm;
+    if (ref >= GRANT_MAX_ENTRIES) return GRANT_INVALID;
+
+    pthread_mutex_lock(&owner->mem_lock);
+    bool in_use = owner->grants && owner->grants->entries[ref].in_use;
+    guest_vm_t* peer = in_use ? &hv->guests[owner->grants->entries[ref].peer] : NULL;
+    pthread_mutex_unlock(&owner->mem_lock);
+    if (!peer) return GRANT_INVALID;
+
+    uint32_t result = GRANT_INVALID;
+    grant_lock(owner, peer);
+    grant_entry_t* entry = grant_entry(owner, peer, ref);
+    if (entry) {
+        if (entry->mapped) grant_unmap_locked(hv, owner, peer, entry);
+        guest_grant_apply(owner, GRANT_OP_UNPIN, entry->first_page, entry->nr_pages, NULL, 0);
+        grant_record(hv, owner, GRANT_OP_UNPIN, entry->first_page, entry->nr_pages, NULL, 0);
+        owner->grants->pages_granted -= entry->nr_pages;
+        owner->grants->revokes++;
+        entry->in_use = false;
+        result = entry->nr_pages;
+    }
+    grant_unlock(owner, peer);
+    return result;
+}
+
+/* ============ DOORBELLS ============ */
+/* Like IPIs, doorbells are wakeups: each guest keeps a mask of the slots that
+   rang it, which HYPERCALL_WAIT_NOTIFY returns and clears */
+
+bool hypervisor_notify(hypervisor_t* hv, guest_vm_t* from, uint32_t target) {
+    if (target >= hv->guest_count) return false;
+    guest_vm_t* dest = &hv->guests[target];
+    if (dest->vcpu.state == GUEST_STOPPED) return false;
+
+    uint32_t bit = 1u << from->vm_id;
+    if (hypervisor_wake(hv, WAIT_NOTIFY, dest->vm_id, bit) == 0) {
+        dest->notify_pending |= bit;
+    }
+    if (from->vm->grants) from->vm->grants->notifies++;
+    return true;
+}
+
+/* ============ REPORTING ============ */
+
+void hypervisor_grant_report(hypervisor_t* hv) {
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* vm = &hv->guests[i];
+        if (vm->vm != vm || !vm->grants) continue;
+
+        pthread_mutex_lock(&vm->mem_lock);
+        const grant_table_t* table = vm->grants;
+        for (uint32_t ref = 0; ref < GRANT_MAX_ENTRIES; ref++) {
+            const grant_entry_t* entry = &table->entries[ref];
+            if (!entry->in_use) continue;
+            log_line_t line = {0};
+            log_append(&line, "[GRANT] Guest VM %u ref %u: 0x%X+%u pages to VM %u (%s", i, ref,
+                       entry->first_page * PAGE_SIZE, entry->nr_pages, entry->peer,
+                       entry->writable ? "rw" : "ro");
+            if (entry->mapped) log_append(&line, ", mapped at 0x%X", entry->peer_page * PAGE_SIZE);
+            hypervisor_log(hv, VISA_LOG_INFO, "%s)\n", line.text);
+        }
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[GRANT] Guest VM %u: %u pages lent, %u borrowed; %llu maps, %llu revokes, %llu doorbells\n", i,
+                       table->pages_granted, table->pages_mapped, (unsigned long long)table->maps,
+                       (unsigned long long)table->revokes, (unsigned long long)table->notifies);
+        pthread_mutex_unlock(&vm->mem_lock);
+    }
+}
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ HYPERCALL DISPATCH ============ */
+/* ABI: `hypercall rN` takes the hypercall number from rN and arguments from
+   r1-r3; the result is returned in r0 when the guest resumes. */
+
+static void hypercall_return(hypervisor_t* hv, guest_vm_t* guest, uint32_t result) {
+    hypervisor_resume_guest(hv, guest, result);
+}
+
+static guest_vm_t* hypercall_target(hypervisor_t* hv, uint32_t vm_id) {
+    if (vm_id >= hv->guest_count) return NULL;
+    guest_vm_t* target = &hv->guests[vm_id];
+    return target->vcpu.state == GUEST_STOPPED ? NULL : target;
+}
+
+/* HYPERCALL_SEND r1=destination guest, r2=value; r0 = 1 on delivery */
+static bool hypercall_send(hypervisor_t* hv, guest_vm_t* guest) {
+    guest_vm_t* dest = hypercall_target(hv, guest->vcpu.registers[1]);
+    uint32_t value = guest->vcpu.registers[2];
+
+    if (!dest) {
+        hypercall_return(hv, guest, 0);
+        return true;
+    }
+
+    /* Hand the value straight to a receiver parked on its mailbox */
+    if (hypervisor_wake(hv, WAIT_MESSAGE, dest->vm_id, value) == 0) {
+        if (dest->mailbox_count == GUEST_MAILBOX_SIZE) {
+            hypercall_return(hv, guest, 0);
+            return true;
+        }
+        dest->mailbox[(dest->mailbox_head + dest->mailbox_count) % GUEST_MAILBOX_SIZE] = value;
+        dest->mailbox_count++;
+    }
+
+    hypercall_return(hv, guest, 1);
+    return true;
+}
+
+/* HYPERCALL_RECV: r0 = next message, blocking until one arrives */
+static bool hypercall_recv(hypervisor_t* hv, guest_vm_t* guest) {
+    if (guest->mailbox_count > 0) {
+        uint32_t value = guest->mailbox[guest->mailbox_head];
+        guest->mailbox_head = (guest->mailbox_head + 1) % GUEST_MAILBOX_SIZE;
+        guest->mailbox_count--;
+        hypercall_return(hv, guest, value);
+        return true;
+    }
+
+    hypervisor_block_guest(hv, guest, WAIT_MESSAGE, guest->vm_id);
+    return false;
+}
+
+/* HYPERCALL_PRINT r1=address, r2=length; blocks while the console buffer is full */
+static bool hypercall_print(hypervisor_t* hv, guest_vm_t* guest) {
+    uint32_t result;
+    if (hypervisor_console_print(hv, guest, &result)) {
+        hypercall_return(hv, guest, result);
+        return true;
+    }
+
+    /* The drain thread wakes the guest with the byte count once it is queued */
+    hypervisor_block_guest(hv, guest, WAIT_CONSOLE, guest->vm_id);
+    return false;
+}
+
+/* HYPERCALL_WAIT_IPI: r0 = mask of vCPUs that sent an IPI, blocking until one does */
+static bool hypercall_wait_ipi(hypervisor_t* hv, guest_vm_t* guest) {
+    if (guest->ipi_pending) {
+        uint32_t pending = guest->ipi_pending;
+        guest->ipi_pending = 0;
+        hypercall_return(hv, guest, pending);
+        return true;
+    }
+
+    hypervisor_block_guest(hv, guest, WAIT_IPI, guest->vm_id);
+    return false;
+}
+
+/* HYPERCALL_WAIT_NOTIFY: r0 = mask of guests that rang, blocking until one does */
+static bool hypercall_wait_notify(hypervisor_t* hv, guest_vm_t* guest) {
+    if (guest->notify_pending) {
+        uint32_t pending = guest->notify_pending;
+        guest->notify_pending = 0;
+        hypercall_return(hv, guest, pending);
+        return true;
+    }
+
+    hypervisor_block_guest(hv, guest, WAIT_NOTIFY, guest->vm_id);
+    return false;
+}
+
+/* HYPERCALL_DISK_READ / HYPERCALL_DISK_WRITE run as exit handler coroutines:
+   the vCPU is suspended while an I/O thread does the transfer. Transfers are
+   truncated to FIBER_IO_MAX bytes. */
+static uint32_t disk_transfer(hypervisor_t* hv, guest_vm_t* guest, io_op_t op) {
+    uint32_t addr = guest->vcpu.registers[1];
+    uint32_t length = guest->vcpu.registers[2];
+    if (length > FIBER_IO_MAX) length = FIBER_IO_MAX;
+    uint8_t* buffer = guest->fiber->buffer;
+
+    int fd = guest->vm->disk_fd;
+    if (fd < 0) return 0xFFFFFFFF;
+    if (op == IO_WRITE && !hypervisor_copy_from_guest(guest, addr, buffer, length)) return 0xFFFFFFFF;
+
+    io_request_t request;
+    request.op = op;
+    request.fd = fd;
+    request.buffer = buffer;
+    request.length = length;
+    request.offset = guest->vcpu.registers[3];
+    uint32_t result = hypervisor_await_io(hv, guest, &request);
+
+    if (op == IO_READ && result != 0xFFFFFFFF &&
+        !hypervisor_copy_to_guest(hv, guest, addr, buffer, result)) {
+        return 0xFFFFFFFF;
+    }
+    return result;
+}
+
+static uint32_t disk_read_handler(hypervisor_t* hv, guest_vm_t* guest) {
+    return disk_transfer(hv, guest, IO_READ);
+}
+
+static uint32_t disk_write_handler(hypervisor_t* hv, guest_vm_t* guest) {
+    return disk_transfer(hv, guest, IO_WRITE);
+}
+
+bool hypervisor_handle_hypercall(hypervisor_t* hv, guest_vm_t* guest) {
+    uint32_t nr_reg = guest->vcpu.vmcs.exit_qualification & 0xFF;
+    uint32_t number = nr_reg < REGISTER_COUNT ? guest->vcpu.registers[nr_reg] : 0;
+
+    if (hv->config.on_hypercall) {
+        uint32_t result = 0;
+        if (hv->config.on_hypercall(hv->config.user, hv, guest->vm_id + 1, number,
+                                    &guest->vcpu.registers[1], &result)) {
+            hypercall_return(hv, guest, result);
+            return true;
+        }
+    }
+
+    switch (number) {
+        case HYPERCALL_PRINT:
+            return hypercall_print(hv, guest);
+
+        case HYPERCALL_EXIT:
+            guest->vcpu.state = GUEST_STOPPED;
+            return false;
+
+        case HYPERCALL_SLEEP: {
+            uint64_t sleep_ns = (uint64_t)guest->vcpu.registers[1] * 1000ULL;
+            if (sleep_ns == 0) {
+                hypercall_return(hv, guest, 0);  /* Plain yield */
+                return true;
+            }
+            hypervisor_sleep_guest(hv, guest, hypervisor_time_ns() + sleep_ns);
+            return false;
+        }
+
+        case HYPERCALL_SEND:
+            return hypercall_send(hv, guest);
+
+        case HYPERCALL_RECV:
+            return hypercall_recv(hv, guest);
+
+        case HYPERCALL_VCPU_ID:
+            hypercall_return(hv, guest, guest->vcpu_index);
+            return true;
+
+        case HYPERCALL_WAIT_IPI:
+            return hypercall_wait_ipi(hv, guest);
+
+        case HYPERCALL_DISK_READ:
+            return hypervisor_run_handler(hv, guest, disk_read_handler);
+
+        case HYPERCALL_DISK_WRITE:
+            return hypervisor_run_handler(hv, guest, disk_write_handler);
+
+        case HYPERCALL_GRANT: {
+            uint32_t pages = guest->vcpu.registers[3];
+            hypercall_return(hv, guest, hypervisor_grant(hv, guest, guest->vcpu.registers[1], guest->vcpu.registers[2],
+                                                         pages & ~GRANT_WRITABLE, (pages & GRANT_WRITABLE) != 0));
+            return true;
+        }
+
+        case HYPERCALL_GRANT_MAP:
+            hypercall_return(hv, guest, hypervisor_grant_map(hv, guest, guest->vcpu.registers[1],
+                                                             guest->vcpu.registers[2], guest->vcpu.registers[3]));
+            return true;
+
+        case HYPERCALL_GRANT_UNMAP:
+            hypercall_return(hv, guest, hypervisor_grant_unmap(hv, guest, guest->vcpu.registers[1],
+                                                               guest->vcpu.registers[2]));
+            return true;
+
+        case HYPERCALL_GRANT_REVOKE:
+            hypercall_return(hv, guest, hypervisor_grant_revoke(hv, guest, guest->vcpu.registers[1]));
+            return true;
+
+        case HYPERCALL_NOTIFY:
+            hypercall_return(hv, guest, hypervisor_notify(hv, guest, guest->vcpu.registers[1]) ? 1 : 0);
+            return true;
+
+        case HYPERCALL_WAIT_NOTIFY:
+            return hypercall_wait_notify(hv, guest);
+
+        default:
+            hypervisor_log(hv, VISA_LOG_WARN, "[HYPERCALL] Guest %u: unsupported hypercall %u\n", guest->vm_id, number);
+            hypercall_return(hv, guest, 0xFFFFFFFF);
+            return true;
+    }
+}
+
+/* ============ INTER-PROCESSOR INTERRUPTS ============ */
+/* IPIs are wakeups, not asynchronous interrupts: each vCPU keeps a mask of
+   sending vCPUs that HYPERCALL_WAIT_IPI returns and clears */
+
+bool hypervisor_send_ipi(hypervisor_t* hv, guest_vm_t* from, uint32_t target) {
+    guest_vm_t* vm = from->vm;
+    if (target >= vm->nr_vcpus) return false;
+    guest_vm_t* dest = vm->vcpus[target];
+    if (dest->vcpu.state == GUEST_STOPPED) return false;
+
+    uint32_t bit = 1u << from->vcpu_index;
+    if (hypervisor_wake(hv, WAIT_IPI, dest->vm_id, bit) == 0) {
+        dest->ipi_pending |= bit;
+    }
+    return true;
+}
+
+/* `ipi rd`: r0 = 1 if vCPU r[rd] of the sender's VM exists and is running */
+bool hypervisor_handle_ipi(hypervisor_t* hv, guest_vm_t* guest) {
+    uint32_t target_reg = guest->vcpu.vmcs.exit_qualification & 0xFF;
+    uint32_t target = target_reg < REGISTER_COUNT ? guest->vcpu.registers[target_reg] : MAX_VCPUS;
+    hypercall_return(hv, guest, hypervisor_send_ipi(hv, guest, target) ? 1 : 0);
+    return true;
+}
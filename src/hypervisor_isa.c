@@ -1,14 +1,157 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <endian.h>
+#include <unistd.h>
 #include "../include/isa.h"
+#include "../include/assembler.h"
+
+/* ============ BASIC-BLOCK DECODE CACHE ============ */
+
+/* Instructions that end a basic block: control transfers, anything that can
+   exit to the hypervisor, and TLBFLUSHV (which invalidates the block cache) */
+static bool opcode_ends_block(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOV:
+        case OP_LOAD: case OP_STORE: case OP_CAS: case OP_FADD: case OP_FENCE:
+        case OP_MOVI: case OP_ADDI: case OP_SUBI: case OP_MULI: case OP_DIVI:
+        case OP_VMCAUSE: case OP_VMTRAPCFG: case OP_LDPGTR: case OP_LDHPTR:
+        case OP_LIVT: case OP_STIMER:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/* The EPT code bits are shared by all vCPUs of a VM, so a flush drops every
+   vCPU's decoded blocks and the code page list kept on the boot vCPU */
+void block_cache_flush(guest_vm_t* guest) {
+    guest_vm_t* vm = guest->vm;
+    for (uint32_t v = 0; v < vm->nr_vcpus; v++) {
+        for (uint32_t i = 0; i < BLOCK_CACHE_SIZE; i++) {
+            vm->vcpus[v]->block_cache[i].valid = false;
+        }
+    }
+    for (uint32_t i = 0; i < vm->nr_code_pages; i++) {
+        vm->ept[vm->code_page_list[i]].code = false;
+    }
+    vm->nr_code_pages = 0;
+}
+
+/* Trap bit that decides whether a sensitive opcode exits (0 = never
+   sensitive). HYPERCALL and IPI ask the hypervisor for a service, so they
+   always exit. */
+static uint32_t opcode_trap_bit(uint8_t opcode) {
+    switch (opcode) {
+        case OP_SYSCALL: case OP_VMENTER: case OP_VMRESUME:
+            return VMTRAPCFG_PRIVILEGED_INSTR;
+        case OP_VMTRAPCFG: case OP_LDPGTR: case OP_LDHPTR: case OP_LIVT:
+            return VMTRAPCFG_CR_WRITE;
+        default:
+            return 0;
+    }
+}
+
+typedef char block_exits_fit[(MAX_BLOCK_INSTRUCTIONS <= 32) ? 1 : -1];
+
+/* Mark a guest physical page as holding decoded code so stores into it flush
+   the block cache */
+static void block_mark_code_page(guest_vm_t* guest, uint32_t page) {
+    guest_vm_t* vm = guest->vm;
+    if (vm->ept[page].code) return;
+    if (vm->nr_code_pages == BLOCK_CACHE_SIZE) block_cache_flush(vm);
+    vm->ept[page].code = true;
+    vm->code_page_list[vm->nr_code_pages++] = page;
+}
+
+/* A block may skip operand checks if it was decoded from aligned slots of the
+   code section on a verified page. A page written since it was verified is
+   checked again here, on the first decode after the write. */
+static bool block_code_verified(guest_vm_t* guest, uint32_t pc, uint32_t guest_phys_addr, uint32_t end) {
+    guest_vm_t* vm = guest->vm;
+    if (pc % INSTRUCTION_SIZE != 0 || end > vm->code_size) return false;
+    ept_entry_t* entry = &vm->ept[guest_phys_addr / PAGE_SIZE];
+    if (entry->reverify) guest_verify_page(vm, guest_phys_addr / PAGE_SIZE, false);
+    return entry->verified;
+}
+
+/* Decode the basic block starting at pc into its cache slot. Returns NULL on
+   a fetch fault. */
+static decoded_block_t* block_decode(guest_vm_t* guest, decoded_block_t* block, uint32_t pc) {
+    block->valid = false;
+    block->start_pc = pc;
+    block->length = 0;
+    block->exits = 0;
+
+    uint32_t page = pc / PAGE_SIZE;
+    uint32_t first_phys_addr = 0, end_phys_addr = 0;
+    while (block->length < MAX_BLOCK_INSTRUCTIONS) {
+        uint32_t guest_virt_addr = pc + block->length * INSTRUCTION_SIZE;
+        if (block->length > 0 && guest_virt_addr / PAGE_SIZE != page) {
+            break;  /* Blocks never span guest pages */
+        }
+
+        /* Device and granted memory is never executable */
+        uint32_t guest_phys_addr = guest_translate_address(guest, guest_virt_addr);
+        if (guest_phys_addr == 0xFFFFFFFF ||
+            guest_phys_addr + INSTRUCTION_SIZE > guest->memory_size ||
+            guest->ept[guest_phys_addr / PAGE_SIZE].mmio || guest->ept[guest_phys_addr / PAGE_SIZE].grant) {
+            if (block->length == 0) return NULL;
+            break;
+        }
+
+        if (block->length == 0) first_phys_addr = guest_phys_addr;
+        end_phys_addr = guest_phys_addr + INSTRUCTION_SIZE;
+
+        instruction_t* instr = &block->instrs[block->length++];
+        instr->opcode = guest_read8(guest, guest_phys_addr);
+        instr->rd = guest_read8(guest, guest_phys_addr + 1);
+        instr->rs1 = guest_read8(guest, guest_phys_addr + 2);
+        instr->rs2 = guest_read8(guest, guest_phys_addr + 3);
+        block_mark_code_page(guest, guest_phys_addr / PAGE_SIZE);
+
+        /* The exit policy is compiled in: flipping a trap bit flushes the cache */
+        if (opcode_trap_bit(instr->opcode) & guest->vcpu.vmcs.trap_config) {
+            block->exits |= 1u << (block->length - 1);
+        }
+
+        if (opcode_ends_block(instr->opcode)) break;
+    }
+
+    block->verified = block_code_verified(guest, pc, first_phys_addr, end_phys_addr);
+    block->valid = true;
+    return block;
+}
+
+/* Misses are charged to translation when counters are on; hits stay in dispatch */
+static decoded_block_t* block_lookup(hypervisor_t* hv, guest_vm_t* guest, uint32_t pc) {
+    decoded_block_t* block = &guest->block_cache[(pc / INSTRUCTION_SIZE) % BLOCK_CACHE_SIZE];
+    if (block->valid && block->start_pc == pc) {
+        return block;
+    }
+    if (!hv->perf) return block_decode(guest, block, pc);
+
+    perf_switch(hv->perf, guest->vm_id, PERF_PHASE_TRANSLATE);
+    block = block_decode(guest, block, pc);
+    perf_switch(hv->perf, guest->vm_id, PERF_PHASE_DISPATCH);
+    return block;
+}
 
 /* ============ VIRTUALIZATION ISA INSTRUCTION IMPLEMENTATIONS ============ */
 
+/* Returns true if the policy changed, which drops every decoded block */
+static bool vcpu_set_trap_config(guest_vm_t* guest, uint32_t trap_config) {
+    if (guest->vcpu.vmcs.trap_config == trap_config) return false;
+    guest->vcpu.vmcs.trap_config = trap_config;
+    block_cache_flush(guest);
+    return true;
+}
+
 /* VMENTER vmcs_ptr - Enter guest mode and start execution */
 void isa_vmenter(hypervisor_t* hv, vmcs_t* vmcs) {
     if (!vmcs) {
-        fprintf(stderr, "[ISA:VMENTER] Invalid VMCS pointer\n");
+        hypervisor_log(hv, VISA_LOG_ERROR, "[ISA:VMENTER] Invalid VMCS pointer\n");
         return;
     }
 
@@ -21,7 +164,7 @@ void isa_vmenter(hypervisor_t* hv, vmcs_t* vmcs) {
     }
 
     if (!guest) {
-        fprintf(stderr, "[ISA:VMENTER] VMCS not associated with any guest\n");
+        hypervisor_log(hv, VISA_LOG_ERROR, "[ISA:VMENTER] VMCS not associated with any guest\n");
         return;
     }
 
@@ -43,14 +186,14 @@ void isa_vmenter(hypervisor_t* hv, vmcs_t* vmcs) {
     guest->vcpu.state = GUEST_RUNNING;
     hv->current_guest_id = guest->vm_id;
 
-    printf("[ISA:VMENTER] Entered Guest VM %u (PC=0x%X, Trap Config=0x%X)\n", 
-           guest->vm_id, guest->vcpu.pc, vmcs->trap_config);
+    hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:VMENTER] Entered Guest VM %u (PC=0x%X, Trap Config=0x%X)\n",
+                   guest->vm_id, guest->vcpu.pc, vmcs->trap_config);
 }
 
 /* VMRESUME vmcs_ptr - Resume guest after handling VMEXIT */
 void isa_vmresume(hypervisor_t* hv, vmcs_t* vmcs) {
     if (!vmcs) {
-        fprintf(stderr, "[ISA:VMRESUME] Invalid VMCS pointer\n");
+        hypervisor_log(hv, VISA_LOG_ERROR, "[ISA:VMRESUME] Invalid VMCS pointer\n");
         return;
     }
 
@@ -63,7 +206,7 @@ void isa_vmresume(hypervisor_t* hv, vmcs_t* vmcs) {
     }
 
     if (!guest) {
-        fprintf(stderr, "[ISA:VMRESUME] VMCS not associated with any guest\n");
+        hypervisor_log(hv, VISA_LOG_ERROR, "[ISA:VMRESUME] VMCS not associated with any guest\n");
         return;
     }
 
@@ -77,19 +220,18 @@ void isa_vmresume(hypervisor_t* hv, vmcs_t* vmcs) {
     hv->mode = MODE_GUEST;
     guest->vcpu.state = GUEST_RUNNING;
 
-    printf("[ISA:VMRESUME] Resumed Guest VM %u (PC=0x%X)\n", 
-           guest->vm_id, guest->vcpu.pc);
+    hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:VMRESUME] Resumed Guest VM %u (PC=0x%X)\n",
+                   guest->vm_id, guest->vcpu.pc);
 }
 
 /* VMCAUSE rd - Read exit cause */
 uint32_t isa_vmcause(hypervisor_t* hv) {
     if (hv->mode == MODE_HOST && hv->current_guest_id < hv->guest_count) {
         guest_vm_t* guest = &hv->guests[hv->current_guest_id];
-        printf("[ISA:VMCAUSE] Exit cause: 0x%X (%s)\n", 
-               guest->vcpu.last_exit_cause,
-               guest->vcpu.last_exit_cause == VMCAUSE_PRIVILEGED_INSTRUCTION ? "Privileged Instruction" :
-               guest->vcpu.last_exit_cause == VMCAUSE_IO_INSTRUCTION ? "I/O Instruction" :
-               guest->vcpu.last_exit_cause == VMCAUSE_PAGE_FAULT ? "Page Fault" : "Unknown");
+        hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:VMCAUSE] Exit cause: 0x%X (%s)\n", guest->vcpu.last_exit_cause,
+                       guest->vcpu.last_exit_cause == VMCAUSE_PRIVILEGED_INSTRUCTION ? "Privileged Instruction" :
+                       guest->vcpu.last_exit_cause == VMCAUSE_IO_INSTRUCTION ? "I/O Instruction" :
+                       guest->vcpu.last_exit_cause == VMCAUSE_PAGE_FAULT ? "Page Fault" : "Unknown");
         return guest->vcpu.last_exit_cause;
     }
     return VMCAUSE_NONE;
@@ -99,17 +241,17 @@ uint32_t isa_vmcause(hypervisor_t* hv) {
 void isa_vmtrapcfg(hypervisor_t* hv, uint32_t trap_config) {
     if (hv->mode == MODE_HOST && hv->current_guest_id < hv->guest_count) {
         guest_vm_t* guest = &hv->guests[hv->current_guest_id];
-        guest->vcpu.vmcs.trap_config = trap_config;
+        vcpu_set_trap_config(guest, trap_config);
         
-        printf("[ISA:VMTRAPCFG] Trap config set to 0x%X\n", trap_config);
-        printf("  - Trap privileged instructions: %s\n", 
-               (trap_config & VMTRAPCFG_PRIVILEGED_INSTR) ? "YES" : "NO");
-        printf("  - Trap CR writes: %s\n", 
-               (trap_config & VMTRAPCFG_CR_WRITE) ? "YES" : "NO");
-        printf("  - Trap I/O instructions: %s\n", 
-               (trap_config & VMTRAPCFG_IO_INSTR) ? "YES" : "NO");
-        printf("  - Trap page faults: %s\n", 
-               (trap_config & VMTRAPCFG_PAGE_FAULT) ? "YES" : "NO");
+        hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:VMTRAPCFG] Trap config set to 0x%X\n", trap_config);
+        hypervisor_log(hv, VISA_LOG_DEBUG, "  - Trap privileged instructions: %s\n",
+                       (trap_config & VMTRAPCFG_PRIVILEGED_INSTR) ? "YES" : "NO");
+        hypervisor_log(hv, VISA_LOG_DEBUG, "  - Trap CR writes: %s\n",
+                       (trap_config & VMTRAPCFG_CR_WRITE) ? "YES" : "NO");
+        hypervisor_log(hv, VISA_LOG_DEBUG, "  - Trap I/O instructions: %s\n",
+                       (trap_config & VMTRAPCFG_IO_INSTR) ? "YES" : "NO");
+        hypervisor_log(hv, VISA_LOG_DEBUG, "  - Trap page faults: %s\n",
+                       (trap_config & VMTRAPCFG_PAGE_FAULT) ? "YES" : "NO");
     }
 }
 
@@ -119,8 +261,8 @@ void isa_ldpgtr(hypervisor_t* hv, uint32_t guest_pgtbl) {
         guest_vm_t* guest = &hv->guests[hv->current_guest_id];
         guest->vcpu.guest_pgtbl_root = guest_pgtbl;
         guest->vcpu.vmcs.guest_pgtbl_root = guest_pgtbl;
-        printf("[ISA:LDPGTR] Guest page table root set to 0x%X (PID %u)\n", 
-               guest_pgtbl, guest->vm_id);
+        hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:LDPGTR] Guest page table root set to 0x%X (PID %u)\n",
+                       guest_pgtbl, guest->vm_id);
     }
 }
 
@@ -130,8 +272,8 @@ void isa_ldhptr(hypervisor_t* hv, uint32_t host_pgtbl) {
         guest_vm_t* guest = &hv->guests[hv->current_guest_id];
         guest->vcpu.host_pgtbl_root = host_pgtbl;
         guest->vcpu.vmcs.host_pgtbl_root = host_pgtbl;
-        printf("[ISA:LDHPTR] Host page table root set to 0x%X (Guest %u)\n", 
-               host_pgtbl, guest->vm_id);
+        hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:LDHPTR] Host page table root set to 0x%X (Guest %u)\n",
+                       host_pgtbl, guest->vm_id);
     }
 }
 
@@ -141,103 +283,387 @@ void isa_tlbflushv(hypervisor_t* hv) {
         guest_vm_t* guest = &hv->guests[hv->current_guest_id];
         guest->vcpu.tlb_valid = false;
         guest->vcpu.tlb_entries = 0;
-        printf("[ISA:TLBFLUSHV] Guest TLB flushed (Guest %u)\n", guest->vm_id);
+        block_cache_flush(guest);
+        hypervisor_log(hv, VISA_LOG_DEBUG, "[ISA:TLBFLUSHV] Guest TLB flushed (Guest %u)\n", guest->vm_id);
     }
 }
 
 /* ============ HYPERVISOR INITIALIZATION ============ */
 hypervisor_t* hypervisor_create(void) {
+    return hypervisor_create_with(NULL);
+}
+
+hypervisor_t* hypervisor_create_with(const visa_config_t* config) {
     hypervisor_t* hv = (hypervisor_t*)malloc(sizeof(hypervisor_t));
     if (!hv) return NULL;
 
+    if (!scheduler_init(&hv->scheduler, SCHED_POLICY_ROUND_ROBIN, MAX_GUESTS)) {
+        free(hv);
+        return NULL;
+    }
+    if (!waitq_init(&hv->waitq, MAX_GUESTS)) {
+        scheduler_destroy(&hv->scheduler);
+        free(hv);
+        return NULL;
+    }
+
     memset(hv->host_memory, 0, sizeof(hv->host_memory));
     memset(hv->guests, 0, sizeof(hv->guests));
+    for (uint32_t i = 0; i < MAX_GUESTS; i++) {
+        pthread_mutex_init(&hv->guests[i].mem_lock, NULL);
+        hv->guests[i].hv = hv;
+    }
+    placement_init(&hv->placement);
+    hv->ksm = NULL;
+    hv->compress = NULL;
+    hv->perf = NULL;
+    hv->replay = NULL;
+    hv->console = NULL;
+    hv->iopool = NULL;
     hv->mode = MODE_HOST;
     hv->current_guest_id = 0;
     hv->guest_count = 0;
     hv->tick_count = 0;
     hv->halted = false;
-
-    printf("[HYPERVISOR] Initialized (Host Memory: %u KB, Max Guests: %u)\n", 
-           MEMORY_SIZE / 1024, MAX_GUESTS);
+    hv->spmd = false;
+    hv->trace = false;
+    hv->verify = true;
+    hv->stdio = config == NULL;
+    memset(&hv->config, 0, sizeof(hv->config));
+    if (config) hv->config = *config;
+    hv->last_error[0] = '\0';
+
+    hypervisor_log(hv, VISA_LOG_INFO, "[HYPERVISOR] Initialized (Host Memory: %u KB, Max Guests: %u)\n",
+                   MEMORY_SIZE / 1024, MAX_GUESTS);
     return hv;
 }
 
 void hypervisor_destroy(hypervisor_t* hv) {
-    if (hv) free(hv);
+    if (!hv) return;
+    hypervisor_record_stop(hv);
+    hypervisor_console_stop(hv);
+    hypervisor_iopool_stop(hv);
+    hypervisor_ksm_stop(hv);
+    hypervisor_compress_stop(hv);
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* guest = &hv->guests[i];
+        free(guest->symbols);
+        fiber_destroy(guest->fiber);
+        if (guest->vm != guest) continue;
+        if (guest->disk_fd >= 0) close(guest->disk_fd);
+        mmio_map_destroy(guest->mmio);
+        free(guest->grants);
+        guest_memory_destroy(guest);
+    }
+    for (uint32_t i = 0; i < MAX_GUESTS; i++) {
+        pthread_mutex_destroy(&hv->guests[i].mem_lock);
+    }
+    ksm_destroy(hv->ksm);
+    compress_destroy(hv->compress);
+    perf_destroy(hv->perf);
+    console_destroy(hv->console);
+    iopool_destroy(hv->iopool);
+    waitq_destroy(&hv->waitq);
+    scheduler_destroy(&hv->scheduler);
+    free(hv);
 }
 
 /* ============ GUEST VM CREATION ============ */
+static bool read_image_file(const char* path, uint8_t** buf, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long length = ok ? ftell(file) : -1;
+    ok = length >= 0 && fseek(file, 0, SEEK_SET) == 0;
+
+    *buf = ok ? malloc((size_t)length + 1) : NULL;
+    if (*buf && fread(*buf, 1, (size_t)length, file) == (size_t)length) {
+        (*buf)[length] = '\0';  /* Assembly source is parsed as a C string */
+        *size = (size_t)length;
+    } else {
+        free(*buf);
+        *buf = NULL;
+    }
+    fclose(file);
+    return *buf != NULL;
+}
+
+static bool has_extension(const char* path, const char* ext) {
+    size_t len = strlen(path), ext_len = strlen(ext);
+    return len >= ext_len && strcmp(path + len - ext_len, ext) == 0;
+}
+
 uint32_t hypervisor_create_guest(hypervisor_t* hv, const char* guest_image) {
+    return hypervisor_create_guest_sized(hv, guest_image, GUEST_PHYS_MEMORY_SIZE);
+}
+
+uint32_t hypervisor_create_guest_sized(hypervisor_t* hv, const char* guest_image, uint32_t memory_size) {
+    visa_status_t status;
+    return hypervisor_load_guest_file(hv, guest_image, memory_size, &status);
+}
+
+uint32_t hypervisor_load_guest_file(hypervisor_t* hv, const char* path, uint32_t memory_size,
+                                    visa_status_t* status) {
+    uint8_t* buf;
+    size_t size;
+    if (!read_image_file(path, &buf, &size)) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Failed to load guest image: %s\n", path);
+        *status = VISA_ERR_IO;
+        return 0;
+    }
+
+    uint32_t result = hypervisor_load_guest_buffer(hv, path, buf, size, has_extension(path, ".isa"),
+                                                   memory_size, status);
+    free(buf);
+    return result;
+}
+
+uint32_t hypervisor_load_guest_buffer(hypervisor_t* hv, const char* name, const uint8_t* buf, size_t size,
+                                      bool source, uint32_t memory_size, visa_status_t* status) {
+    vobj_image_t image;
+    char error[128];
+    bool ok = true;
+
+    if (source) {
+        ok = visa_assemble((const char*)buf, &image, error, sizeof(error));
+    } else if (vobj_is_object(buf, size)) {
+        ok = vobj_decode(buf, size, &image, error, sizeof(error));
+    } else {
+        /* Raw binary: one flat section loaded at address 0 */
+        memset(&image, 0, sizeof(image));
+        image.code = buf;
+        image.code_size = (uint32_t)size;
+        image.content_hash = hypervisor_hash_bytes(buf, size);
+        if (size == 0 || size > GUEST_MAX_MEMORY_SIZE) {
+            snprintf(error, sizeof(error), size == 0 ? "image is empty" : "image too large");
+            ok = false;
+        }
+    }
+
+    uint32_t result = 0;
+    if (!ok) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] %s: %s\n", name, error);
+        *status = VISA_ERR_IMAGE;
+    } else {
+        result = hypervisor_create_guest_from_object(hv, &image, memory_size);
+        if (result) {
+            *status = VISA_OK;
+        } else if (hv->guest_count >= MAX_GUESTS) {
+            *status = VISA_ERR_LIMIT;
+        } else if (image.code_size == 0 ||
+                   vobj_memory_size(&image) > (memory_size ? memory_size : GUEST_PHYS_MEMORY_SIZE)) {
+            *status = VISA_ERR_IMAGE;
+        } else {
+            *status = VISA_ERR_NO_MEMORY;
+        }
+    }
+    vobj_free(&image);
+    return result;
+}
+
+uint32_t hypervisor_create_guest_from_object(hypervisor_t* hv, const vobj_image_t* image,
+                                             uint32_t memory_size) {
     if (hv->guest_count >= MAX_GUESTS) {
-        fprintf(stderr, "[HYPERVISOR] Maximum guests reached\n");
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Maximum guests reached\n");
+        return 0;
+    }
+    if (memory_size == 0) memory_size = GUEST_PHYS_MEMORY_SIZE;
+    if (image->code_size == 0 || vobj_memory_size(image) > memory_size) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Guest image does not fit in %u bytes of guest memory\n",
+                       memory_size);
         return 0;
     }
 
-    uint32_t guest_id = hv->guest_count++;
-    guest_vm_t* guest = &hv->guests[guest_id];
+    vobj_symbol_t* symbols = NULL;
+    if (image->symbol_count > 0) {
+        symbols = malloc(image->symbol_count * sizeof(vobj_symbol_t));
+        if (!symbols) return 0;
+        memcpy(symbols, image->symbols, image->symbol_count * sizeof(vobj_symbol_t));
+    }
+
+    guest_vm_t* guest = &hv->guests[hv->guest_count];
+    guest_vcpu_attach(guest, guest);
+    /* Hold the memory lock until the image is loaded: the KSM scanner may see
+       the guest as soon as guest_count is bumped */
+    pthread_mutex_lock(&guest->mem_lock);
+    if (!guest_memory_init(guest, memory_size)) {
+        pthread_mutex_unlock(&guest->mem_lock);
+        free(symbols);
+        return 0;
+    }
+
+    /* Bind RAM to the home node before the image load first-touches it */
+    guest->home_node = hypervisor_next_home_node(hv);
+    placement_bind_memory(hv, guest->memory_base, guest->memory_size,
+                          guest->home_node, hv->placement.huge_pages);
+
+    uint32_t guest_id = __atomic_fetch_add(&hv->guest_count, 1, __ATOMIC_RELEASE);
 
     guest->vm_id = guest_id;
     guest->state = GUEST_STOPPED;
     guest->instruction_count = 0;
+    guest->steps = 0;
+    guest->quantum_instructions = DEFAULT_TIME_QUANTUM;
+    guest->quantum_ns = 0;
+    guest->sched.weight = SCHED_DEFAULT_WEIGHT;
+    guest->sched.queue_index = -1;
+    guest->wait.timer_index = -1;
 
     /* Initialize vCPU */
     guest->vcpu.guest_id = guest_id;
     guest->vcpu.state = GUEST_STOPPED;
     memset(guest->vcpu.registers, 0, sizeof(guest->vcpu.registers));
-    guest->vcpu.pc = 0;
-    guest->vcpu.sp = GUEST_PHYS_MEMORY_SIZE - 1;
+    guest->vcpu.pc = image->entry;
+    guest->vcpu.sp = guest->memory_size - 1;
     guest->vcpu.priv = PRIV_USER;
+    guest->vcpu.ivt_base = 0;         /* No in-guest interrupts until LIVT */
+    guest->vcpu.irq_pending = 0;
+    guest->vcpu.irq_masked = false;
+    guest->vcpu.timer_period = 0;
+    guest->vcpu.timer_ticks = 0;
+    memset(guest->vcpu.irq_delivered, 0, sizeof(guest->vcpu.irq_delivered));
+    memset(guest->vcpu.trap_inline, 0, sizeof(guest->vcpu.trap_inline));
+    memset(guest->vcpu.trap_exits, 0, sizeof(guest->vcpu.trap_exits));
+    guest->vcpu.trap_acked = false;
 
     /* Initialize VMCS */
     guest->vcpu.vmcs.vmcs_id = guest_id;
     guest->vcpu.vmcs.exit_cause = VMCAUSE_NONE;
-    guest->vcpu.vmcs.trap_config = 0;  /* No traps by default */
-
-    /* Initialize guest memory */
-    memset(guest->guest_memory, 0, sizeof(guest->guest_memory));
-    memset(guest->ept, 0, sizeof(guest->ept));
+    guest->vcpu.vmcs.trap_config = VMTRAPCFG_DEFAULT;
+    guest->vcpu.vmcs.guest_pc = image->entry;
 
-    /* Initialize guest page table to map VA→PA identity */
-    memset(guest->vcpu.guest_page_table, 0, sizeof(guest->vcpu.guest_page_table));
-    uint32_t max_pages = GUEST_PHYS_MEMORY_SIZE / PAGE_SIZE;
-    for (uint32_t i = 0; i < max_pages; i++) {
-        guest->vcpu.guest_page_table[i].present = 1;
-        guest->vcpu.guest_page_table[i].guest_physical_page = i;
-        guest->vcpu.guest_page_table[i].accessed = 0;
-    }
+    /* Guest memory and the identity VA→PA page table come from guest_memory_init */
+    block_cache_flush(guest);
     guest->vcpu.guest_pgtbl_root = 0;  /* Page table at VA 0 */
     guest->vcpu.host_pgtbl_root = 0;   /* Direct host mapping */
     guest->vcpu.tlb_valid = true;
 
-    /* Load guest image */
-    FILE* file = fopen(guest_image, "rb");
-    if (!file) {
-        fprintf(stderr, "[HYPERVISOR] Failed to load guest image: %s\n", guest_image);
-        return 0;
-    }
-
-    size_t bytes_read = fread(guest->guest_memory, 1, GUEST_PHYS_MEMORY_SIZE, file);
-    fclose(file);
-
-    if (bytes_read == 0) {
-        fprintf(stderr, "[HYPERVISOR] Guest image is empty\n");
-        return 0;
+    /* Map sections at their load addresses; bss stays on the shared zero page
+       until the guest writes it */
+    uint32_t data_base = vobj_data_base(image);
+    guest_memory_write(guest, 0, image->code, image->code_size);
+    if (image->data_size) guest_memory_write(guest, data_base, image->data, image->data_size);
+    guest->code_size = image->code_size;
+    guest->spmd_ejected = false;
+    guest->verify = hv->verify;
+    guest_verify_image(guest);
+    pthread_mutex_unlock(&guest->mem_lock);
+
+    free(guest->symbols);
+    guest->symbols = symbols;
+    guest->symbol_count = image->symbol_count;
+    guest->image_size = image->data_size ? data_base + image->data_size : image->code_size;
+    guest->image_hash = image->content_hash;
+
+    if (guest->memory_size != GUEST_PHYS_MEMORY_SIZE) {
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[HYPERVISOR] Created Guest VM %u (loaded %u bytes, %u KB memory, %u KB resident)\n", guest_id,
+                       guest->image_size, guest->memory_size / 1024, guest->resident_pages * (PAGE_SIZE / 1024));
+    } else if (image->data_size || image->bss_size || image->symbol_count) {
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[HYPERVISOR] Created Guest VM %u (code %u, data %u, bss %u bytes, entry 0x%X)\n", guest_id,
+                       image->code_size, image->data_size, image->bss_size, image->entry);
+    } else {
+        hypervisor_log(hv, VISA_LOG_INFO, "[HYPERVISOR] Created Guest VM %u (loaded %u bytes)\n", guest_id,
+                       image->code_size);
     }
-
-    printf("[HYPERVISOR] Created Guest VM %u (loaded %zu bytes)\n", guest_id, bytes_read);
     
-    /* Start guest in RUNNING state for scheduler */
+    /* Start guest in RUNNING state and make it runnable for the scheduler */
     guest->vcpu.state = GUEST_RUNNING;
+    scheduler_enqueue(&hv->scheduler, guest);
     
     return guest_id + 1;  /* Return 1-based ID */
 }
 
+/* ============ SMP GUESTS ============ */
+
+/* Make `vcpu` a vCPU of `vm`, sharing its physical memory, EPT and page
+   table. Attaching a guest to itself makes it the boot vCPU of a new VM. */
+void guest_vcpu_attach(guest_vm_t* vm, guest_vm_t* vcpu) {
+    vcpu->vm = vm;
+    vcpu->fiber = NULL;
+    if (vm == vcpu) {
+        vm->nr_vcpus = 0;
+        vm->disk_fd = -1;
+        vm->mmio = NULL;
+        vm->grants = NULL;
+    } else {
+        vcpu->memory_base = vm->memory_base;
+        vcpu->memory_size = vm->memory_size;
+        vcpu->ept = vm->ept;
+        vcpu->vcpu.guest_page_table = vm->vcpu.guest_page_table;
+        vcpu->vcpu.guest_page_count = vm->vcpu.guest_page_count;
+        vcpu->home_node = vm->home_node;
+        vcpu->image_hash = vm->image_hash;
+        vcpu->image_size = vm->image_size;
+        vcpu->code_size = vm->code_size;
+        vcpu->nr_vcpus = 0;
+    }
+    vcpu->vcpu_index = vm->nr_vcpus;
+    vcpu->ipi_pending = 0;
+    vcpu->last_run_ns = hypervisor_time_ns();
+    vm->vcpus[vm->nr_vcpus++] = vcpu;
+}
+
+bool hypervisor_set_vcpus(hypervisor_t* hv, uint32_t guest_id, uint32_t nr_vcpus) {
+    if (guest_id == 0 || guest_id > hv->guest_count) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
+        return false;
+    }
+
+    guest_vm_t* vm = &hv->guests[guest_id - 1];
+    if (vm->vm != vm || vm->instruction_count != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[SMP] vCPUs can only be added to a VM before it runs\n");
+        return false;
+    }
+    if (nr_vcpus == 0 || nr_vcpus > MAX_VCPUS || hv->guest_count + nr_vcpus - vm->nr_vcpus > MAX_GUESTS) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[SMP] Cannot give Guest VM %u %u vCPUs (max %u per VM, %u in total)\n",
+                       vm->vm_id, nr_vcpus, MAX_VCPUS, MAX_GUESTS);
+        return false;
+    }
+
+    while (vm->nr_vcpus < nr_vcpus) {
+        guest_vm_t* guest = &hv->guests[hv->guest_count];
+        free(guest->symbols);
+        guest->symbols = NULL;
+        guest->symbol_count = 0;
+        guest_vcpu_attach(vm, guest);
+
+        uint32_t slot = __atomic_fetch_add(&hv->guest_count, 1, __ATOMIC_RELEASE);
+        guest->vm_id = slot;
+        guest->state = GUEST_STOPPED;
+        guest->instruction_count = 0;
+        guest->steps = 0;
+        guest->quantum_instructions = vm->quantum_instructions;
+        guest->quantum_ns = vm->quantum_ns;
+        guest->sched.weight = vm->sched.weight;
+        guest->sched.queue_index = -1;
+        guest->wait.timer_index = -1;
+
+        /* Same entry state as the boot vCPU; HYPERCALL_VCPU_ID tells them apart */
+        guest->vcpu = vm->vcpu;
+        guest->vcpu.guest_id = slot;
+        guest->vcpu.vmcs.vmcs_id = slot;
+        guest->vcpu.last_exit_cause = VMCAUSE_NONE;
+        for (uint32_t i = 0; i < BLOCK_CACHE_SIZE; i++) guest->block_cache[i].valid = false;
+
+        guest->vcpu.state = GUEST_RUNNING;
+        scheduler_enqueue(&hv->scheduler, guest);
+    }
+
+    log_line_t line = {0};
+    log_append(&line, "[SMP] Guest VM %u has %u vCPUs (slots", vm->vm_id, vm->nr_vcpus);
+    for (uint32_t v = 0; v < vm->nr_vcpus; v++) log_append(&line, " %u", vm->vcpus[v]->vm_id);
+    hypervisor_log(hv, VISA_LOG_INFO, "%s)\n", line.text);
+    return true;
+}
+
 /* ============ GUEST MEMORY TRANSLATION ============ */
 uint32_t guest_translate_address(guest_vm_t* guest, uint32_t guest_virt_addr) {
-    if (guest_virt_addr >= GUEST_VIRT_MEMORY_SIZE) {
-        fprintf(stderr, "[GUEST %u] Virtual address 0x%X out of bounds\n", 
-                guest->vm_id, guest_virt_addr);
+    if (guest_virt_addr >= guest->vcpu.guest_page_count * PAGE_SIZE) {
+        hypervisor_log(guest->hv, VISA_LOG_ERROR, "[GUEST %u] Virtual address 0x%X out of bounds\n",
+                       guest->vm_id, guest_virt_addr);
         return 0xFFFFFFFF;
     }
 
@@ -247,13 +673,18 @@ uint32_t guest_translate_address(guest_vm_t* guest, uint32_t guest_virt_addr) {
     guest_page_table_entry_t* pte = &guest->vcpu.guest_page_table[page_num];
 
     if (!pte->present) {
-        fprintf(stderr, "[GUEST %u] Page fault at virt 0x%X (page %u not present)\n", 
-                guest->vm_id, guest_virt_addr, page_num);
+        hypervisor_log(guest->hv, VISA_LOG_ERROR, "[GUEST %u] Page fault at virt 0x%X (page %u not present)\n",
+                       guest->vm_id, guest_virt_addr, page_num);
         return 0xFFFFFFFF;
     }
 
     pte->accessed = true;
     uint32_t guest_phys_addr = (pte->guest_physical_page * PAGE_SIZE) + offset;
+    if (guest_phys_addr >= guest->memory_size) {
+        hypervisor_log(guest->hv, VISA_LOG_ERROR, "[GUEST %u] Physical address 0x%X beyond guest memory\n",
+                       guest->vm_id, guest_phys_addr);
+        return 0xFFFFFFFF;
+    }
 
     return guest_phys_addr;
 }
@@ -263,308 +694,789 @@ uint32_t host_translate_address(hypervisor_t* hv __attribute__((unused)), uint32
 }
 
 /* ============ GUEST EXECUTION ============ */
-void hypervisor_run_guest(hypervisor_t* hv, uint32_t guest_id) {
+uint64_t hypervisor_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t hypervisor_hash_bytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+void hypervisor_set_quantum(hypervisor_t* hv, uint32_t guest_id,
+                            uint32_t instructions, uint64_t nanoseconds) {
     if (guest_id == 0 || guest_id > hv->guest_count) {
-        fprintf(stderr, "[HYPERVISOR] Invalid guest ID\n");
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
         return;
     }
 
     guest_vm_t* guest = &hv->guests[guest_id - 1];
+    guest->quantum_instructions = instructions;
+    guest->quantum_ns = nanoseconds;
+}
 
-    printf("\n[HYPERVISOR] Starting Guest VM %u\n", guest->vm_id);
-    printf("=========================================\n\n");
+void hypervisor_set_trap_config(hypervisor_t* hv, uint32_t guest_id, uint32_t trap_config) {
+    if (guest_id == 0 || guest_id > hv->guest_count) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
+        return;
+    }
 
-    /* Use ISA instruction to enter guest */
-    isa_vmenter(hv, &guest->vcpu.vmcs);
+    guest_vm_t* guest = &hv->guests[guest_id - 1];
+    pthread_mutex_lock(&guest->vm->mem_lock);
+    vcpu_set_trap_config(guest, trap_config);
+    pthread_mutex_unlock(&guest->vm->mem_lock);
+}
 
-    const int TIME_SLICE = 10000;
-    int total_instructions = 0;
+/* Record a VMEXIT: save guest state into the VMCS and return to host mode */
+static void vm_exit(hypervisor_t* hv, guest_vm_t* guest, vmcause_t cause, uint32_t qualification) {
+    vmcs_t* vmcs = &guest->vcpu.vmcs;
 
-    while (guest->vcpu.state == GUEST_RUNNING) {
-        /* Execute guest time slice */
-        for (int i = 0; i < TIME_SLICE && guest->vcpu.state == GUEST_RUNNING; i++) {
-            uint32_t guest_virt_addr = guest->vcpu.pc;
-            uint32_t guest_phys_addr = guest_translate_address(guest, guest_virt_addr);
+    vmcs->guest_rax = guest->vcpu.registers[0];
+    vmcs->guest_rbx = guest->vcpu.registers[1];
+    vmcs->guest_rcx = guest->vcpu.registers[2];
+    vmcs->guest_rdx = guest->vcpu.registers[3];
+    vmcs->guest_pc = guest->vcpu.pc;
+    vmcs->guest_priv = guest->vcpu.priv;
+    vmcs->exit_cause = cause;
+    vmcs->exit_qualification = qualification;
 
-            if (guest_phys_addr == 0xFFFFFFFF) {
-                hv->mode = MODE_HOST;
-                guest->vcpu.state = GUEST_BLOCKED;
-                guest->vcpu.last_exit_cause = VMCAUSE_PAGE_FAULT;
+    guest->vcpu.last_exit_cause = cause;
+    hv->mode = MODE_HOST;
+}
+
+/* Host word backing an aligned 32-bit guest word, made writable for an atomic
+   read-modify-write. NULL if the address is misaligned, unmapped, MMIO or a
+   read-only grant. */
+static uint32_t* guest_atomic_word(guest_vm_t* guest, uint32_t guest_virt_addr, uint32_t* guest_phys_addr) {
+    if (guest_virt_addr % 4 != 0) return NULL;
+    uint32_t addr = guest_translate_address(guest, guest_virt_addr);
+    if (addr == 0xFFFFFFFF || addr + 4 > guest->memory_size) return NULL;
+
+    ept_entry_t* entry = &guest->ept[addr / PAGE_SIZE];
+    if (entry->mmio || (entry->grant && !entry->writable)) return NULL;
+    uint8_t* host = entry->writable ? entry->host_page : guest_memory_fault(guest, addr / PAGE_SIZE);
+    *guest_phys_addr = addr;
+    return (uint32_t*)(host + addr % PAGE_SIZE);
+}
+
+/* ============ IN-GUEST INTERRUPTS ============ */
+/* Exceptions and timer ticks enter a guest handler without a VM exit. They
+   are raised while a block executes and delivered at the next block
+   boundary; the frame is two CALL-style words (return PC, then the info
+   word), so a handler finds the info word at SP+1..SP+4. */
+
+static uint32_t ivt_handler(guest_vm_t* guest, uint32_t vector) {
+    uint32_t handler = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        uint32_t addr = guest_translate_address(guest, guest->vcpu.ivt_base + vector * 4 + i);
+        if (addr == 0xFFFFFFFF) return 0;
+        handler = (handler << 8) | guest_read8(guest, addr);
+    }
+    return handler;
+}
+
+/* Queue `vector` if the guest can take it now. false means the event keeps
+   its old behaviour (ignored or a VM exit). */
+static bool guest_raise(guest_vm_t* guest, interrupt_type_t vector, uint32_t info) {
+    vcpu_t* vcpu = &guest->vcpu;
+    if (!vcpu->ivt_base || vcpu->irq_masked || vcpu->sp <= 7 || !ivt_handler(guest, vector)) {
+        return false;
+    }
+    vcpu->irq_pending |= 1u << vector;
+    vcpu->irq_info[vector] = info;
+    return true;
+}
+
+static void guest_push_word(guest_vm_t* guest, uint32_t value) {
+    vcpu_t* vcpu = &guest->vcpu;
+    guest_write8(guest, vcpu->sp - 3, (value >> 24) & 0xFF);
+    guest_write8(guest, vcpu->sp - 2, (value >> 16) & 0xFF);
+    guest_write8(guest, vcpu->sp - 1, (value >> 8) & 0xFF);
+    guest_write8(guest, vcpu->sp, value & 0xFF);
+    vcpu->sp -= 4;
+}
+
+/* Block boundary with something pending or a timer armed: raise a due tick,
+   then enter the handler of the lowest pending vector unless masked */
+static void guest_interrupt_check(guest_vm_t* guest) {
+    vcpu_t* vcpu = &guest->vcpu;
+
+    if (vcpu->timer_period && (int32_t)(guest->instruction_count - vcpu->timer_next) >= 0) {
+        vcpu->timer_next = guest->instruction_count + vcpu->timer_period;
+        vcpu->timer_ticks++;
+        if (vcpu->ivt_base) {
+            vcpu->irq_pending |= 1u << IRQ_TIMER;
+            vcpu->irq_info[IRQ_TIMER] = vcpu->timer_ticks;
+        }
+    }
+    if (!vcpu->irq_pending || vcpu->irq_masked) return;
+
+    uint32_t vector = (uint32_t)__builtin_ctz(vcpu->irq_pending);
+    vcpu->irq_pending &= ~(1u << vector);
+
+    /* The table or stack may have changed since the vector was raised */
+    uint32_t handler = vcpu->ivt_base ? ivt_handler(guest, vector) : 0;
+    if (!handler || vcpu->sp <= 7) return;
+
+    guest_push_word(guest, vcpu->pc);
+    guest_push_word(guest, vcpu->irq_info[vector]);
+    vcpu->pc = handler;
+    vcpu->irq_masked = true;
+    vcpu->irq_delivered[vector]++;
+}
+
+/* ============ EXIT POLICY ============ */
+/* A trapped event exits with PC at its instruction. When the hypervisor
+   resumes the guest, that instruction runs inline once (the exit has been
+   seen), so handlers need not emulate it. Only the rerun retires; both
+   attempts count as steps, which lets exact replays reach the exit.
+   Returns false for the rerun. */
+static bool trap_exit(hypervisor_t* hv, guest_vm_t* guest, uint32_t bit, vmcause_t cause,
+                      uint32_t qualification) {
+    vcpu_t* vcpu = &guest->vcpu;
+    uint32_t pc = vcpu->pc - INSTRUCTION_SIZE;
+    if (vcpu->trap_acked && vcpu->trap_acked_pc == pc) {
+        vcpu->trap_acked = false;
+        return false;
+    }
+
+    vcpu->trap_acked = true;
+    vcpu->trap_acked_pc = pc;
+    vcpu->trap_attempts++;
+    vcpu->trap_exits[__builtin_ctz(bit)]++;
+    vcpu->pc = pc;
+    vcpu->state = GUEST_BLOCKED;
+    vm_exit(hv, guest, cause, qualification);
+    return true;
+}
+
+/* Events only known at run time (device accesses, data faults) */
+static bool trap_check(hypervisor_t* hv, guest_vm_t* guest, uint32_t bit, vmcause_t cause,
+                       uint32_t qualification) {
+    if (guest->vcpu.vmcs.trap_config & bit) return trap_exit(hv, guest, bit, cause, qualification);
+    guest->vcpu.trap_inline[__builtin_ctz(bit)]++;
+    return false;
+}
+
+/* Operand checks a verified block has already passed at load time */
+#define REG_OK(r) (verified || (r) < REGISTER_COUNT)
+
+/* Execute up to `limit` instructions of a decoded block. Returns the number of
+   instructions retired; stops early if the guest leaves GUEST_RUNNING or
+   overwrites its own code. Inlined twice, so that with `verified` set the
+   compiler drops the operand checks; both copies behave the same on code
+   that passed verification. */
+static inline __attribute__((always_inline)) uint32_t
+execute_block_body(hypervisor_t* hv, guest_vm_t* guest, const decoded_block_t* block, uint32_t limit,
+                   const bool verified) {
+    vcpu_t* vcpu = &guest->vcpu;
+    uint32_t executed = 0;
+
+    while (executed < limit && vcpu->state == GUEST_RUNNING) {
+        instruction_t instr = block->instrs[executed++];
+
+        if (hv->trace) {
+            hypervisor_log(hv, VISA_LOG_DEBUG, "    [G%u:0x%02X] %s r%u r%u r%u\n", guest->vm_id, vcpu->pc,
+                           isa_opcode_name(instr.opcode), instr.rd, instr.rs1, instr.rs2);
+        }
+
+        vcpu->pc += INSTRUCTION_SIZE;
+
+        switch (instr.opcode) {
+            case OP_ADD:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] + vcpu->registers[instr.rs2];
+                }
                 break;
-            }
 
-            /* Fetch instruction */
-            instruction_t instr;
-            instr.opcode = guest->guest_memory[guest_phys_addr];
-            instr.rd = guest->guest_memory[guest_phys_addr + 1];
-            instr.rs1 = guest->guest_memory[guest_phys_addr + 2];
-            instr.rs2 = guest->guest_memory[guest_phys_addr + 3];
-
-            guest->vcpu.pc += INSTRUCTION_SIZE;
-
-            /* Execute instruction */
-            printf("[EXEC] PC=0x%02X  Op=0x%02X rd=%u rs1=%u rs2=%u\n", 
-                   guest->vcpu.pc - INSTRUCTION_SIZE, instr.opcode, instr.rd, instr.rs1, instr.rs2);
-
-            switch (instr.opcode) {
-                case OP_ADD:
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = 
-                            guest->vcpu.registers[instr.rs1] + guest->vcpu.registers[instr.rs2];
-                        printf("  ADD r%u = r%u(0x%X) + r%u(0x%X) = 0x%X\n", instr.rd, instr.rs1, 
-                               guest->vcpu.registers[instr.rs1], instr.rs2, guest->vcpu.registers[instr.rs2],
-                               guest->vcpu.registers[instr.rd]);
-                    }
-                    break;
+            case OP_SUB:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] - vcpu->registers[instr.rs2];
+                }
+                break;
 
-                case OP_SUB:
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = 
-                            guest->vcpu.registers[instr.rs1] - guest->vcpu.registers[instr.rs2];
-                    }
-                    break;
+            case OP_MUL:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] * vcpu->registers[instr.rs2];
+                }
+                break;
 
-                case OP_MUL:
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = 
-                            guest->vcpu.registers[instr.rs1] * guest->vcpu.registers[instr.rs2];
+            case OP_DIV:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    if (vcpu->registers[instr.rs2] != 0) {
+                        vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] / vcpu->registers[instr.rs2];
+                    } else if (guest_raise(guest, IRQ_DIVIDE_BY_ZERO, vcpu->pc - INSTRUCTION_SIZE)) {
+                        return executed;
                     }
-                    break;
+                }
+                break;
 
-                case OP_DIV:
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                        if (guest->vcpu.registers[instr.rs2] != 0) {
-                            guest->vcpu.registers[instr.rd] = 
-                                guest->vcpu.registers[instr.rs1] / guest->vcpu.registers[instr.rs2];
+            case OP_MOV:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1];
+                }
+                break;
+
+            case OP_LOAD:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1)) {
+                    uint32_t addr = guest_translate_address(guest, vcpu->registers[instr.rs1]);
+                    if (addr != 0xFFFFFFFF) {
+                        if (__builtin_expect(guest->ept[addr / PAGE_SIZE].mmio, 0) &&
+                            trap_check(hv, guest, VMTRAPCFG_IO_INSTR, VMCAUSE_IO_INSTRUCTION, addr)) {
+                            return executed;
                         }
+                        vcpu->registers[instr.rd] = guest_load8(hv, guest, addr);
+                    } else if (trap_check(hv, guest, VMTRAPCFG_PAGE_FAULT, VMCAUSE_PAGE_FAULT,
+                                          vcpu->registers[instr.rs1])) {
+                        return executed;
+                    } else if (guest_raise(guest, IRQ_PAGE_FAULT, vcpu->registers[instr.rs1])) {
+                        return executed;
                     }
-                    break;
+                }
+                break;
 
-                case OP_MOV:
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = guest->vcpu.registers[instr.rs1];
-                        printf("  MOV r%u = r%u (value 0x%X)\n", instr.rd, instr.rs1, guest->vcpu.registers[instr.rd]);
+            case OP_STORE:
+                if (REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    uint32_t addr = guest_translate_address(guest, vcpu->registers[instr.rs1]);
+                    if (addr != 0xFFFFFFFF) {
+                        if (__builtin_expect(guest->ept[addr / PAGE_SIZE].mmio, 0) &&
+                            trap_check(hv, guest, VMTRAPCFG_IO_INSTR, VMCAUSE_IO_INSTRUCTION, addr)) {
+                            return executed;
+                        }
+                        guest_store8(hv, guest, addr, (uint8_t)vcpu->registers[instr.rs2]);
+                        if (guest->ept[addr / PAGE_SIZE].code) {
+                            /* Self-modifying code: drop stale blocks and re-decode */
+                            block_cache_flush(guest);
+                            return executed;
+                        }
+                    } else if (trap_check(hv, guest, VMTRAPCFG_PAGE_FAULT, VMCAUSE_PAGE_FAULT,
+                                          vcpu->registers[instr.rs1])) {
+                        return executed;
+                    } else if (guest_raise(guest, IRQ_PAGE_FAULT, vcpu->registers[instr.rs1])) {
+                        return executed;
                     }
-                    break;
+                }
+                break;
 
-                case OP_LOAD:
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                        uint32_t addr = guest_translate_address(guest, guest->vcpu.registers[instr.rs1]);
-                        if (addr != 0xFFFFFFFF) {
-                            guest->vcpu.registers[instr.rd] = guest->guest_memory[addr];
+            case OP_CAS:
+            case OP_FADD:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    uint32_t addr;
+                    uint32_t* word = guest_atomic_word(guest, vcpu->registers[instr.rs1], &addr);
+                    if (!word) {
+                        if (trap_check(hv, guest, VMTRAPCFG_PAGE_FAULT, VMCAUSE_PAGE_FAULT,
+                                       vcpu->registers[instr.rs1])) {
+                            return executed;
                         }
+                        if (guest_raise(guest, IRQ_PAGE_FAULT, vcpu->registers[instr.rs1])) return executed;
+                        /* Unhandled: a failed CAS must not look like a swap (rd == expected) */
+                        if (instr.opcode == OP_CAS) vcpu->registers[instr.rd] = ~vcpu->registers[instr.rd];
+                        break;
                     }
-                    break;
 
-                case OP_STORE:
-                    if (instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                        uint32_t addr = guest_translate_address(guest, guest->vcpu.registers[instr.rs1]);
-                        if (addr != 0xFFFFFFFF) {
-                            guest->guest_memory[addr] = guest->vcpu.registers[instr.rs2];
+                    /* Words are big-endian in guest memory */
+                    uint32_t expected;
+                    bool stored;
+                    if (instr.opcode == OP_CAS) {
+                        expected = htobe32(vcpu->registers[instr.rd]);
+                        stored = __atomic_compare_exchange_n(word, &expected, htobe32(vcpu->registers[instr.rs2]),
+                                                             false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+                    } else {
+                        expected = __atomic_load_n(word, __ATOMIC_RELAXED);
+                        while (!__atomic_compare_exchange_n(word, &expected,
+                                                            htobe32(be32toh(expected) + vcpu->registers[instr.rs2]),
+                                                            true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
                         }
+                        stored = true;
                     }
-                    break;
+                    vcpu->registers[instr.rd] = be32toh(expected);
 
-                case OP_JMP:
-                    if (instr.rs1 < REGISTER_COUNT) {
-                        guest->vcpu.pc = guest->vcpu.registers[instr.rs1];
+                    if (stored && guest->ept[addr / PAGE_SIZE].code) {
+                        block_cache_flush(guest);
+                        return executed;
                     }
-                    break;
+                }
+                break;
 
-                case OP_JEQ:
-                    if (instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT && instr.rd < REGISTER_COUNT) {
-                        if (guest->vcpu.registers[instr.rs1] == guest->vcpu.registers[instr.rs2]) {
-                            guest->vcpu.pc = guest->vcpu.registers[instr.rd];
-                        }
-                    }
-                    break;
+            case OP_FENCE:
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                break;
 
-                case OP_JNE:
-                    if (instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT && instr.rd < REGISTER_COUNT) {
-                        if (guest->vcpu.registers[instr.rs1] != guest->vcpu.registers[instr.rs2]) {
-                            guest->vcpu.pc = guest->vcpu.registers[instr.rd];
-                        }
-                    }
-                    break;
+            /* Branch targets are instruction indices encoded in rd (see assembler.py) */
+            case OP_JMP:
+                vcpu->pc = instr.rd * INSTRUCTION_SIZE;
+                break;
 
-                case OP_CALL:
-                    if (guest->vcpu.sp > 3) {
-                        // Save return address (current PC + 4 bytes to next instruction)
-                        uint32_t return_addr = guest->vcpu.pc + INSTRUCTION_SIZE;
-                        guest->guest_memory[guest->vcpu.sp - 3] = (return_addr >> 24) & 0xFF;
-                        guest->guest_memory[guest->vcpu.sp - 2] = (return_addr >> 16) & 0xFF;
-                        guest->guest_memory[guest->vcpu.sp - 1] = (return_addr >> 8) & 0xFF;
-                        guest->guest_memory[guest->vcpu.sp] = return_addr & 0xFF;
-                        guest->vcpu.sp -= 4;
-                        
-                        // Jump to function address in rd (or rs1 if rd is 0)
-                        if (instr.rd != 0) {
-                            guest->vcpu.pc = instr.rd * INSTRUCTION_SIZE;
-                        } else if (instr.rs1 < REGISTER_COUNT) {
-                            guest->vcpu.pc = guest->vcpu.registers[instr.rs1];
-                        }
+            case OP_JEQ:
+                if (REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    if (vcpu->registers[instr.rs1] == vcpu->registers[instr.rs2]) {
+                        vcpu->pc = instr.rd * INSTRUCTION_SIZE;
                     }
-                    break;
+                }
+                break;
 
-                case OP_RET:
-                    if (guest->vcpu.sp + 4 <= GUEST_PHYS_MEMORY_SIZE) {
-                        guest->vcpu.pc = ((uint32_t)guest->guest_memory[guest->vcpu.sp] << 24) |
-                                        ((uint32_t)guest->guest_memory[guest->vcpu.sp + 1] << 16) |
-                                        ((uint32_t)guest->guest_memory[guest->vcpu.sp + 2] << 8) |
-                                        ((uint32_t)guest->guest_memory[guest->vcpu.sp + 3]);
-                        guest->vcpu.sp += 4;
+            case OP_JNE:
+                if (REG_OK(instr.rs1) && REG_OK(instr.rs2)) {
+                    if (vcpu->registers[instr.rs1] != vcpu->registers[instr.rs2]) {
+                        vcpu->pc = instr.rd * INSTRUCTION_SIZE;
                     }
-                    break;
+                }
+                break;
 
-                case OP_VMTRAPCFG:
-                    if (instr.rd < REGISTER_COUNT) {
-                        guest->vcpu.vmcs.trap_config = guest->vcpu.registers[instr.rd];
-                        printf("  VMTRAPCFG: Set trap config to 0x%X\n", guest->vcpu.vmcs.trap_config);
+            case OP_CALL:
+                if (vcpu->sp > 3) {
+                    /* Save return address (PC already points at the next instruction) */
+                    uint32_t return_addr = vcpu->pc;
+                    guest_write8(guest, vcpu->sp - 3, (return_addr >> 24) & 0xFF);
+                    guest_write8(guest, vcpu->sp - 2, (return_addr >> 16) & 0xFF);
+                    guest_write8(guest, vcpu->sp - 1, (return_addr >> 8) & 0xFF);
+                    guest_write8(guest, vcpu->sp, return_addr & 0xFF);
+                    vcpu->sp -= 4;
+
+                    /* Jump to function address in rd (or rs1 if rd is 0) */
+                    if (instr.rd != 0) {
+                        vcpu->pc = instr.rd * INSTRUCTION_SIZE;
+                    } else if (REG_OK(instr.rs1)) {
+                        vcpu->pc = vcpu->registers[instr.rs1];
                     }
-                    break;
+                }
+                break;
+
+            case OP_RET:
+                if (vcpu->sp + 4 < guest->memory_size) {
+                    /* CALL stored the address at old SP-3..SP, old SP = SP + 4 */
+                    uint32_t saved_sp = vcpu->sp + 4;
+                    vcpu->pc = ((uint32_t)guest_read8(guest, saved_sp - 3) << 24) |
+                               ((uint32_t)guest_read8(guest, saved_sp - 2) << 16) |
+                               ((uint32_t)guest_read8(guest, saved_sp - 1) << 8) |
+                               ((uint32_t)guest_read8(guest, saved_sp));
+                    vcpu->sp += 4;
+                }
+                break;
 
-                case OP_LDPGTR:
-                    if (instr.rd < REGISTER_COUNT) {
-                        guest->vcpu.vmcs.guest_pgtbl_root = guest->vcpu.registers[instr.rd];
-                        printf("  LDPGTR: Set guest page table root to 0x%X\n", guest->vcpu.vmcs.guest_pgtbl_root);
+            /* CR writes: the decoder marked the trapped ones in block->exits */
+            case OP_VMTRAPCFG:
+            case OP_LDPGTR:
+            case OP_LDHPTR:
+            case OP_LIVT:
+                if (!REG_OK(instr.rd)) break;
+                if (block->exits & (1u << (executed - 1))) {
+                    if (trap_exit(hv, guest, VMTRAPCFG_CR_WRITE, VMCAUSE_CR_WRITE,
+                                  ((uint32_t)instr.opcode << 8) | instr.rd)) {
+                        return executed;
                     }
-                    break;
+                } else {
+                    vcpu->trap_inline[__builtin_ctz(VMTRAPCFG_CR_WRITE)]++;
+                }
+
+                if (instr.opcode == OP_LDPGTR) {
+                    vcpu->vmcs.guest_pgtbl_root = vcpu->registers[instr.rd];
+                } else if (instr.opcode == OP_LDHPTR) {
+                    vcpu->vmcs.host_pgtbl_root = vcpu->registers[instr.rd];
+                } else if (instr.opcode == OP_LIVT) {
+                    vcpu->ivt_base = vcpu->registers[instr.rd];
+                } else if (vcpu_set_trap_config(guest, vcpu->registers[instr.rd])) {
+                    return executed;  /* The rest of this block was compiled under the old policy */
+                }
+                break;
+
+            case OP_VMCAUSE:
+                if (REG_OK(instr.rd)) {
+                    vcpu->registers[instr.rd] = vcpu->last_exit_cause;
+                }
+                break;
+
+            case OP_TLBFLUSHV:
+                vcpu->tlb_valid = false;
+                block_cache_flush(guest);
+                break;
 
-                case OP_LDHPTR:
-                    if (instr.rd < REGISTER_COUNT) {
-                        guest->vcpu.vmcs.host_pgtbl_root = guest->vcpu.registers[instr.rd];
+            case OP_STIMER:
+                if (REG_OK(instr.rd)) {
+                    /* Counted from the end of this instruction */
+                    vcpu->timer_period = vcpu->registers[instr.rd];
+                    vcpu->timer_next = guest->instruction_count + executed + vcpu->timer_period;
+                }
+                break;
+
+            case OP_IRET:
+                if (vcpu->sp + 8 < guest->memory_size) {
+                    /* Skip the info word; the return PC sits at old SP-3..SP */
+                    uint32_t saved_sp = vcpu->sp + 8;
+                    vcpu->pc = ((uint32_t)guest_read8(guest, saved_sp - 3) << 24) |
+                               ((uint32_t)guest_read8(guest, saved_sp - 2) << 16) |
+                               ((uint32_t)guest_read8(guest, saved_sp - 1) << 8) |
+                               ((uint32_t)guest_read8(guest, saved_sp));
+                    vcpu->sp += 8;
+                    vcpu->irq_masked = false;
+                }
+                break;
+
+            /* Privileged instructions: the handler emulates trapped ones. Untrapped,
+               SYSCALL enters the guest's IRQ_SYSCALL handler if it has one, and
+               VMENTER/VMRESUME (nested entry is not supported) do nothing. */
+            case OP_SYSCALL:
+            case OP_VMENTER:
+            case OP_VMRESUME:
+                if (!(block->exits & (1u << (executed - 1)))) {
+                    vcpu->trap_inline[__builtin_ctz(VMTRAPCFG_PRIVILEGED_INSTR)]++;
+                    if (instr.opcode == OP_SYSCALL && REG_OK(instr.rd) &&
+                        guest_raise(guest, IRQ_SYSCALL, vcpu->registers[instr.rd])) {
+                        return executed;
                     }
                     break;
+                }
+                vcpu->trap_exits[__builtin_ctz(VMTRAPCFG_PRIVILEGED_INSTR)]++;
+                /* fall through */
+            case OP_HYPERCALL:
+            case OP_IPI:
+                /* Qualification: faulting opcode and its rd operand */
+                vcpu->state = GUEST_BLOCKED;
+                vm_exit(hv, guest, VMCAUSE_PRIVILEGED_INSTRUCTION, ((uint32_t)instr.opcode << 8) | instr.rd);
+                break;
 
-                case OP_VMCAUSE:
-                    if (instr.rd < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = guest->vcpu.last_exit_cause;
-                        printf("  VMCAUSE: Read exit cause 0x%X into r%u\n", guest->vcpu.last_exit_cause, instr.rd);
+            /* ============ IMMEDIATE INSTRUCTIONS ============ */
+            case OP_MOVI:
+                if (REG_OK(instr.rd)) {
+                    vcpu->registers[instr.rd] = (uint32_t)instr.rs2;
+                }
+                break;
+
+            case OP_ADDI:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] + (uint32_t)instr.rs2;
+                }
+                break;
+
+            case OP_SUBI:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] - (uint32_t)instr.rs2;
+                }
+                break;
+
+            case OP_MULI:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1)) {
+                    vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] * (uint32_t)instr.rs2;
+                }
+                break;
+
+            case OP_DIVI:
+                if (REG_OK(instr.rd) && REG_OK(instr.rs1)) {
+                    if (verified || instr.rs2 != 0) {
+                        vcpu->registers[instr.rd] = vcpu->registers[instr.rs1] / (uint32_t)instr.rs2;
                     }
-                    break;
+                }
+                break;
 
-                case OP_SYSCALL:
-                    hv->mode = MODE_HOST;
-                    guest->vcpu.state = GUEST_BLOCKED;
-                    guest->vcpu.last_exit_cause = VMCAUSE_PRIVILEGED_INSTRUCTION;
-                    break;
+            case OP_HALT:
+                vcpu->state = GUEST_STOPPED;
+                hv->mode = MODE_HOST;
+                break;
 
-                case OP_HYPERCALL:
-                    hv->mode = MODE_HOST;
-                    guest->vcpu.state = GUEST_BLOCKED;
-                    guest->vcpu.last_exit_cause = VMCAUSE_PRIVILEGED_INSTRUCTION;
-                    break;
+            default:
+                if (guest_raise(guest, IRQ_INVALID_INSTRUCTION, vcpu->pc - INSTRUCTION_SIZE)) {
+                    return executed;
+                }
+                vcpu->state = GUEST_BLOCKED;
+                vm_exit(hv, guest, VMCAUSE_ILLEGAL_INSTRUCTION, instr.opcode);
+                hypervisor_log(hv, VISA_LOG_WARN, "[ILLEGAL_INSTR] Opcode 0x%02X at PC 0x%X\n", instr.opcode,
+                               vcpu->pc - INSTRUCTION_SIZE);
+                break;
+        }
+    }
 
-                case OP_TLBFLUSHV:
-                    guest->vcpu.tlb_valid = false;
-                    break;
+    return executed;
+}
 
-                case OP_VMENTER:
-                    /* Guest trying to enter nested VM (shouldn't happen, trap it) */
-                    hv->mode = MODE_HOST;
-                    guest->vcpu.state = GUEST_BLOCKED;
-                    guest->vcpu.last_exit_cause = VMCAUSE_PRIVILEGED_INSTRUCTION;
-                    break;
+#undef REG_OK
 
-                case OP_VMRESUME:
-                    /* Guest trying to resume (shouldn't happen in guest context, trap it) */
-                    hv->mode = MODE_HOST;
-                    guest->vcpu.state = GUEST_BLOCKED;
-                    guest->vcpu.last_exit_cause = VMCAUSE_PRIVILEGED_INSTRUCTION;
-                    break;
+static uint32_t execute_block(hypervisor_t* hv, guest_vm_t* guest, const decoded_block_t* block,
+                              uint32_t limit) {
+    return execute_block_body(hv, guest, block, limit, false);
+}
 
-                /* ============ IMMEDIATE INSTRUCTIONS ============ */
-                case OP_MOVI:
-                    /* movi rd, imm8 - load immediate 8-bit value */
-                    if (instr.rd < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = (uint32_t)instr.rs2;
-                        printf("  MOVI r%u = 0x%X\n", instr.rd, instr.rs2);
-                    }
-                    break;
+static uint32_t execute_verified_block(hypervisor_t* hv, guest_vm_t* guest, const decoded_block_t* block,
+                                       uint32_t limit) {
+    return execute_block_body(hv, guest, block, limit, true);
+}
 
-                case OP_ADDI:
-                    /* addi rd, rs1, imm8 - rd = rs1 + imm8 */
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = 
-                            guest->vcpu.registers[instr.rs1] + (uint32_t)instr.rs2;
-                        printf("  ADDI r%u = r%u(0x%X) + 0x%X = 0x%X\n", instr.rd, instr.rs1,
-                               guest->vcpu.registers[instr.rs1], instr.rs2, guest->vcpu.registers[instr.rd]);
-                    }
-                    break;
+vmcause_t hypervisor_run_slice(hypervisor_t* hv, guest_vm_t* guest) {
+    return hypervisor_run_slice_budget(hv, guest, guest->quantum_instructions, guest->quantum_ns);
+}
 
-                case OP_SUBI:
-                    /* subi rd, rs1, imm8 - rd = rs1 - imm8 */
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = 
-                            guest->vcpu.registers[instr.rs1] - (uint32_t)instr.rs2;
-                        printf("  SUBI r%u = r%u(0x%X) - 0x%X = 0x%X\n", instr.rd, instr.rs1,
-                               guest->vcpu.registers[instr.rs1], instr.rs2, guest->vcpu.registers[instr.rd]);
-                    }
-                    break;
+/* Budgets are only checked between blocks, so a slice may overrun its
+   instruction quantum by at most MAX_BLOCK_INSTRUCTIONS - 1. Exact slices
+   (replay) cut the last block short instead and exit on the timer only if
+   `preempt` is set. */
+static vmcause_t run_slice_locked(hypervisor_t* hv, guest_vm_t* guest, uint32_t instructions,
+                                  uint64_t nanoseconds, bool exact, bool preempt) {
+    vcpu_t* vcpu = &guest->vcpu;
 
-                case OP_MULI:
-                    /* muli rd, rs1, imm8 - rd = rs1 * imm8 */
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                        guest->vcpu.registers[instr.rd] = 
-                            guest->vcpu.registers[instr.rs1] * (uint32_t)instr.rs2;
-                        printf("  MULI r%u = r%u(0x%X) * 0x%X = 0x%X\n", instr.rd, instr.rs1,
-                               guest->vcpu.registers[instr.rs1], instr.rs2, guest->vcpu.registers[instr.rd]);
-                    }
-                    break;
+    int64_t budget = instructions || exact ? (int64_t)instructions : INT64_MAX;
+    uint64_t deadline = nanoseconds ? hypervisor_time_ns() + nanoseconds : 0;
 
-                case OP_DIVI:
-                    /* divi rd, rs1, imm8 - rd = rs1 / imm8 */
-                    if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                        if (instr.rs2 != 0) {
-                            guest->vcpu.registers[instr.rd] = 
-                                guest->vcpu.registers[instr.rs1] / (uint32_t)instr.rs2;
-                            printf("  DIVI r%u = r%u(0x%X) / 0x%X = 0x%X\n", instr.rd, instr.rs1,
-                                   guest->vcpu.registers[instr.rs1], instr.rs2, guest->vcpu.registers[instr.rd]);
-                        }
-                    }
-                    break;
+    hv->mode = MODE_GUEST;
+    hv->current_guest_id = guest->vm_id;
+    hv->tick_count++;
 
-                case OP_HALT:
-                    guest->vcpu.state = GUEST_STOPPED;
-                    hv->mode = MODE_HOST;
-                    break;
+    while (vcpu->state == GUEST_RUNNING) {
+        if (__builtin_expect((vcpu->irq_pending | vcpu->timer_period) != 0, 0)) {
+            guest_interrupt_check(guest);
+        }
 
-                default:
-                    hv->mode = MODE_HOST;
-                    guest->vcpu.state = GUEST_BLOCKED;
-                    guest->vcpu.last_exit_cause = VMCAUSE_ILLEGAL_INSTRUCTION;
-                    printf("[ILLEGAL_INSTR] Opcode 0x%02X at PC 0x%X\n", instr.opcode, guest->vcpu.pc - INSTRUCTION_SIZE);
-                    break;
+        decoded_block_t* block = block_lookup(hv, guest, vcpu->pc);
+        if (!block) {
+            /* Fetch faults the guest cannot take exit whatever the policy */
+            if (!(vcpu->vmcs.trap_config & VMTRAPCFG_PAGE_FAULT) && guest_raise(guest, IRQ_PAGE_FAULT, vcpu->pc)) {
+                vcpu->trap_inline[__builtin_ctz(VMTRAPCFG_PAGE_FAULT)]++;
+                continue;
             }
+            vcpu->trap_exits[__builtin_ctz(VMTRAPCFG_PAGE_FAULT)]++;
+            vcpu->state = GUEST_BLOCKED;
+            vm_exit(hv, guest, VMCAUSE_PAGE_FAULT, vcpu->pc);
+            break;
+        }
 
-            total_instructions++;
+        uint32_t limit = block->length;
+        if (exact && budget < limit) limit = (uint32_t)budget;
+
+        uint32_t attempts = vcpu->trap_attempts;
+        uint32_t executed;
+        if (__builtin_expect(hv->perf != NULL, 0) && perf_sample_begin(hv->perf)) {
+            executed = block->verified ? execute_verified_block(hv, guest, block, limit)
+                                       : execute_block(hv, guest, block, limit);
+            uint8_t opcodes[MAX_BLOCK_INSTRUCTIONS];
+            for (uint32_t i = 0; i < executed; i++) opcodes[i] = block->instrs[i].opcode;
+            perf_sample_end(hv->perf, opcodes, executed);
+        } else if (block->verified) {
+            executed = execute_verified_block(hv, guest, block, limit);
+        } else {
+            executed = execute_block(hv, guest, block, limit);
         }
+        uint32_t retired = executed - (vcpu->trap_attempts - attempts);
+        guest->instruction_count += retired;
+        guest->steps += executed;
+        budget -= exact ? executed : retired;
+
+        if (vcpu->state == GUEST_RUNNING &&
+            (budget <= 0 || (deadline && hypervisor_time_ns() >= deadline))) {
+            if (exact && !preempt) break;
+            vm_exit(hv, guest, VMCAUSE_TIMER, 0);
+            return VMCAUSE_TIMER;
+        }
+    }
+
+    hv->mode = MODE_HOST;
+    return vcpu->state == GUEST_STOPPED ? VMCAUSE_NONE : vcpu->last_exit_cause;
+}
+
+/* The whole slice, decode misses aside, is dispatch time for the guest */
+static vmcause_t run_slice_counted(hypervisor_t* hv, guest_vm_t* guest, uint32_t instructions,
+                                   uint64_t nanoseconds, bool exact, bool preempt) {
+    if (!hv->perf) return run_slice_locked(hv, guest, instructions, nanoseconds, exact, preempt);
+
+    perf_switch(hv->perf, guest->vm_id, PERF_PHASE_DISPATCH);
+    vmcause_t cause = run_slice_locked(hv, guest, instructions, nanoseconds, exact, preempt);
+    perf_switch(hv->perf, PERF_HOST, PERF_PHASE_SCHED);
+    return cause;
+}
+
+/* Guest memory is locked for the whole slice so the KSM scanner and the
+   compressor never remap a page under a running guest. vCPUs of one VM share
+   the boot vCPU's lock. */
+vmcause_t hypervisor_run_slice_budget(hypervisor_t* hv, guest_vm_t* guest,
+                                      uint32_t instructions, uint64_t nanoseconds) {
+    if (guest->vcpu.state != GUEST_RUNNING) {
+        return guest->vcpu.last_exit_cause;
+    }
+
+    /* A lane ejected at this PC gets past the instruction that ejected it */
+    guest->spmd_ejected = false;
+
+    uint32_t start_steps = guest->steps;
+    pthread_mutex_lock(&guest->vm->mem_lock);
+    vmcause_t cause = run_slice_counted(hv, guest, instructions, nanoseconds, false, false);
+    __atomic_store_n(&guest->last_run_ns, hypervisor_time_ns(), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&guest->vm->mem_lock);
+
+    if (hv->replay) {
+        replay_record_slice(hv->replay, guest, guest->steps - start_steps, cause == VMCAUSE_TIMER);
+    }
+    return cause;
+}
+
+vmcause_t hypervisor_run_slice_exact(hypervisor_t* hv, guest_vm_t* guest,
+                                     uint32_t instructions, bool preempt) {
+    if (guest->vcpu.state != GUEST_RUNNING) {
+        return guest->vcpu.last_exit_cause;
+    }
+
+    pthread_mutex_lock(&guest->vm->mem_lock);
+    vmcause_t cause = run_slice_counted(hv, guest, instructions, 0, true, preempt);
+    pthread_mutex_unlock(&guest->vm->mem_lock);
+    return cause;
+}
+
+void hypervisor_resume_guest(hypervisor_t* hv, guest_vm_t* guest, uint32_t result) {
+    if (hv->replay) replay_record_resume(hv->replay, guest, result);
+    guest->vcpu.vmcs.guest_rax = result;
+    isa_vmresume(hv, &guest->vcpu.vmcs);
+}
+
+static bool dispatch_exit(hypervisor_t* hv, guest_vm_t* guest, vmcause_t cause) {
+    switch (cause) {
+        case VMCAUSE_NONE:
+            return false;  /* Guest halted */
+
+        case VMCAUSE_TIMER:
+            return true;   /* Preempted; still runnable */
+
+        case VMCAUSE_ILLEGAL_INSTRUCTION:
+        case VMCAUSE_PAGE_FAULT:
+            hypervisor_log(hv, VISA_LOG_WARN, "[VMEXIT] Guest %u - Cause: 0x%X (fatal)\n", guest->vm_id, cause);
+            guest->vcpu.state = GUEST_STOPPED;
+            return false;
+
+        case VMCAUSE_CR_WRITE:
+        case VMCAUSE_IO_INSTRUCTION:
+            /* Seen; the instruction completes inline on resume */
+            hypervisor_resume_guest(hv, guest, guest->vcpu.vmcs.guest_rax);
+            return true;
+
+        default:
+            if ((guest->vcpu.vmcs.exit_qualification >> 8) == OP_HYPERCALL) {
+                return hypervisor_handle_hypercall(hv, guest);
+            }
+            if ((guest->vcpu.vmcs.exit_qualification >> 8) == OP_IPI) {
+                return hypervisor_handle_ipi(hv, guest);
+            }
+
+            hypervisor_log(hv, VISA_LOG_DEBUG, "[VMEXIT] Guest %u - Cause: 0x%X\n", guest->vm_id, cause);
+            hypervisor_resume_guest(hv, guest, guest->vcpu.vmcs.guest_rax);
+            return true;
+    }
+}
+
+/* The embedder sees the exit first and may stop the guest instead */
+static bool host_exit(hypervisor_t* hv, guest_vm_t* guest, vmcause_t cause) {
+    visa_exit_t exit = {
+        .cause = cause,
+        .qualification = guest->vcpu.vmcs.exit_qualification,
+        .pc = guest->vcpu.pc,
+        .instructions = guest->instruction_count,
+    };
+    if (hv->config.on_exit(hv->config.user, hv, guest->vm_id + 1, &exit) != VISA_EXIT_STOP) {
+        return dispatch_exit(hv, guest, cause);
+    }
+    guest->vcpu.state = GUEST_STOPPED;
+    return false;
+}
+
+bool hypervisor_handle_exit(hypervisor_t* hv, guest_vm_t* guest, vmcause_t cause) {
+    guest_state_t state = guest->vcpu.state;
+    if (hv->perf) perf_switch(hv->perf, guest->vm_id, PERF_PHASE_EXIT);
+    bool runnable = hv->config.on_exit ? host_exit(hv, guest, cause) : dispatch_exit(hv, guest, cause);
+    if (hv->perf) perf_switch(hv->perf, PERF_HOST, PERF_PHASE_SCHED);
+
+    /* Resumes are recorded with their r0 value; stops are recorded here */
+    if (hv->replay && guest->vcpu.state != state && guest->vcpu.state != GUEST_RUNNING) {
+        replay_record_state(hv->replay, guest);
+    }
+    return runnable;
+}
 
-        /* Handle VMEXIT */
+void hypervisor_run_guest(hypervisor_t* hv, uint32_t guest_id) {
+    if (guest_id == 0 || guest_id > hv->guest_count) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
+        return;
+    }
+
+    guest_vm_t* guest = &hv->guests[guest_id - 1];
+
+    hypervisor_log(hv, VISA_LOG_INFO, "\n[HYPERVISOR] Starting Guest VM %u\n", guest->vm_id);
+    hypervisor_log(hv, VISA_LOG_INFO, "=========================================\n\n");
+
+    /* Use ISA instruction to enter guest */
+    isa_vmenter(hv, &guest->vcpu.vmcs);
+
+    /* This loop drives the guest directly, outside the run queue */
+    scheduler_remove(&hv->scheduler, guest);
+
+    uint32_t start_count = guest->instruction_count;
+    while (guest->vcpu.state != GUEST_STOPPED) {
         if (guest->vcpu.state == GUEST_BLOCKED) {
-            printf("[VMEXIT] Guest %u - Cause: 0x%X\n", guest->vm_id, guest->vcpu.last_exit_cause);
-            
-            if (guest->vcpu.last_exit_cause == VMCAUSE_ILLEGAL_INSTRUCTION) {
+            /* Sleep until the event the guest is parked on fires */
+            hypervisor_poll_events(hv);
+            if (guest->vcpu.state == GUEST_BLOCKED && !hypervisor_idle_wait(hv, 0)) {
+                hypervisor_log(hv, VISA_LOG_WARN, "[HYPERVISOR] Guest VM %u blocked with no pending wakeup\n",
+                               guest->vm_id);
                 break;
             }
-
-            /* Use ISA instruction to resume */
-            guest->vcpu.vmcs.guest_pc = guest->vcpu.pc;
-            isa_vmresume(hv, &guest->vcpu.vmcs);
+            scheduler_remove(&hv->scheduler, guest);
+            continue;
         }
+
+        hypervisor_place_vcpu(hv, guest);
+        hypervisor_handle_exit(hv, guest, hypervisor_run_slice(hv, guest));
     }
 
-    printf("\n=========================================\n");
-    printf("[HYPERVISOR] Guest VM %u stopped after %d instructions\n\n", 
-           guest->vm_id, total_instructions);
+    hypervisor_log(hv, VISA_LOG_INFO, "\n=========================================\n");
+    hypervisor_log(hv, VISA_LOG_INFO, "[HYPERVISOR] Guest VM %u stopped after %u instructions\n\n",
+                   guest->vm_id, guest->instruction_count - start_count);
 }
 
 /* ============ DEBUGGING ============ */
+const char* isa_opcode_name(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_MUL: return "MUL";
+        case OP_DIV: return "DIV";
+        case OP_MOV: return "MOV";
+        case OP_LOAD: return "LOAD";
+        case OP_STORE: return "STORE";
+        case OP_JMP: return "JMP";
+        case OP_JEQ: return "JEQ";
+        case OP_JNE: return "JNE";
+        case OP_CALL: return "CALL";
+        case OP_RET: return "RET";
+        case OP_MOVI: return "MOVI";
+        case OP_ADDI: return "ADDI";
+        case OP_SUBI: return "SUBI";
+        case OP_MULI: return "MULI";
+        case OP_DIVI: return "DIVI";
+        case OP_CAS: return "CAS";
+        case OP_FADD: return "FADD";
+        case OP_FENCE: return "FENCE";
+        case OP_SYSCALL: return "SYSCALL";
+        case OP_HYPERCALL: return "HYPERCALL";
+        case OP_IPI: return "IPI";
+        case OP_VMENTER: return "VMENTER";
+        case OP_VMRESUME: return "VMRESUME";
+        case OP_VMCAUSE: return "VMCAUSE";
+        case OP_VMTRAPCFG: return "VMTRAPCFG";
+        case OP_LDPGTR: return "LDPGTR";
+        case OP_LDHPTR: return "LDHPTR";
+        case OP_TLBFLUSHV: return "TLBFLUSHV";
+        case OP_LIVT: return "LIVT";
+        case OP_IRET: return "IRET";
+        case OP_STIMER: return "STIMER";
+        case OP_HALT: return "HALT";
+        default: return "???";
+    }
+}
+
 void hypervisor_dump_state(hypervisor_t* hv) {
-    printf("\n[HYPERVISOR STATE]\n");
-    printf("Mode: %s\n", hv->mode == MODE_HOST ? "HOST" : "GUEST");
-    printf("Guests: %u/%u\n", hv->guest_count, MAX_GUESTS);
-    printf("Ticks: %u\n", hv->tick_count);
+    hypervisor_log(hv, VISA_LOG_INFO, "\n[HYPERVISOR STATE]\n");
+    hypervisor_log(hv, VISA_LOG_INFO, "Mode: %s\n", hv->mode == MODE_HOST ? "HOST" : "GUEST");
+    hypervisor_log(hv, VISA_LOG_INFO, "Guests: %u/%u\n", hv->guest_count, MAX_GUESTS);
+    hypervisor_log(hv, VISA_LOG_INFO, "Ticks: %u\n", hv->tick_count);
 
     for (uint32_t i = 0; i < hv->guest_count; i++) {
         guest_dump_state(&hv->guests[i]);
@@ -572,31 +1484,78 @@ void hypervisor_dump_state(hypervisor_t* hv) {
 }
 
 void guest_dump_state(guest_vm_t* guest) {
-    printf("\n  [GUEST %u STATE]\n", guest->vm_id);
-    printf("  State: %d (0=Stopped, 1=Running, 2=Blocked, 3=Paused)\n", guest->vcpu.state);
-    printf("  PC: 0x%08X\n", guest->vcpu.pc);
-    printf("  SP: 0x%08X\n", guest->vcpu.sp);
-    printf("  Priv: %s\n", guest->vcpu.priv == PRIV_KERNEL ? "KERNEL" : "USER");
-    printf("  Guest PGTBL: 0x%08X\n", guest->vcpu.guest_pgtbl_root);
-    printf("  Host PGTBL: 0x%08X\n", guest->vcpu.host_pgtbl_root);
-    printf("  VMCS Trap Config: 0x%08X\n", guest->vcpu.vmcs.trap_config);
-    printf("  Last Exit Cause: 0x%X\n", guest->vcpu.last_exit_cause);
-    printf("  Instructions: %u\n", guest->instruction_count);
-    printf("  TLB Valid: %s\n", guest->vcpu.tlb_valid ? "YES" : "NO");
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "\n  [GUEST %u STATE]\n", guest->vm_id);
+    if (guest->vm->nr_vcpus != 1) {
+        hypervisor_log(guest->hv, VISA_LOG_INFO, "  vCPU: %u of Guest VM %u\n", guest->vcpu_index, guest->vm->vm_id);
+    }
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  State: %d (0=Stopped, 1=Running, 2=Blocked, 3=Paused)\n",
+                   guest->vcpu.state);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  PC: 0x%08X\n", guest->vcpu.pc);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  SP: 0x%08X\n", guest->vcpu.sp);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  Priv: %s\n", guest->vcpu.priv == PRIV_KERNEL ? "KERNEL" : "USER");
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  Guest PGTBL: 0x%08X\n", guest->vcpu.guest_pgtbl_root);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  Host PGTBL: 0x%08X\n", guest->vcpu.host_pgtbl_root);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  VMCS Trap Config: 0x%08X\n", guest->vcpu.vmcs.trap_config);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  Last Exit Cause: 0x%X\n", guest->vcpu.last_exit_cause);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  Instructions: %u\n", guest->instruction_count);
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "  TLB Valid: %s\n", guest->vcpu.tlb_valid ? "YES" : "NO");
+    if (guest->vm == guest) {
+        hypervisor_log(guest->hv, VISA_LOG_INFO, "  Memory: %u KB reserved, %u KB resident\n",
+                       guest->memory_size / 1024, guest->resident_pages * (PAGE_SIZE / 1024));
+    }
+    if (guest->shared_pages || guest->cow_breaks) {
+        hypervisor_log(guest->hv, VISA_LOG_INFO, "  Merged Pages: %u shared, %u copy-on-write breaks\n",
+                       guest->shared_pages, guest->cow_breaks);
+    }
+    if (guest->vm == guest && guest->verify) {
+        hypervisor_log(guest->hv, VISA_LOG_INFO, "  Verified Code: %u pages (%u checks, %u failed)\n",
+                       guest->verified_pages, guest->verify_runs, guest->verify_failures);
+    }
+    static const char* const irq_names[IRQ_VECTORS] = {
+        "vector 0", [IRQ_SYSCALL] = "syscall", [IRQ_PAGE_FAULT] = "page fault",
+        [IRQ_DIVIDE_BY_ZERO] = "divide", [IRQ_INVALID_INSTRUCTION] = "illegal",
+        [IRQ_TIMER] = "timer", [IRQ_IO] = "io", "vector 7",
+    };
+    for (uint32_t v = 0; v < IRQ_VECTORS; v++) {
+        if (guest->vcpu.irq_delivered[v]) {
+            hypervisor_log(guest->hv, VISA_LOG_INFO, "  Interrupts (%s): %u delivered\n", irq_names[v],
+                           guest->vcpu.irq_delivered[v]);
+        }
+    }
+    static const char* const trap_names[VMTRAPCFG_BITS] = { "privileged", "cr write", "i/o", "page fault" };
+    for (uint32_t b = 0; b < VMTRAPCFG_BITS; b++) {
+        if (guest->vcpu.trap_inline[b] || guest->vcpu.trap_exits[b]) {
+            hypervisor_log(guest->hv, VISA_LOG_INFO, "  Sensitive (%s, %s): %llu inline, %llu exits\n", trap_names[b],
+                           (guest->vcpu.vmcs.trap_config >> b) & 1 ? "trapped" : "untrapped",
+                           (unsigned long long)guest->vcpu.trap_inline[b],
+                           (unsigned long long)guest->vcpu.trap_exits[b]);
+        }
+    }
     
     /* Print registers r0-r15 */
-    printf("\n  [REGISTERS]\n");
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "\n  [REGISTERS]\n");
+    log_line_t line = {0};
     for (int i = 0; i < 16; i++) {
-        printf("    r%u = 0x%08X", i, guest->vcpu.registers[i]);
-        if ((i + 1) % 4 == 0) printf("\n");
-        else printf("  ");
+        log_append(&line, "    r%u = 0x%08X", i, guest->vcpu.registers[i]);
+        if ((i + 1) % 4 == 0) {
+            hypervisor_log(guest->hv, VISA_LOG_INFO, "%s\n", line.text);
+            line.length = 0;
+        } else {
+            log_append(&line, "  ");
+        }
     }
     
     /* Print first 20 bytes of memory */
-    printf("\n  [MEMORY (first 20 bytes - Program Results)]\n");
+    hypervisor_log(guest->hv, VISA_LOG_INFO, "\n  [MEMORY (first 20 bytes - Program Results)]\n");
+    pthread_mutex_lock(&guest->vm->mem_lock);
     for (int i = 0; i < 20; i++) {
-        printf("    [%u] = 0x%02X", i, guest->guest_memory[i]);
-        if ((i + 1) % 4 == 0) printf("\n");
-        else printf("  ");
+        log_append(&line, "    [%u] = 0x%02X", i, guest_read8(guest, i));
+        if ((i + 1) % 4 == 0) {
+            hypervisor_log(guest->hv, VISA_LOG_INFO, "%s\n", line.text);
+            line.length = 0;
+        } else {
+            log_append(&line, "  ");
+        }
     }
+    pthread_mutex_unlock(&guest->vm->mem_lock);
 }
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../include/isa.h"
+
+/* ============ REQUEST QUEUE ============ */
+
+void iopool_submit(iopool_t* pool, io_request_t* request) {
+    request->next = NULL;
+    request->submit_ns = hypervisor_time_ns();
+
+    pthread_mutex_lock(&pool->lock);
+    *pool->tail = request;
+    pool->tail = &request->next;
+    pool->requests++;
+    if (++pool->in_flight > pool->max_in_flight) pool->max_in_flight = pool->in_flight;
+    /* Counted under the lock so a worker cannot complete it first */
+    hypervisor_async_begin(pool->hv);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Transfer the whole request, retrying short and interrupted transfers */
+static uint32_t io_execute(const io_request_t* request) {
+    uint32_t done = 0;
+    while (done < request->length) {
+        ssize_t n = request->op == IO_READ
+            ? pread(request->fd, request->buffer + done, request->length - done, (off_t)(request->offset + done))
+            : pwrite(request->fd, request->buffer + done, request->length - done, (off_t)(request->offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return 0xFFFFFFFF;
+        if (n == 0) break;  /* End of file */
+        done += (uint32_t)n;
+    }
+    return done;
+}
+
+/* ============ WORKER THREADS ============ */
+
+static void* iopool_thread(void* arg) {
+    iopool_t* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->running && !pool->head) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        io_request_t* request = pool->head;
+        if (!request) break;  /* Stopped and drained */
+        pool->head = request->next;
+        if (!pool->head) pool->tail = &pool->head;
+        pthread_mutex_unlock(&pool->lock);
+
+        uint32_t result = io_execute(request);
+        wait_event_t event = request->event;
+        uint32_t key = request->key;
+        uint64_t latency = hypervisor_time_ns() - request->submit_ns;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->in_flight--;
+        pool->latency_ns += latency;
+        if (result == 0xFFFFFFFF) pool->errors++;
+        else pool->bytes += result;
+        pthread_mutex_unlock(&pool->lock);
+
+        /* The submitter may reuse the request as soon as this is posted */
+        hypervisor_async_complete(pool->hv, event, key, result);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* ============ HYPERVISOR INTERFACE ============ */
+
+bool hypervisor_iopool_start(hypervisor_t* hv, uint32_t nr_threads) {
+    if (hv->iopool) return true;
+    if (nr_threads == 0) nr_threads = IOPOOL_DEFAULT_THREADS;
+    if (nr_threads > IOPOOL_MAX_THREADS) nr_threads = IOPOOL_MAX_THREADS;
+
+    iopool_t* pool = calloc(1, sizeof(iopool_t));
+    if (!pool) return false;
+    pool->hv = hv;
+    pool->tail = &pool->head;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    pool->running = true;
+    for (uint32_t i = 0; i < nr_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, iopool_thread, pool) != 0) break;
+        placement_pin_helper(hv, pool->threads[i]);
+        pool->nr_threads++;
+    }
+    if (pool->nr_threads == 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[IO] Failed to start I/O threads\n");
+        iopool_destroy(pool);
+        return false;
+    }
+
+    hv->iopool = pool;
+    hypervisor_log(hv, VISA_LOG_INFO, "[IO] Started %u I/O threads\n", pool->nr_threads);
+    return true;
+}
+
+void hypervisor_iopool_stop(hypervisor_t* hv) {
+    iopool_t* pool = hv->iopool;
+    if (!pool || !pool->running) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = false;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < pool->nr_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    uint64_t completed = pool->requests - pool->in_flight;
+    hypervisor_log(hv, VISA_LOG_INFO,
+                   "[IO] %llu requests (%llu bytes, %llu errors) on %u threads, %.1f us average latency, "
+                   "%u in flight at most\n", (unsigned long long)pool->requests, (unsigned long long)pool->bytes,
+                   (unsigned long long)pool->errors, pool->nr_threads,
+                   completed ? (double)pool->latency_ns / (double)completed / 1000.0 : 0.0, pool->max_in_flight);
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        fiber_t* fiber = hv->guests[i].fiber;
+        if (!fiber) continue;
+        hypervisor_log(hv, VISA_LOG_INFO, "[IO] Guest %u: %llu async exits, %llu suspensions\n", i,
+                       (unsigned long long)fiber->runs, (unsigned long long)fiber->suspends);
+    }
+    hypervisor_log(hv, VISA_LOG_INFO, "[IO] Scheduler idle %.1f ms while guests waited\n",
+                   (double)hv->waitq.idle_ns / 1e6);
+}
+
+void iopool_destroy(iopool_t* pool) {
+    if (!pool) return;
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/* Back HYPERCALL_DISK_* for a guest VM with a host file (created if missing) */
+bool hypervisor_attach_disk(hypervisor_t* hv, uint32_t guest_id, const char* path) {
+    if (guest_id == 0 || guest_id > hv->guest_count) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
+        return false;
+    }
+
+    guest_vm_t* vm = hv->guests[guest_id - 1].vm;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[IO] Cannot open disk %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (vm->disk_fd >= 0) close(vm->disk_fd);
+    vm->disk_fd = fd;
+    hypervisor_log(hv, VISA_LOG_INFO, "[IO] Guest VM %u disk: %s\n", vm->vm_id, path);
+    return true;
+}
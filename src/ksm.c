@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "../include/isa.h"
+
+/* ============ PAGE HASHING ============ */
+/* Sixteen independent 32-bit multiply/rotate lanes over the page, folded at the
+   end. The lane loop has no cross-lane dependency, so it compiles to SIMD
+   multiplies (ksm.c is built with -O3). */
+#define KSM_HASH_LANES 16
+#define KSM_PRIME1 0x9E3779B1u
+#define KSM_PRIME2 0x85EBCA77u
+
+uint32_t ksm_page_hash(const uint8_t* page) {
+    uint32_t acc[KSM_HASH_LANES];
+    for (uint32_t l = 0; l < KSM_HASH_LANES; l++) {
+        acc[l] = KSM_PRIME1 * (l + 1);
+    }
+
+    for (uint32_t off = 0; off < PAGE_SIZE; off += KSM_HASH_LANES * 4) {
+        uint32_t words[KSM_HASH_LANES];
+        memcpy(words, page + off, sizeof(words));
+        for (uint32_t l = 0; l < KSM_HASH_LANES; l++) {
+            uint32_t v = acc[l] + words[l] * KSM_PRIME2;
+            acc[l] = ((v << 13) | (v >> 19)) * KSM_PRIME1;
+        }
+    }
+
+    uint32_t hash = 0x811C9DC5u;
+    for (uint32_t l = 0; l < KSM_HASH_LANES; l++) {
+        hash = (hash ^ acc[l]) * 0x01000193u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+void ksm_page_put(uint8_t* host_page) {
+    __atomic_sub_fetch(&((ksm_page_t*)host_page)->refcount, 1, __ATOMIC_ACQ_REL);
+}
+
+/* ============ MAPPING ============ */
+
+/* Point a private guest page at a merged page and give back its backing */
+static void map_shared(guest_vm_t* guest, uint32_t page, ksm_page_t* kp) {
+    ept_entry_t* entry = &guest->ept[page];
+    entry->host_page = kp->data;
+    entry->writable = false;
+    entry->shared = true;
+    guest->shared_pages++;
+    guest_memory_release(guest, page);
+}
+
+static ksm_page_t* stable_lookup(ksm_t* ksm, uint32_t hash, const uint8_t* data) {
+    for (ksm_page_t* kp = ksm->stable[hash % KSM_HASH_BUCKETS]; kp; kp = kp->next) {
+        if (kp->hash == hash && memcmp(kp->data, data, PAGE_SIZE) == 0) return kp;
+    }
+    return NULL;
+}
+
+static ksm_page_t* stable_insert(ksm_t* ksm, uint32_t hash, const uint8_t* data) {
+    void* mem;
+    if (posix_memalign(&mem, PAGE_SIZE, sizeof(ksm_page_t)) != 0) return NULL;
+
+    ksm_page_t* kp = mem;
+    memcpy(kp->data, data, PAGE_SIZE);
+    kp->refcount = 0;
+    kp->hash = hash;
+    kp->next = ksm->stable[hash % KSM_HASH_BUCKETS];
+    ksm->stable[hash % KSM_HASH_BUCKETS] = kp;
+    return kp;
+}
+
+/* Free merged pages every guest has written away from */
+static void stable_sweep(ksm_t* ksm) {
+    for (uint32_t b = 0; b < KSM_HASH_BUCKETS; b++) {
+        ksm_page_t** link = &ksm->stable[b];
+        while (*link) {
+            ksm_page_t* kp = *link;
+            if (__atomic_load_n(&kp->refcount, __ATOMIC_ACQUIRE) == 0) {
+                *link = kp->next;
+                free(kp);
+            } else {
+                link = &kp->next;
+            }
+        }
+    }
+}
+
+/* ============ UNSTABLE CANDIDATES ============ */
+
+static void candidates_reset(ksm_t* ksm) {
+    ksm->nr_candidates = 0;
+    memset(ksm->unstable, 0xFF, sizeof(ksm->unstable));
+}
+
+static void candidate_add(ksm_t* ksm, uint32_t guest_id, uint32_t page, uint32_t hash) {
+    if (ksm->nr_candidates == ksm->candidate_capacity) {
+        uint32_t capacity = ksm->candidate_capacity ? ksm->candidate_capacity * 2 : 1024;
+        ksm_candidate_t* grown = realloc(ksm->candidates, capacity * sizeof(ksm_candidate_t));
+        if (!grown) return;
+        ksm->candidates = grown;
+        ksm->candidate_capacity = capacity;
+    }
+    uint32_t index = ksm->nr_candidates++;
+    ksm_candidate_t* c = &ksm->candidates[index];
+    c->guest_id = guest_id;
+    c->page = page;
+    c->hash = hash;
+    c->next = ksm->unstable[hash % KSM_HASH_BUCKETS];
+    ksm->unstable[hash % KSM_HASH_BUCKETS] = index;
+}
+
+/* Merge with an earlier page of the same contents; true if merged */
+static bool candidate_merge(ksm_t* ksm, guest_vm_t* guest, uint32_t page, uint32_t hash) {
+    const uint8_t* data = guest->ept[page].host_page;
+
+    for (uint32_t i = ksm->unstable[hash % KSM_HASH_BUCKETS]; i != KSM_NO_CANDIDATE;
+         i = ksm->candidates[i].next) {
+        ksm_candidate_t* c = &ksm->candidates[i];
+        if (c->guest_id == KSM_NO_CANDIDATE || c->hash != hash) continue;
+        if (c->guest_id == guest->vm_id && c->page == page) return false;
+
+        /* Never block on a second guest: its runner may be waiting for ours */
+        guest_vm_t* other = &ksm->hv->guests[c->guest_id];
+        if (other != guest && pthread_mutex_trylock(&other->mem_lock) != 0) continue;
+
+        bool merged = false;
+        if (guest_memory_is_private(other, c->page) &&
+            memcmp(other->ept[c->page].host_page, data, PAGE_SIZE) == 0) {
+            ksm_page_t* kp = stable_insert(ksm, hash, data);
+            if (kp) {
+                kp->refcount = 2;
+                map_shared(other, c->page, kp);
+                map_shared(guest, page, kp);
+                c->guest_id = KSM_NO_CANDIDATE;
+                merged = true;
+            }
+        }
+
+        if (other != guest) pthread_mutex_unlock(&other->mem_lock);
+        if (merged) return true;
+    }
+    return false;
+}
+
+/* ============ SCANNER ============ */
+
+static void scan_page(ksm_t* ksm, guest_vm_t* guest, uint32_t page, uint32_t* checksums) {
+    const uint8_t* data = guest->ept[page].host_page;
+    uint32_t hash = ksm_page_hash(data);
+    ksm->stats.pages_scanned++;
+
+    if (hash == ksm->zero_hash && memcmp(data, guest_memory_zero_page(), PAGE_SIZE) == 0) {
+        guest_memory_discard(guest, page);
+        ksm->stats.pages_zeroed++;
+        return;
+    }
+
+    /* Only pages unchanged since the previous pass are worth merging */
+    if (checksums[page] != hash) {
+        checksums[page] = hash;
+        return;
+    }
+
+    ksm_page_t* kp = stable_lookup(ksm, hash, data);
+    if (kp) {
+        __atomic_add_fetch(&kp->refcount, 1, __ATOMIC_ACQ_REL);
+        map_shared(guest, page, kp);
+        return;
+    }
+
+    if (!candidate_merge(ksm, guest, page, hash)) {
+        candidate_add(ksm, guest->vm_id, page, hash);
+    }
+}
+
+static void end_full_scan(ksm_t* ksm) {
+    ksm->stats.full_scans++;
+    candidates_reset(ksm);
+    stable_sweep(ksm);
+}
+
+/* Examine up to budget private pages, resuming where the last batch stopped */
+static void scan_batch(ksm_t* ksm, uint32_t budget) {
+    hypervisor_t* hv = ksm->hv;
+    uint32_t guest_count = __atomic_load_n(&hv->guest_count, __ATOMIC_ACQUIRE);
+    if (guest_count == 0) return;
+
+    uint32_t scanned = 0;
+    uint32_t guests_visited = 0;
+    while (scanned < budget && guests_visited <= guest_count) {
+        if (ksm->cursor_guest >= guest_count) {
+            end_full_scan(ksm);
+            ksm->cursor_guest = 0;
+            ksm->cursor_page = 0;
+        }
+
+        guest_vm_t* guest = &hv->guests[ksm->cursor_guest];
+        if (guest->vm != guest) {
+            /* Secondary vCPU: its memory is scanned through the boot vCPU */
+            ksm->cursor_guest++;
+            guests_visited++;
+            continue;
+        }
+        pthread_mutex_lock(&guest->mem_lock);
+
+        uint32_t nr_pages = guest->memory_size / PAGE_SIZE;
+        uint32_t** checksums = &ksm->checksums[ksm->cursor_guest];
+        if (!*checksums && nr_pages > 0) *checksums = calloc(nr_pages, sizeof(uint32_t));
+
+        while (*checksums && ksm->cursor_page < nr_pages && scanned < budget) {
+            uint32_t page = ksm->cursor_page++;
+            if (!guest_memory_is_private(guest, page)) continue;
+            scan_page(ksm, guest, page, *checksums);
+            scanned++;
+        }
+        pthread_mutex_unlock(&guest->mem_lock);
+
+        if (ksm->cursor_page >= nr_pages || !*checksums) {
+            ksm->cursor_guest++;
+            ksm->cursor_page = 0;
+            guests_visited++;
+        }
+    }
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void* ksm_thread(void* arg) {
+    ksm_t* ksm = arg;
+
+    pthread_mutex_lock(&ksm->lock);
+    while (ksm->running) {
+        uint64_t start = thread_cpu_ns();
+        scan_batch(ksm, ksm->pages_to_scan);
+        ksm->stats.scan_ns += thread_cpu_ns() - start;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = (uint64_t)deadline.tv_nsec + (uint64_t)ksm->sleep_ms * 1000000ULL;
+        deadline.tv_sec += (time_t)(ns / 1000000000ULL);
+        deadline.tv_nsec = (long)(ns % 1000000000ULL);
+        while (ksm->running &&
+               pthread_cond_timedwait(&ksm->wake, &ksm->lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&ksm->lock);
+    return NULL;
+}
+
+/* ============ KSM API ============ */
+
+bool hypervisor_ksm_start(hypervisor_t* hv, uint32_t pages_to_scan, uint32_t sleep_ms) {
+    if (pages_to_scan == 0) pages_to_scan = KSM_DEFAULT_PAGES_TO_SCAN;
+
+    ksm_t* ksm = hv->ksm;
+    if (ksm && ksm->running) {
+        pthread_mutex_lock(&ksm->lock);
+        ksm->pages_to_scan = pages_to_scan;
+        ksm->sleep_ms = sleep_ms;
+        pthread_cond_signal(&ksm->wake);
+        pthread_mutex_unlock(&ksm->lock);
+        return true;
+    }
+
+    if (!ksm) {
+        ksm = calloc(1, sizeof(ksm_t));
+        if (!ksm) return false;
+        ksm->checksums = calloc(MAX_GUESTS, sizeof(uint32_t*));
+        if (!ksm->checksums) {
+            free(ksm);
+            return false;
+        }
+        ksm->hv = hv;
+        ksm->zero_hash = ksm_page_hash(guest_memory_zero_page());
+        pthread_mutex_init(&ksm->lock, NULL);
+        pthread_cond_init(&ksm->wake, NULL);
+        candidates_reset(ksm);
+        hv->ksm = ksm;
+    }
+
+    ksm->pages_to_scan = pages_to_scan;
+    ksm->sleep_ms = sleep_ms;
+    ksm->running = true;
+    if (pthread_create(&ksm->thread, NULL, ksm_thread, ksm) != 0) {
+        ksm->running = false;
+        hypervisor_log(hv, VISA_LOG_ERROR, "[KSM] Failed to start scanner thread\n");
+        return false;
+    }
+    placement_pin_helper(hv, ksm->thread);
+
+    hypervisor_log(hv, VISA_LOG_INFO, "[KSM] Scanner started (%u pages every %u ms)\n", pages_to_scan, sleep_ms);
+    return true;
+}
+
+void hypervisor_ksm_stop(hypervisor_t* hv) {
+    ksm_t* ksm = hv->ksm;
+    if (!ksm || !ksm->running) return;
+
+    pthread_mutex_lock(&ksm->lock);
+    ksm->running = false;
+    pthread_cond_signal(&ksm->wake);
+    pthread_mutex_unlock(&ksm->lock);
+    pthread_join(ksm->thread, NULL);
+}
+
+/* Merged pages stay mapped after the scanner stops; free them once guest
+   memory is gone */
+void ksm_destroy(ksm_t* ksm) {
+    if (!ksm) return;
+    for (uint32_t b = 0; b < KSM_HASH_BUCKETS; b++) {
+        ksm_page_t* kp = ksm->stable[b];
+        while (kp) {
+            ksm_page_t* next = kp->next;
+            free(kp);
+            kp = next;
+        }
+    }
+    for (uint32_t i = 0; i < MAX_GUESTS; i++) free(ksm->checksums[i]);
+    free(ksm->checksums);
+    free(ksm->candidates);
+    pthread_cond_destroy(&ksm->wake);
+    pthread_mutex_destroy(&ksm->lock);
+    free(ksm);
+}
+
+void hypervisor_ksm_stats(hypervisor_t* hv, ksm_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    ksm_t* ksm = hv->ksm;
+    if (!ksm) return;
+
+    pthread_mutex_lock(&ksm->lock);
+    *stats = ksm->stats;
+    for (uint32_t b = 0; b < KSM_HASH_BUCKETS; b++) {
+        for (ksm_page_t* kp = ksm->stable[b]; kp; kp = kp->next) {
+            uint32_t refs = __atomic_load_n(&kp->refcount, __ATOMIC_ACQUIRE);
+            if (refs == 0) continue;
+            stats->pages_shared++;
+            stats->pages_sharing += refs;
+        }
+    }
+    pthread_mutex_unlock(&ksm->lock);
+
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        stats->cow_breaks += __atomic_load_n(&hv->guests[i].cow_breaks, __ATOMIC_RELAXED);
+    }
+    stats->bytes_saved = (stats->pages_sharing - stats->pages_shared) * PAGE_SIZE;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ HOST OUTPUT ============ */
+
+/* Errors are always formatted so that visa_last_error can report them */
+bool hypervisor_log_enabled(const hypervisor_t* hv, visa_log_level_t level) {
+    return hv->stdio || level == VISA_LOG_ERROR || (hv->config.log && level >= hv->config.log_level);
+}
+
+void hypervisor_log(hypervisor_t* hv, visa_log_level_t level, const char* fmt, ...) {
+    if (!hypervisor_log_enabled(hv, level)) return;
+
+    char text[LOG_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(text)) text[sizeof(text) - 2] = '\n';  /* Truncated: keep it a whole line */
+
+    if (level == VISA_LOG_ERROR) {
+        const char* start = text + strspn(text, "\n");
+        size_t length = strcspn(start, "\n");
+        memcpy(hv->last_error, start, length);
+        hv->last_error[length] = '\0';
+    }
+
+    if (hv->stdio) {
+        fputs(text, level == VISA_LOG_ERROR ? stderr : stdout);
+    } else if (hv->config.log && level >= hv->config.log_level) {
+        hv->config.log(hv->config.user, level, text);
+    }
+}
+
+void log_append(log_line_t* line, const char* fmt, ...) {
+    size_t room = sizeof(line->text) - line->length;
+    if (room <= 1) return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line->text + line->length, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) line->length += (size_t)n < room ? (size_t)n : room - 1;
+}
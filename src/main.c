@@ -1,12 +1,179 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../include/isa.h"
+#include "../include/assembler.h"
+
+#define MAX_DEVICE_OPTIONS 8
+
+static void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <guest.bin|.isa|.vobj> [[options] guest2 ...]\n", prog);
+    fprintf(stderr, "Example: %s examples/programs/test.bin\n", prog);
+    fprintf(stderr, "\nOptions (per-guest options apply to the guest images that follow):\n");
+    fprintf(stderr, "  --trace             Print every executed guest instruction\n");
+    fprintf(stderr, "  --no-verify         Run the code of the following guests with every operand checked\n");
+    fprintf(stderr, "  --spmd              Run guests with identical images in lockstep batches\n");
+    fprintf(stderr, "  --quantum=N         Preempt after N instructions (0 = unlimited, default %u)\n",
+            DEFAULT_TIME_QUANTUM);
+    fprintf(stderr, "  --quantum-us=N      Preempt after N microseconds of wall-clock time (0 = off)\n");
+    fprintf(stderr, "  --sched=rr|fair     Scheduling policy (default rr)\n");
+    fprintf(stderr, "  --weight=N          Fair-share weight (default %u)\n", SCHED_DEFAULT_WEIGHT);
+    fprintf(stderr, "  --cap=PCT           Cap guest at PCT%% of a host CPU (0 = uncapped)\n");
+    fprintf(stderr, "  --trap=LIST         Events that exit to the hypervisor: priv,cr,io,pf, none or\n"
+                    "                      a mask (default priv); the rest are emulated inline\n");
+    fprintf(stderr, "  --vcpus=N           Virtual CPUs sharing the guest's memory (default 1, max %u)\n",
+            MAX_VCPUS);
+    fprintf(stderr, "  --mem=SIZE[K|M|G]   Guest physical memory (default %u KB, max %u MB)\n",
+            GUEST_PHYS_MEMORY_SIZE / 1024, GUEST_MAX_MEMORY_SIZE >> 20);
+    fprintf(stderr, "  --ksm[=PAGES[,MS]]  Merge identical guest pages, scanning PAGES every MS\n"
+                    "                      milliseconds (default %u,%u)\n",
+            KSM_DEFAULT_PAGES_TO_SCAN, KSM_DEFAULT_SLEEP_MS);
+    fprintf(stderr, "  --compress[=MS[,PAGES]]\n"
+                    "                      Compress cold pages of guests idle for MS milliseconds,\n"
+                    "                      examining PAGES per batch (default %u,%u)\n",
+            COMPRESS_DEFAULT_IDLE_MS, COMPRESS_DEFAULT_PAGES);
+    fprintf(stderr, "  --cpus=LIST         Pin the execution thread to CPUs (e.g. 0-3,8)\n");
+    fprintf(stderr, "  --helper-cpus=LIST  Pin KSM, compressor and console threads started after this option\n");
+    fprintf(stderr, "  --node=N|auto       Home NUMA node for guest memory (auto = round-robin)\n");
+    fprintf(stderr, "  --thp               Back guest memory with transparent huge pages\n");
+    fprintf(stderr, "  --console[=PREFIX]  Buffer guest prints; write them to PREFIX<id>.log\n"
+                    "                      instead of tagged lines on stdout\n");
+    fprintf(stderr, "  --disk=FILE         Back HYPERCALL_DISK_READ/WRITE with a host file (empty = none)\n");
+    fprintf(stderr, "  --io-threads=N      Host threads for asynchronous disk I/O (default %u)\n",
+            IOPOOL_DEFAULT_THREADS);
+    fprintf(stderr, "  --device=NAME@ADDR  Map a device (uart, scratch) at a guest physical address;\n"
+                    "                      repeat for more, empty to clear\n");
+    fprintf(stderr, "  --bench-mmio        Time a load/store loop against RAM and against a device\n");
+    fprintf(stderr, "  --perf              Attribute host cycles, IPC and cache/branch misses to guests\n"
+                    "                      and phases (dispatch, translate, exit, sched)\n");
+    fprintf(stderr, "  --perf-opcodes[=N]  --perf plus per-opcode costs from 1 block in N (default %u)\n",
+            PERF_DEFAULT_SAMPLE_PERIOD);
+    fprintf(stderr, "  --record=FILE       Record nondeterministic inputs for offline replay\n");
+    fprintf(stderr, "  --replay=FILE       Re-execute a recording instead of loading images\n");
+}
+
+/* "64K", "512M", "1G" or plain bytes; returns false if out of range */
+static bool parse_memory_size(const char* text, uint32_t* size) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 0);
+    switch (*end) {
+        case 'k': case 'K': value <<= 10; end++; break;
+        case 'm': case 'M': value <<= 20; end++; break;
+        case 'g': case 'G': value <<= 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || value == 0 || value > GUEST_MAX_MEMORY_SIZE) return false;
+    *size = (uint32_t)value;
+    return true;
+}
+
+/* "priv,cr,io,pf", "none" or a vmtrapcfg mask */
+static bool parse_trap_config(const char* text, uint32_t* trap_config) {
+    static const struct { const char* name; uint32_t bit; } names[] = {
+        { "priv", VMTRAPCFG_PRIVILEGED_INSTR }, { "cr", VMTRAPCFG_CR_WRITE },
+        { "io", VMTRAPCFG_IO_INSTR },           { "pf", VMTRAPCFG_PAGE_FAULT },
+    };
+
+    char* end;
+    unsigned long value = strtoul(text, &end, 0);
+    if (end != text) {
+        if (*end != '\0' || value >= (1u << VMTRAPCFG_BITS)) return false;
+        *trap_config = (uint32_t)value;
+        return true;
+    }
+    if (strcmp(text, "none") == 0) {
+        *trap_config = 0;
+        return true;
+    }
+
+    uint32_t mask = 0;
+    while (*text) {
+        size_t len = strcspn(text, ",");
+        uint32_t n;
+        for (n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+            if (strlen(names[n].name) == len && strncmp(text, names[n].name, len) == 0) break;
+        }
+        if (n == sizeof(names) / sizeof(names[0])) return false;
+        mask |= names[n].bit;
+        text += len;
+        if (*text == ',') text++;
+    }
+    *trap_config = mask;
+    return true;
+}
+
+/* ============ MMIO BENCHMARK ============ */
+/* 2,000,000 iterations of load/add/store on the byte at 0x2000 */
+static const char mmio_bench_source[] =
+    "    movi r0, 0\n"
+    "    movi r1, 128\n"
+    "    muli r1, r1, 64\n"      /* r1 = 0x2000 */
+    "    movi r5, 40\n"
+    "OUTER:\n"
+    "    movi r2, 200\n"
+    "MIDDLE:\n"
+    "    movi r3, 250\n"
+    "INNER:\n"
+    "    load r4, r1\n"
+    "    addi r4, r4, 1\n"
+    "    store r1, r4\n"
+    "    subi r3, r3, 1\n"
+    "    jne INNER, r3, r0\n"
+    "    subi r2, r2, 1\n"
+    "    jne MIDDLE, r2, r0\n"
+    "    subi r5, r5, 1\n"
+    "    jne OUTER, r5, r0\n"
+    "    halt\n";
+
+#define MMIO_BENCH_ADDR 0x2000
+#define MMIO_BENCH_ACCESSES (2ULL * 40 * 200 * 250)
+
+/* Run the loop once with the byte in RAM or in a scratch device; returns the
+   ns per guest access, or a negative value on failure */
+static double mmio_bench_run(const vobj_image_t* image, bool device) {
+    hypervisor_t* hv = hypervisor_create();
+    if (!hv) return -1.0;
+
+    double result = -1.0;
+    uint32_t guest_id = hypervisor_create_guest_from_object(hv, image, 0);
+    if (guest_id != 0 && (!device || hypervisor_add_device(hv, guest_id, "scratch", MMIO_BENCH_ADDR))) {
+        hypervisor_set_quantum(hv, guest_id, 0, 0);  /* One slice: time the loop, not the scheduler */
+        uint64_t start = hypervisor_time_ns();
+        hypervisor_run(hv);
+        uint64_t elapsed = hypervisor_time_ns() - start;
+        result = (double)elapsed / (double)MMIO_BENCH_ACCESSES;
+        if (device) hypervisor_mmio_report(hv);
+    }
+    hypervisor_destroy(hv);
+    return result;
+}
+
+static int mmio_bench(void) {
+    vobj_image_t image;
+    char error[256];
+    if (!visa_assemble(mmio_bench_source, &image, error, sizeof(error))) {
+        fprintf(stderr, "[MMIO] Benchmark does not assemble: %s\n", error);
+        return 1;
+    }
+
+    double ram = mmio_bench_run(&image, false);
+    double mmio = mmio_bench_run(&image, true);
+    vobj_free(&image);
+    if (ram < 0 || mmio < 0) return 1;
+
+    printf("\n[MMIO] %llu accesses at 0x%X: RAM %.2f ns, MMIO %.2f ns per access (%.1fx)\n",
+           MMIO_BENCH_ACCESSES, MMIO_BENCH_ADDR, ram, mmio, mmio / ram);
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <guest_image.bin> [guest2.bin ...]\n", argv[0]);
-        fprintf(stderr, "Example: %s examples/programs/test.bin\n", argv[0]);
+        print_usage(argv[0]);
         return 1;
     }
+    if (argc == 2 && strcmp(argv[1], "--bench-mmio") == 0) {
+        return mmio_bench();
+    }
 
     printf("======================================\n");
     printf("  vISA Hypervisor (ISA-Based)\n");
@@ -20,237 +187,271 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    /* Load guest VMs */
+    /* Load guest VMs, applying the most recent per-guest options to each */
+    uint32_t quantum_instructions = DEFAULT_TIME_QUANTUM;
+    uint64_t quantum_ns = 0;
+    uint32_t weight = SCHED_DEFAULT_WEIGHT;
+    uint32_t cpu_cap = 0;
+    uint32_t trap_config = VMTRAPCFG_DEFAULT;
+    uint32_t memory_size = GUEST_PHYS_MEMORY_SIZE;
+    uint32_t nr_vcpus = 1;
+    const char* disk_path = NULL;
+    const char* device_names[MAX_DEVICE_OPTIONS];
+    uint32_t device_addrs[MAX_DEVICE_OPTIONS];
+    uint32_t nr_devices = 0;
+    const char* record_path = NULL;
+    bool placed = false;
+    const char* replay_path = NULL;
+
     for (int i = 1; i < argc; i++) {
-        uint32_t guest_id = hypervisor_create_guest(hv, argv[i]);
+        if (strcmp(argv[i], "--trace") == 0) {
+            hv->trace = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--no-verify") == 0) {
+            hv->verify = false;
+            continue;
+        }
+        if (strcmp(argv[i], "--spmd") == 0) {
+            hv->spmd = true;
+            continue;
+        }
+        if (strncmp(argv[i], "--quantum=", 10) == 0) {
+            quantum_instructions = (uint32_t)strtoul(argv[i] + 10, NULL, 0);
+            continue;
+        }
+        if (strncmp(argv[i], "--quantum-us=", 13) == 0) {
+            quantum_ns = strtoull(argv[i] + 13, NULL, 0) * 1000ULL;
+            continue;
+        }
+        if (strcmp(argv[i], "--sched=rr") == 0 || strcmp(argv[i], "--sched=fair") == 0) {
+            hypervisor_set_scheduler(hv, strcmp(argv[i], "--sched=fair") == 0
+                                         ? SCHED_POLICY_FAIR_SHARE : SCHED_POLICY_ROUND_ROBIN);
+            continue;
+        }
+        if (strncmp(argv[i], "--weight=", 9) == 0) {
+            weight = (uint32_t)strtoul(argv[i] + 9, NULL, 0);
+            continue;
+        }
+        if (strncmp(argv[i], "--trap=", 7) == 0) {
+            if (!parse_trap_config(argv[i] + 7, &trap_config)) {
+                fprintf(stderr, "[ERROR] Invalid trap list %s\n", argv[i] + 7);
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], "--cap=", 6) == 0) {
+            cpu_cap = (uint32_t)strtoul(argv[i] + 6, NULL, 0);
+            continue;
+        }
+        if (strcmp(argv[i], "--ksm") == 0 || strncmp(argv[i], "--ksm=", 6) == 0) {
+            char* end = argv[i] + 5;
+            uint32_t pages = KSM_DEFAULT_PAGES_TO_SCAN;
+            uint32_t sleep_ms = KSM_DEFAULT_SLEEP_MS;
+            if (*end == '=') {
+                pages = (uint32_t)strtoul(end + 1, &end, 0);
+                if (*end == ',') sleep_ms = (uint32_t)strtoul(end + 1, NULL, 0);
+            }
+            hypervisor_ksm_start(hv, pages, sleep_ms);
+            continue;
+        }
+        if (strcmp(argv[i], "--compress") == 0 || strncmp(argv[i], "--compress=", 11) == 0) {
+            char* end = argv[i] + 10;
+            uint32_t idle_ms = COMPRESS_DEFAULT_IDLE_MS;
+            uint32_t pages = COMPRESS_DEFAULT_PAGES;
+            if (*end == '=') {
+                idle_ms = (uint32_t)strtoul(end + 1, &end, 0);
+                if (*end == ',') pages = (uint32_t)strtoul(end + 1, NULL, 0);
+            }
+            hypervisor_compress_start(hv, idle_ms, pages);
+            continue;
+        }
+        if (strncmp(argv[i], "--vcpus=", 8) == 0) {
+            nr_vcpus = (uint32_t)strtoul(argv[i] + 8, NULL, 0);
+            continue;
+        }
+        if (strncmp(argv[i], "--mem=", 6) == 0) {
+            if (!parse_memory_size(argv[i] + 6, &memory_size)) {
+                fprintf(stderr, "[ERROR] Invalid guest memory size %s\n", argv[i] + 6);
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], "--cpus=", 7) == 0 || strncmp(argv[i], "--helper-cpus=", 14) == 0) {
+            bool helper = argv[i][2] == 'h';
+            cpu_set_t cpus;
+            if (!placement_parse_cpus(strchr(argv[i], '=') + 1, &cpus) ||
+                (!helper && !hypervisor_pin_worker(hv, &cpus))) {
+                fprintf(stderr, "[ERROR] Invalid CPU list %s\n", argv[i]);
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            if (helper) {
+                hv->placement.helper_cpus = cpus;
+                hv->placement.helpers_pinned = true;
+            }
+            placed = true;
+            continue;
+        }
+        if (strncmp(argv[i], "--node=", 7) == 0) {
+            char* end;
+            long node = strtol(argv[i] + 7, &end, 10);
+            if (strcmp(argv[i] + 7, "auto") == 0) {
+                hv->placement.guest_node = PLACEMENT_NODE_AUTO;
+            } else if (*end == '\0' && end != argv[i] + 7 && node >= 0 &&
+                       node < (long)hv->placement.nr_nodes) {
+                hv->placement.guest_node = (int32_t)node;
+            } else {
+                fprintf(stderr, "[ERROR] Invalid NUMA node %s (host has %u)\n",
+                        argv[i] + 7, hv->placement.nr_nodes);
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            placed = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--thp") == 0) {
+            hv->placement.huge_pages = true;
+            placed = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--console") == 0 || strncmp(argv[i], "--console=", 10) == 0) {
+            if (!hypervisor_console_start(hv, argv[i][9] == '=' ? argv[i] + 10 : NULL)) {
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], "--disk=", 7) == 0) {
+            disk_path = argv[i][7] ? argv[i] + 7 : NULL;  /* "--disk=" detaches */
+            continue;
+        }
+        if (strncmp(argv[i], "--device=", 9) == 0) {
+            if (argv[i][9] == '\0') {  /* "--device=" clears the list */
+                nr_devices = 0;
+                continue;
+            }
+            char* at = strchr(argv[i] + 9, '@');
+            char* end = NULL;
+            uint32_t addr = 0;
+            if (at) {
+                *at = '\0';
+                addr = (uint32_t)strtoul(at + 1, &end, 0);
+            }
+            if (!at || end == at + 1 || *end != '\0' || !mmio_device_lookup(argv[i] + 9) ||
+                nr_devices == MAX_DEVICE_OPTIONS) {
+                fprintf(stderr, "[ERROR] Bad or too many --device options (NAME@ADDR, NAME = uart or scratch)\n");
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            device_addrs[nr_devices] = addr;
+            device_names[nr_devices++] = argv[i] + 9;
+            continue;
+        }
+        if (strncmp(argv[i], "--io-threads=", 13) == 0) {
+            if (!hypervisor_iopool_start(hv, (uint32_t)strtoul(argv[i] + 13, NULL, 0))) {
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--perf") == 0) {
+            if (!hypervisor_perf_start(hv, 0)) {
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--perf-opcodes") == 0 || strncmp(argv[i], "--perf-opcodes=", 15) == 0) {
+            uint32_t period = argv[i][14] == '=' ? (uint32_t)strtoul(argv[i] + 15, NULL, 0) : 0;
+            if (!hypervisor_perf_start(hv, period ? period : PERF_DEFAULT_SAMPLE_PERIOD)) {
+                hypervisor_destroy(hv);
+                return 1;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], "--record=", 9) == 0) {
+            record_path = argv[i] + 9;
+            continue;
+        }
+        if (strncmp(argv[i], "--replay=", 9) == 0) {
+            replay_path = argv[i] + 9;
+            continue;
+        }
+        if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "[ERROR] Unknown option %s\n", argv[i]);
+            print_usage(argv[0]);
+            hypervisor_destroy(hv);
+            return 1;
+        }
+
+        uint32_t guest_id = hypervisor_create_guest_sized(hv, argv[i], memory_size);
         if (guest_id == 0) {
             fprintf(stderr, "[ERROR] Failed to create guest from %s\n", argv[i]);
             hypervisor_destroy(hv);
             return 1;
         }
+        if ((disk_path && !hypervisor_attach_disk(hv, guest_id, disk_path)) ||
+            (nr_vcpus != 1 && !hypervisor_set_vcpus(hv, guest_id, nr_vcpus))) {
+            hypervisor_destroy(hv);
+            return 1;
+        }
+        for (uint32_t d = 0; d < nr_devices; d++) {
+            if (!hypervisor_add_device(hv, guest_id, device_names[d], device_addrs[d])) {
+                hypervisor_destroy(hv);
+                return 1;
+            }
+        }
+        /* Every vCPU is scheduled on its own */
+        for (uint32_t id = guest_id; id <= hv->guest_count; id++) {
+            hypervisor_set_quantum(hv, id, quantum_instructions, quantum_ns);
+            hypervisor_set_sched_params(hv, id, weight, cpu_cap);
+            hypervisor_set_trap_config(hv, id, trap_config);
+        }
     }
 
-    printf("\n");
-
-    /* Run guests with round-robin scheduling (time-sliced) */
-    printf("[SCHEDULER] Starting time-sliced execution (2 instructions per slice)\n\n");
-    
-    uint32_t total_ticks = 0;
-    bool all_stopped = false;
-    
-    int max_ticks = 1000;  // Add safety limit
-    while (!all_stopped && total_ticks < max_ticks) {
-        all_stopped = true;
-        
-        for (uint32_t i = 1; i <= hv->guest_count; i++) {
-            guest_vm_t* guest = &hv->guests[i - 1];
-            
-            if (guest->vcpu.state != GUEST_STOPPED) {
-                all_stopped = false;
-                printf("[TICK %u] Running Guest VM %u time slice...\n", total_ticks, guest->vm_id);
-                
-                /* Run single time slice for this guest */
-                const int TIME_SLICE = 2;
-                int slice_count = 0;
-                
-                if (guest->vcpu.state == GUEST_STOPPED) {
-                    isa_vmenter(hv, &guest->vcpu.vmcs);
-                }
-                
-                while (guest->vcpu.state == GUEST_RUNNING && slice_count < TIME_SLICE) {
-                    uint32_t guest_virt_addr = guest->vcpu.pc;
-                    uint32_t guest_phys_addr = guest_translate_address(guest, guest_virt_addr);
-
-                    if (guest_phys_addr == 0xFFFFFFFF) {
-                        hv->mode = MODE_HOST;
-                        guest->vcpu.state = GUEST_BLOCKED;
-                        guest->vcpu.last_exit_cause = VMCAUSE_PAGE_FAULT;
-                        break;
-                    }
-
-                    /* Fetch one instruction */
-                    instruction_t instr;
-                    instr.opcode = guest->guest_memory[guest_phys_addr];
-                    instr.rd = guest->guest_memory[guest_phys_addr + 1];
-                    instr.rs1 = guest->guest_memory[guest_phys_addr + 2];
-                    instr.rs2 = guest->guest_memory[guest_phys_addr + 3];
-                    
-                    /* Print instruction before execution */
-                    const char* op_name = "???";
-                    switch(instr.opcode) {
-                        case 0x01: op_name = "ADD"; break;
-                        case 0x02: op_name = "SUB"; break;
-                        case 0x03: op_name = "MUL"; break;
-                        case 0x04: op_name = "DIV"; break;
-                        case 0x05: op_name = "MOV"; break;
-                        case 0x06: op_name = "LOAD"; break;
-                        case 0x07: op_name = "STORE"; break;
-                        case 0x08: op_name = "JMP"; break;
-                        case 0x09: op_name = "JEQ"; break;
-                        case 0x0A: op_name = "JNE"; break;
-                        case 0x0B: op_name = "CALL"; break;
-                        case 0x0C: op_name = "RET"; break;
-                        case 0x0D: op_name = "MOVI"; break;
-                        case 0x0E: op_name = "ADDI"; break;
-                        case 0x0F: op_name = "SUBI"; break;
-                        case 0x10: op_name = "MULI"; break;
-                        case 0x11: op_name = "DIVI"; break;
-                        case 0xFF: op_name = "HALT"; break;
-                    }
-                    printf("    [G%u:0x%02X] %s r%u r%u r%u\n", guest->vm_id, guest->vcpu.pc, 
-                           op_name, instr.rd, instr.rs1, instr.rs2);
-                    
-                    guest->vcpu.pc += INSTRUCTION_SIZE;
-                    slice_count++;
-                    guest->instruction_count++;
-                    
-                    /* Execute instruction */
-                    switch (instr.opcode) {
-                        case OP_ADD:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = 
-                                    guest->vcpu.registers[instr.rs1] + guest->vcpu.registers[instr.rs2];
-                            }
-                            break;
-
-                        case OP_SUB:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = 
-                                    guest->vcpu.registers[instr.rs1] - guest->vcpu.registers[instr.rs2];
-                            }
-                            break;
-
-                        case OP_MUL:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = 
-                                    guest->vcpu.registers[instr.rs1] * guest->vcpu.registers[instr.rs2];
-                            }
-                            break;
-
-                        case OP_DIV:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                                if (guest->vcpu.registers[instr.rs2] != 0) {
-                                    guest->vcpu.registers[instr.rd] = 
-                                        guest->vcpu.registers[instr.rs1] / guest->vcpu.registers[instr.rs2];
-                                }
-                            }
-                            break;
-
-                        case OP_MOV:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = guest->vcpu.registers[instr.rs1];
-                            }
-                            break;
-
-                        case OP_LOAD:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                                uint32_t addr = guest_translate_address(guest, guest->vcpu.registers[instr.rs1]);
-                                if (addr != 0xFFFFFFFF) {
-                                    guest->vcpu.registers[instr.rd] = guest->guest_memory[addr];
-                                }
-                            }
-                            break;
-
-                        case OP_STORE:
-                            if (instr.rs1 < REGISTER_COUNT && instr.rs2 < REGISTER_COUNT) {
-                                uint32_t addr = guest_translate_address(guest, guest->vcpu.registers[instr.rs1]);
-                                if (addr != 0xFFFFFFFF) {
-                                    guest->guest_memory[addr] = guest->vcpu.registers[instr.rs2];
-                                }
-                            }
-                            break;
-
-                        /* ============ IMMEDIATE INSTRUCTIONS ============ */
-                        case OP_MOVI:
-                            if (instr.rd < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = (uint32_t)instr.rs2;
-                            }
-                            break;
-
-                        case OP_ADDI:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = 
-                                    guest->vcpu.registers[instr.rs1] + (uint32_t)instr.rs2;
-                            }
-                            break;
-
-                        case OP_SUBI:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = 
-                                    guest->vcpu.registers[instr.rs1] - (uint32_t)instr.rs2;
-                            }
-                            break;
-
-                        case OP_MULI:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                                guest->vcpu.registers[instr.rd] = 
-                                    guest->vcpu.registers[instr.rs1] * (uint32_t)instr.rs2;
-                            }
-                            break;
-
-                        case OP_DIVI:
-                            if (instr.rd < REGISTER_COUNT && instr.rs1 < REGISTER_COUNT) {
-                                if (instr.rs2 != 0) {
-                                    guest->vcpu.registers[instr.rd] = 
-                                        guest->vcpu.registers[instr.rs1] / (uint32_t)instr.rs2;
-                                }
-                            }
-                            break;
-
-                        case OP_CALL:
-                            if (guest->vcpu.sp > 3) {
-                                // Save return address (current PC which is already at next instruction)
-                                uint32_t return_addr = guest->vcpu.pc;
-                                guest->guest_memory[guest->vcpu.sp - 3] = (return_addr >> 24) & 0xFF;
-                                guest->guest_memory[guest->vcpu.sp - 2] = (return_addr >> 16) & 0xFF;
-                                guest->guest_memory[guest->vcpu.sp - 1] = (return_addr >> 8) & 0xFF;
-                                guest->guest_memory[guest->vcpu.sp] = return_addr & 0xFF;
-                                guest->vcpu.sp -= 4;
-                                
-                                // Jump to function address in rd (instruction address, not byte address)
-                                if (instr.rd != 0) {
-                                    guest->vcpu.pc = instr.rd * INSTRUCTION_SIZE;
-                                } else if (instr.rs1 < REGISTER_COUNT) {
-                                    guest->vcpu.pc = guest->vcpu.registers[instr.rs1];
-                                }
-                            }
-                            break;
+    if (replay_path) {
+        if (hv->guest_count != 0 || record_path) {
+            fprintf(stderr, "[ERROR] --replay takes no guest images and cannot be recorded\n");
+            hypervisor_destroy(hv);
+            return 1;
+        }
+        bool replayed = hypervisor_replay(hv, replay_path);
+        hypervisor_dump_state(hv);
+        hypervisor_mmio_report(hv);
+        hypervisor_destroy(hv);
+        return replayed ? 0 : 1;
+    }
 
-                        case OP_RET:
-                            if (guest->vcpu.sp + 4 <= GUEST_PHYS_MEMORY_SIZE) {
-                                // Restore 32-bit return address from stack
-                                // We saved at: SP-3, SP-2, SP-1, SP (before SP -= 4)
-                                // Now SP points to old (SP-4), so old SP = current SP + 4
-                                uint32_t saved_sp = guest->vcpu.sp + 4;  // Reconstruct original SP
-                                guest->vcpu.pc = ((uint32_t)guest->guest_memory[saved_sp - 3] << 24) |
-                                                ((uint32_t)guest->guest_memory[saved_sp - 2] << 16) |
-                                                ((uint32_t)guest->guest_memory[saved_sp - 1] << 8) |
-                                                ((uint32_t)guest->guest_memory[saved_sp]);
-                                guest->vcpu.sp += 4;
-                            }
-                            break;
+    if (hv->guest_count == 0) {
+        fprintf(stderr, "[ERROR] No guest images given\n");
+        hypervisor_destroy(hv);
+        return 1;
+    }
 
-                        case OP_HALT:
-                            guest->vcpu.state = GUEST_STOPPED;
-                            hv->mode = MODE_HOST;
-                            break;
+    printf("\n");
 
-                        default:
-                            break;
-                    }
-                }
-                
-                printf("  [Guest %u completed %d instructions this slice, total: %u]\n", 
-                       guest->vm_id, slice_count, guest->instruction_count);
-                total_ticks++;
-            }
-        }
+    if (record_path && !hypervisor_record_start(hv, record_path)) {
+        hypervisor_destroy(hv);
+        return 1;
     }
-    
-    printf("\n[SCHEDULER] All guests stopped after %u scheduling rounds\n\n", total_ticks);
+
+    /* Run guests until all stop; each slice ends on a VMEXIT or when the
+       guest's quantum expires at a basic-block boundary */
+    hypervisor_run(hv);
+    hypervisor_console_stop(hv);
+    hypervisor_iopool_stop(hv);
 
     /* Final state */
     hypervisor_dump_state(hv);
+    hypervisor_memory_report(hv);
+    hypervisor_mmio_report(hv);
+    hypervisor_grant_report(hv);
+    if (placed) hypervisor_placement_report(hv);
+    hypervisor_perf_report(hv);
+    hypervisor_record_stop(hv);
 
     hypervisor_destroy(hv);
     return 0;
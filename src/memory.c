@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../include/isa.h"
+
+/* ============ SHARED ZERO PAGE ============ */
+/* Backs every guest page that has never been written. EPT entries pointing here
+   are never writable, so guest writes always fault before reaching it. */
+static uint8_t zero_page[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+const uint8_t* guest_memory_zero_page(void) {
+    return zero_page;
+}
+
+/* ============ GUEST MEMORY SETUP ============ */
+
+bool guest_memory_init(guest_vm_t* guest, uint32_t memory_size) {
+    if (memory_size == 0) memory_size = GUEST_PHYS_MEMORY_SIZE;
+    if (memory_size > GUEST_MAX_MEMORY_SIZE) {
+        hypervisor_log(guest->hv, VISA_LOG_ERROR, "[MEMORY] Guest memory %u MB exceeds the %u MB limit\n",
+                       memory_size >> 20, GUEST_MAX_MEMORY_SIZE >> 20);
+        return false;
+    }
+    memory_size = (memory_size + PAGE_SIZE - 1) & ~(uint32_t)(PAGE_SIZE - 1);
+    uint32_t nr_pages = memory_size / PAGE_SIZE;
+
+    /* Reserve address space only; the kernel commits pages on first write.
+       Large guests are aligned to the huge page size so they can use THP. */
+    size_t align = memory_size >= PLACEMENT_HUGE_PAGE_SIZE ? PLACEMENT_HUGE_PAGE_SIZE : 0;
+    uint8_t* base = mmap(NULL, memory_size + align, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        hypervisor_log(guest->hv, VISA_LOG_ERROR, "[MEMORY] Failed to reserve %u KB of guest memory\n",
+                       memory_size / 1024);
+        return false;
+    }
+    if (align) {
+        size_t head = (align - (uintptr_t)base % align) % align;
+        if (head) munmap(base, head);
+        munmap(base + head + memory_size, align - head);
+        base += head;
+    }
+
+    ept_entry_t* ept = malloc((size_t)nr_pages * sizeof(ept_entry_t));
+    uint32_t virt_size = memory_size > GUEST_VIRT_MEMORY_SIZE ? memory_size : GUEST_VIRT_MEMORY_SIZE;
+    uint32_t virt_pages = virt_size / PAGE_SIZE;
+    guest_page_table_entry_t* page_table = calloc(virt_pages, sizeof(guest_page_table_entry_t));
+    if (!ept || !page_table) {
+        free(ept);
+        free(page_table);
+        munmap(base, memory_size);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nr_pages; i++) {
+        ept[i].host_page = zero_page;
+        ept[i].host_physical_page = i;
+        ept[i].present = true;
+        ept[i].writable = false;
+        ept[i].code = false;
+        ept[i].shared = false;
+        ept[i].mmio = false;
+        ept[i].grant = false;
+        ept[i].verified = false;
+        ept[i].reverify = false;
+        ept[i].verify_writes = 0;
+    }
+
+    /* Guest page table maps VA→PA identity over physical memory */
+    for (uint32_t i = 0; i < nr_pages; i++) {
+        page_table[i].present = 1;
+        page_table[i].guest_physical_page = i;
+    }
+
+    guest->memory_base = base;
+    guest->memory_size = memory_size;
+    guest->ept = ept;
+    guest->resident_pages = 0;
+    guest->shared_pages = 0;
+    guest->cow_breaks = 0;
+    guest->compressed_pages = 0;
+    guest->compressed_bytes = 0;
+    guest->nr_code_pages = 0;
+    guest->verified_pages = 0;
+    guest->verify_runs = 0;
+    guest->verify_failures = 0;
+    guest->vcpu.guest_page_table = page_table;
+    guest->vcpu.guest_page_count = virt_pages;
+    return true;
+}
+
+void guest_memory_destroy(guest_vm_t* guest) {
+    for (uint32_t page = 0; guest->ept && page < guest->memory_size / PAGE_SIZE; page++) {
+        ept_entry_t* entry = &guest->ept[page];
+        if (!entry->present && !entry->mmio) free(entry->host_page);
+    }
+    if (guest->memory_base) munmap(guest->memory_base, guest->memory_size);
+    free(guest->ept);
+    free(guest->vcpu.guest_page_table);
+    guest->memory_base = NULL;
+    guest->ept = NULL;
+    guest->vcpu.guest_page_table = NULL;
+    guest->memory_size = 0;
+    guest->resident_pages = 0;
+}
+
+/* ============ DEMAND PAGING ============ */
+
+/* Write to a non-writable page: give it the guest's private backing page,
+   copying the old contents unless it was the zero page. Page counts are kept
+   on the VM's boot vCPU. */
+uint8_t* guest_memory_fault(guest_vm_t* guest, uint32_t page) {
+    guest = guest->vm;
+    ept_entry_t* entry = &guest->ept[page];
+    if (entry->mmio || entry->grant) return guest->hv->mmio_sink;
+    if (entry->verified) guest_verify_withdraw(guest, page);
+    if (!entry->present) return guest_memory_page_in(guest, page);
+    uint8_t* backing = guest->memory_base + (size_t)page * PAGE_SIZE;
+
+    if (entry->host_page != zero_page && entry->host_page != backing) {
+        memcpy(backing, entry->host_page, PAGE_SIZE);
+    }
+    if (entry->shared) {
+        /* Copy-on-write break of a merged page */
+        ksm_page_put(entry->host_page);
+        entry->shared = false;
+        guest->shared_pages--;
+        __atomic_add_fetch(&guest->cow_breaks, 1, __ATOMIC_RELAXED);
+    }
+    if (entry->host_page != backing) guest->resident_pages++;
+
+    entry->host_page = backing;
+    entry->writable = true;
+    return backing;
+}
+
+/* Hand a page's private backing back to the host; the EPT entry must already
+   point elsewhere */
+void guest_memory_release(guest_vm_t* guest, uint32_t page) {
+    madvise(guest->memory_base + (size_t)page * PAGE_SIZE, PAGE_SIZE, MADV_DONTNEED);
+    guest->resident_pages--;
+}
+
+/* Verified code is private too; it is only write-protected */
+bool guest_memory_is_private(const guest_vm_t* guest, uint32_t page) {
+    const ept_entry_t* entry = &guest->ept[page];
+    return (entry->writable || entry->verified) && !entry->grant &&
+           entry->host_page == guest->memory_base + (size_t)page * PAGE_SIZE;
+}
+
+void guest_memory_discard(guest_vm_t* guest, uint32_t page) {
+    ept_entry_t* entry = &guest->ept[page];
+    guest_verify_withdraw(guest, page);
+    entry->host_page = zero_page;
+    entry->writable = false;
+    guest_memory_release(guest, page);
+}
+
+/* Free whatever holds a page's contents before the entry is repointed */
+static void guest_memory_drop(guest_vm_t* guest, uint32_t page) {
+    ept_entry_t* entry = &guest->ept[page];
+    guest_verify_withdraw(guest, page);
+    if (!entry->present) {
+        compressed_page_t* blob = (compressed_page_t*)entry->host_page;
+        guest->compressed_pages--;
+        guest->compressed_bytes -= blob->size;
+        free(blob);
+    } else if (entry->shared) {
+        ksm_page_put(entry->host_page);
+        entry->shared = false;
+        guest->shared_pages--;
+    } else if (entry->host_page != zero_page) {
+        guest_memory_release(guest, page);
+    }
+}
+
+/* Give a page to the VM's devices: drop its RAM contents and leave it mapped
+   read-only to the zero page for every access that is not a LOAD or STORE */
+void guest_memory_map_mmio(guest_vm_t* guest, uint32_t page) {
+    guest = guest->vm;
+    ept_entry_t* entry = &guest->ept[page];
+    if (entry->mmio) return;
+
+    guest_memory_drop(guest, page);
+    entry->host_page = zero_page;
+    entry->present = false;
+    entry->writable = false;
+    entry->mmio = true;
+}
+
+/* ============ GRANTED PAGES ============ */
+
+/* Owner side: a lent page gets private backing for the life of the grant,
+   so the host page the peer maps never moves */
+void guest_memory_pin_grant(guest_vm_t* guest, uint32_t page, bool pinned) {
+    guest = guest->vm;
+    ept_entry_t* entry = &guest->ept[page];
+    guest_verify_withdraw(guest, page);
+    if (pinned && !entry->writable) guest_memory_fault(guest, page);
+    entry->grant = pinned;
+}
+
+/* Peer side: the page's own contents go and it maps the owner's backing.
+   Writes to a read-only grant are dropped. */
+void guest_memory_map_grant(guest_vm_t* guest, uint32_t page, uint8_t* host_page, bool writable) {
+    guest = guest->vm;
+    ept_entry_t* entry = &guest->ept[page];
+    guest_memory_drop(guest, page);
+    entry->host_page = host_page;
+    entry->present = true;
+    entry->writable = writable;
+    entry->grant = true;
+}
+
+void guest_memory_unmap_grant(guest_vm_t* guest, uint32_t page) {
+    ept_entry_t* entry = &guest->vm->ept[page];
+    entry->host_page = zero_page;
+    entry->writable = false;
+    entry->grant = false;
+}
+
+/* ============ COMPRESSED PAGES ============ */
+
+/* Replace a private page with a compressed copy and give its backing back to
+   the host. The entry stops being present, so the next access of any kind
+   faults into guest_memory_page_in. */
+bool guest_memory_compress(guest_vm_t* guest, uint32_t page, uint8_t* scratch) {
+    ept_entry_t* entry = &guest->ept[page];
+    uint32_t size = lz_compress(entry->host_page, PAGE_SIZE, scratch, COMPRESS_MAX_SIZE);
+    if (size == 0) return false;
+
+    compressed_page_t* blob = malloc(sizeof(compressed_page_t) + size);
+    if (!blob) return false;
+    blob->size = (uint16_t)size;
+    memcpy(blob->data, scratch, size);
+
+    entry->host_page = (uint8_t*)blob;
+    entry->present = false;
+    entry->writable = false;
+    guest_memory_release(guest, page);
+    guest->compressed_pages++;
+    guest->compressed_bytes += size;
+    return true;
+}
+
+/* Not-present access: decompress into the page's own backing. MMIO pages stay
+   not present and read as the zero page here. */
+uint8_t* guest_memory_page_in(guest_vm_t* guest, uint32_t page) {
+    guest = guest->vm;
+    ept_entry_t* entry = &guest->ept[page];
+    if (entry->present || entry->mmio) return entry->host_page;
+
+    uint64_t start = hypervisor_time_ns();
+    compressed_page_t* blob = (compressed_page_t*)entry->host_page;
+    uint8_t* backing = guest->memory_base + (size_t)page * PAGE_SIZE;
+    if (!lz_decompress(blob->data, blob->size, backing, PAGE_SIZE)) {
+        hypervisor_log(guest->hv, VISA_LOG_ERROR, "[COMPRESS] Guest VM %u page %u does not decompress\n", guest->vm_id,
+                       page);
+        memset(backing, 0, PAGE_SIZE);
+    }
+    guest->compressed_pages--;
+    guest->compressed_bytes -= blob->size;
+    free(blob);
+
+    entry->host_page = backing;
+    entry->present = true;
+    entry->writable = !entry->verified;
+    guest->resident_pages++;
+
+    uint64_t elapsed = hypervisor_time_ns() - start;
+    guest->page_ins++;
+    guest->page_in_ns += elapsed;
+    if (elapsed > guest->page_in_max_ns) guest->page_in_max_ns = elapsed;
+    return backing;
+}
+
+/* Copy a buffer into guest physical memory, faulting pages in as needed */
+void guest_memory_write(guest_vm_t* guest, uint32_t guest_phys_addr, const uint8_t* src, uint32_t size) {
+    bool flush = false;
+    while (size > 0) {
+        uint32_t page = guest_phys_addr / PAGE_SIZE;
+        uint32_t offset = guest_phys_addr % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - offset < size ? PAGE_SIZE - offset : size;
+
+        ept_entry_t* entry = &guest->ept[page];
+        flush |= entry->code;
+        uint8_t* host = entry->writable ? entry->host_page : guest_memory_fault(guest, page);
+        memcpy(host + offset, src, chunk);
+
+        guest_phys_addr += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+    /* Host writes (disk reads, embedder pokes) over code the guest already ran */
+    if (flush) block_cache_flush(guest);
+}
+
+/* ============ HOST ACCESS TO GUEST MEMORY ============ */
+
+/* Walk [guest_virt_addr, +size) in chunks that never cross a guest page */
+static uint32_t guest_chunk(guest_vm_t* guest, uint32_t guest_virt_addr, uint32_t size, uint32_t* phys) {
+    uint32_t chunk = PAGE_SIZE - guest_virt_addr % PAGE_SIZE;
+    *phys = guest_translate_address(guest, guest_virt_addr);
+    if (*phys == 0xFFFFFFFF || *phys >= guest->memory_size) return 0;
+    return chunk < size ? chunk : size;
+}
+
+bool hypervisor_copy_to_guest(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_virt_addr,
+                              const uint8_t* src, uint32_t size) {
+    bool ok = true;
+    pthread_mutex_lock(&guest->vm->mem_lock);
+    while (size > 0) {
+        uint32_t phys;
+        uint32_t chunk = guest_chunk(guest, guest_virt_addr, size, &phys);
+        if (chunk == 0) {
+            ok = false;
+            break;
+        }
+        guest_memory_write(guest, phys, src, chunk);
+        if (hv->replay) replay_record_write(hv->replay, guest, phys, src, chunk);
+
+        guest_virt_addr += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+    pthread_mutex_unlock(&guest->vm->mem_lock);
+    return ok;
+}
+
+bool hypervisor_copy_from_guest(guest_vm_t* guest, uint32_t guest_virt_addr, uint8_t* dst, uint32_t size) {
+    bool ok = true;
+    pthread_mutex_lock(&guest->vm->mem_lock);
+    while (size > 0) {
+        uint32_t phys;
+        uint32_t chunk = guest_chunk(guest, guest_virt_addr, size, &phys);
+        if (chunk == 0) {
+            ok = false;
+            break;
+        }
+        const ept_entry_t* entry = &guest->ept[phys / PAGE_SIZE];
+        const uint8_t* host = entry->present ? entry->host_page : guest_memory_page_in(guest, phys / PAGE_SIZE);
+        memcpy(dst, host + phys % PAGE_SIZE, chunk);
+
+        guest_virt_addr += chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+    pthread_mutex_unlock(&guest->vm->mem_lock);
+    return ok;
+}
+
+/* ============ RESIDENT MEMORY REPORTING ============ */
+
+uint64_t hypervisor_guest_resident_bytes(hypervisor_t* hv, uint32_t guest_id) {
+    if (guest_id == 0 || guest_id > hv->guest_count) return 0;
+    return (uint64_t)hv->guests[guest_id - 1].resident_pages * PAGE_SIZE;
+}
+
+void hypervisor_memory_report(hypervisor_t* hv) {
+    hypervisor_log(hv, VISA_LOG_INFO, "\n[MEMORY] Guest memory (reserved / resident):\n");
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* guest = &hv->guests[i];
+        if (guest->vm != guest) continue;  /* Secondary vCPU: memory reported on the VM */
+        uint64_t resident = hypervisor_guest_resident_bytes(hv, i + 1);
+        log_line_t line = {0};
+        log_append(&line, "  Guest %u: %u KB / %llu KB (%u of %u pages",
+                   i, guest->memory_size / 1024, (unsigned long long)(resident / 1024),
+                   guest->resident_pages, guest->memory_size / PAGE_SIZE);
+        if (guest->compressed_pages) {
+            log_append(&line, ", %u compressed into %llu KB", guest->compressed_pages,
+                       (unsigned long long)(guest->compressed_bytes + 1023) / 1024);
+        }
+        hypervisor_log(hv, VISA_LOG_INFO, "%s)\n", line.text);
+    }
+
+    if (hv->ksm) {
+        ksm_stats_t stats;
+        hypervisor_ksm_stats(hv, &stats);
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[KSM] %llu pages shared, %llu sharing, %llu KB saved, %llu zero pages reclaimed, "
+                       "%llu COW breaks\n", (unsigned long long)stats.pages_shared,
+                       (unsigned long long)stats.pages_sharing, (unsigned long long)(stats.bytes_saved / 1024),
+                       (unsigned long long)stats.pages_zeroed, (unsigned long long)stats.cow_breaks);
+        hypervisor_log(hv, VISA_LOG_INFO, "[KSM] Scanned %llu pages in %llu full scans, %llu us scanner CPU\n",
+                       (unsigned long long)stats.pages_scanned, (unsigned long long)stats.full_scans,
+                       (unsigned long long)(stats.scan_ns / 1000));
+    }
+
+    if (hv->compress) {
+        compress_stats_t stats;
+        hypervisor_compress_stats(hv, &stats);
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[COMPRESS] %llu pages in %llu KB (%.1fx), %llu KB reclaimed, %llu incompressible\n",
+                       (unsigned long long)stats.pages_compressed,
+                       (unsigned long long)(stats.compressed_bytes + 1023) / 1024,
+                       stats.compressed_bytes ?
+                           (double)(stats.pages_compressed * PAGE_SIZE) / (double)stats.compressed_bytes : 0.0,
+                       (unsigned long long)(stats.bytes_reclaimed / 1024), (unsigned long long)stats.incompressible);
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "[COMPRESS] %llu page-ins, %.1f us average, %.1f us max; %llu sweeps, %llu us compressor CPU\n",
+                       (unsigned long long)stats.page_ins,
+                       stats.page_ins ? (double)stats.page_in_ns / (double)stats.page_ins / 1000.0 : 0.0,
+                       (double)stats.page_in_max_ns / 1000.0, (unsigned long long)stats.sweeps,
+                       (unsigned long long)(stats.scan_ns / 1000));
+    }
+}
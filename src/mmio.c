@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ RANGE INDEX ============ */
+
+bool mmio_map_insert(mmio_map_t* map, uint32_t base, uint32_t size, const mmio_ops_t* ops, void* opaque) {
+    if (map->count == MMIO_MAX_REGIONS) return false;
+
+    uint32_t pos = 0;
+    while (pos < map->count && map->regions[pos].base < base) pos++;
+    if (pos > 0 && map->regions[pos - 1].base + map->regions[pos - 1].size > base) return false;
+    if (pos < map->count && base + size > map->regions[pos].base) return false;
+
+    memmove(&map->regions[pos + 1], &map->regions[pos], (map->count - pos) * sizeof(mmio_region_t));
+    mmio_region_t* region = &map->regions[pos];
+    memset(region, 0, sizeof(*region));
+    region->base = base;
+    region->size = size;
+    region->ops = ops;
+    region->opaque = opaque;
+    map->count++;
+    map->last = pos;
+    return true;
+}
+
+/* Device drivers tend to hammer one device at a time, so the last hit is
+   tried before the binary search */
+mmio_region_t* mmio_map_find(mmio_map_t* map, uint32_t guest_phys_addr) {
+    if (map->count == 0) return NULL;
+    mmio_region_t* region = &map->regions[map->last];
+    if (guest_phys_addr - region->base < region->size) return region;
+
+    /* Last region starting at or below the address */
+    uint32_t low = 0, high = map->count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (map->regions[mid].base <= guest_phys_addr) low = mid + 1;
+        else high = mid;
+    }
+    if (low == 0) return NULL;
+    region = &map->regions[low - 1];
+    if (guest_phys_addr - region->base >= region->size) return NULL;
+    map->last = low - 1;
+    return region;
+}
+
+void mmio_map_destroy(mmio_map_t* map) {
+    if (!map) return;
+    for (uint32_t i = 0; i < map->count; i++) {
+        const mmio_ops_t* ops = map->regions[i].ops;
+        if (ops && ops->release) ops->release(map->regions[i].opaque);
+    }
+    free(map);
+}
+
+/* ============ GUEST ACCESS (SLOW PATH) ============ */
+/* Reached only for pages with the EPT mmio bit set, so the VM has a map */
+
+uint8_t guest_mmio_read(hypervisor_t* hv, guest_vm_t* guest, uint32_t guest_phys_addr) {
+    mmio_map_t* map = guest->vm->mmio;
+    mmio_region_t* region = mmio_map_find(map, guest_phys_addr);
+    uint8_t value;
+    if (!region) {
+        map->unassigned++;
+        value = MMIO_UNASSIGNED;
+    } else {
+        region->reads++;
+        value = region->ops && region->ops->read
+            ? region->ops->read(region->opaque, guest, guest_phys_addr - region->base) : 0;
+    }
+    return hv->replay ? replay_mmio_read(hv->replay, guest, value) : value;
+}
+
+void guest_mmio_write(hypervisor_t* hv __attribute__((unused)), guest_vm_t* guest,
+                      uint32_t guest_phys_addr, uint8_t value) {
+    mmio_map_t* map = guest->vm->mmio;
+    mmio_region_t* region = mmio_map_find(map, guest_phys_addr);
+    if (!region) {
+        map->unassigned++;
+        return;
+    }
+    region->writes++;
+    if (region->ops && region->ops->write) {
+        region->ops->write(region->opaque, guest, guest_phys_addr - region->base, value);
+    }
+}
+
+/* ============ REGISTRATION ============ */
+
+/* Add a range to the VM's index and turn its pages over to devices. Stale
+   decoded blocks may have been fetched from those pages, so they go too. */
+bool guest_mmio_map(guest_vm_t* vm, uint32_t base, uint32_t size, const mmio_ops_t* ops, void* opaque) {
+    for (uint32_t page = base / PAGE_SIZE; page <= (base + size - 1) / PAGE_SIZE; page++) {
+        if (vm->ept[page].grant) return false;  /* Shared with another VM */
+    }
+    if (!vm->mmio) {
+        vm->mmio = calloc(1, sizeof(mmio_map_t));
+        if (!vm->mmio) return false;
+    }
+    if (!mmio_map_insert(vm->mmio, base, size, ops, opaque)) {
+        if (vm->mmio->count == 0) {
+            free(vm->mmio);
+            vm->mmio = NULL;
+        }
+        return false;
+    }
+
+    for (uint32_t page = base / PAGE_SIZE; page <= (base + size - 1) / PAGE_SIZE; page++) {
+        guest_memory_map_mmio(vm, page);
+    }
+    block_cache_flush(vm);
+    return true;
+}
+
+bool hypervisor_mmio_register(hypervisor_t* hv, uint32_t guest_id, uint32_t base, uint32_t size,
+                              const mmio_ops_t* ops, void* opaque) {
+    if (guest_id == 0 || guest_id > hv->guest_count) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
+        return false;
+    }
+
+    guest_vm_t* vm = hv->guests[guest_id - 1].vm;
+    if (size == 0 || (uint64_t)base + size > vm->memory_size) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[MMIO] %s at 0x%X+0x%X is outside Guest VM %u memory\n",
+                       ops->name, base, size, vm->vm_id);
+        return false;
+    }
+    /* Devices take whole pages, so any page holding the image would stop being RAM */
+    if (base / PAGE_SIZE * PAGE_SIZE < vm->image_size) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[MMIO] %s at 0x%X+0x%X overlaps the %u-byte image of Guest VM %u\n",
+                       ops->name, base, size, vm->image_size, vm->vm_id);
+        return false;
+    }
+
+    pthread_mutex_lock(&vm->mem_lock);
+    bool ok = guest_mmio_map(vm, base, size, ops, opaque);
+    if (ok && hv->replay) replay_record_mmio_map(hv->replay, vm, base, size);
+    pthread_mutex_unlock(&vm->mem_lock);
+
+    if (!ok) {
+        hypervisor_log(hv, VISA_LOG_ERROR,
+                       "[MMIO] %s at 0x%X+0x%X overlaps another device or granted memory, or exceeds %u devices\n",
+                       ops->name, base, size, MMIO_MAX_REGIONS);
+        return false;
+    }
+    hypervisor_log(hv, VISA_LOG_INFO, "[MMIO] Guest VM %u: %s at 0x%X-0x%X\n", vm->vm_id, ops->name, base,
+                   base + size - 1);
+    return true;
+}
+
+bool hypervisor_add_device(hypervisor_t* hv, uint32_t guest_id, const char* name, uint32_t base) {
+    const mmio_device_t* device = mmio_device_lookup(name);
+    if (!device) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[MMIO] Unknown device %s\n", name);
+        return false;
+    }
+
+    void* opaque = device->create ? device->create(hv) : NULL;
+    if (device->create && !opaque) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[MMIO] Out of memory for %s\n", name);
+        return false;
+    }
+    if (!hypervisor_mmio_register(hv, guest_id, base, device->size, device->ops, opaque)) {
+        if (device->ops->release) device->ops->release(opaque);
+        return false;
+    }
+    return true;
+}
+
+/* ============ REPORTING ============ */
+
+void hypervisor_mmio_report(hypervisor_t* hv) {
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* vm = &hv->guests[i];
+        if (vm->vm != vm || !vm->mmio) continue;
+
+        pthread_mutex_lock(&vm->mem_lock);
+        mmio_map_t* map = vm->mmio;
+        for (uint32_t r = 0; r < map->count; r++) {
+            const mmio_region_t* region = &map->regions[r];
+            hypervisor_log(hv, VISA_LOG_INFO, "[MMIO] Guest VM %u %s at 0x%X: %llu reads, %llu writes\n", i,
+                           region->ops ? region->ops->name : "(replayed)", region->base,
+                           (unsigned long long)region->reads, (unsigned long long)region->writes);
+        }
+        if (map->unassigned) {
+            hypervisor_log(hv, VISA_LOG_INFO, "[MMIO] Guest VM %u: %llu accesses to unassigned MMIO bytes\n", i,
+                           (unsigned long long)map->unassigned);
+        }
+        pthread_mutex_unlock(&vm->mem_lock);
+    }
+}
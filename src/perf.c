@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../include/isa.h"
+
+static const struct {
+    const char* name;
+    uint64_t config;
+} perf_events[PERF_NR_COUNTERS] = {
+    [PERF_CYCLES] = { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_BRANCH_MISSES] = { "branch-misses", PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_CACHE_MISSES] = { "cache-misses", PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static const char* const phase_names[PERF_NR_PHASES] = {
+    [PERF_PHASE_DISPATCH] = "dispatch",
+    [PERF_PHASE_TRANSLATE] = "translate",
+    [PERF_PHASE_EXIT] = "exit",
+    [PERF_PHASE_SCHED] = "sched",
+    [PERF_PHASE_IDLE] = "idle",
+};
+
+/* ============ COUNTER GROUP ============ */
+
+static int perf_event_open(struct perf_event_attr* attr, int group_fd) {
+    return (int)syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+/* Open whichever events the host supports as one group on the calling
+   thread, so a single read() returns them all from the same instant */
+static void perf_open_group(hypervisor_t* hv, perf_t* perf) {
+    perf->leader = -1;
+    int errors[PERF_NR_COUNTERS] = { 0 };
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+        perf->fds[c] = -1;
+        perf->slot[c] = -1;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_events[c].config;
+        attr.disabled = perf->leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = perf_event_open(&attr, perf->leader);
+        if (fd < 0) {
+            errors[c] = errno;
+            continue;
+        }
+        if (perf->leader < 0) perf->leader = fd;
+        perf->fds[c] = fd;
+        perf->slot[c] = (int)perf->nr_open++;
+    }
+
+    if (perf->leader < 0) {
+        hypervisor_log(hv, VISA_LOG_INFO, "[PERF] Hardware counters unavailable (%s); attributing time only\n",
+                       strerror(errors[0]));
+        return;
+    }
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+        if (errors[c]) {
+            hypervisor_log(hv, VISA_LOG_INFO, "[PERF] No %s counter (%s)\n", perf_events[c].name,
+                           strerror(errors[c]));
+        }
+    }
+    ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/* Cumulative counts, scaled up if the kernel multiplexed the group */
+static void perf_read(const perf_t* perf, uint64_t now[PERF_NR_COUNTERS]) {
+    memset(now, 0, sizeof(uint64_t) * PERF_NR_COUNTERS);
+    if (perf->leader < 0) return;
+
+    struct {
+        uint64_t nr;
+        uint64_t time_enabled;
+        uint64_t time_running;
+        uint64_t values[PERF_NR_COUNTERS];
+    } data;
+    if (read(perf->leader, &data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+        if (perf->slot[c] < 0 || (uint64_t)perf->slot[c] >= data.nr) continue;
+        uint64_t value = data.values[perf->slot[c]];
+        if (data.time_running && data.time_running < data.time_enabled) {
+            value = (uint64_t)((double)value * (double)data.time_enabled / (double)data.time_running);
+        }
+        now[c] = value;
+    }
+}
+
+/* Smallest cost of a back-to-back pair of readings */
+static void perf_calibrate(perf_t* perf) {
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) perf->overhead[c] = UINT64_MAX;
+    perf->overhead_ns = UINT64_MAX;
+
+    for (uint32_t i = 0; i < 16; i++) {
+        uint64_t before[PERF_NR_COUNTERS], after[PERF_NR_COUNTERS];
+        uint64_t start = hypervisor_time_ns();
+        perf_read(perf, before);
+        perf_read(perf, after);
+        uint64_t elapsed = hypervisor_time_ns() - start;
+        for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+            uint64_t delta = after[c] > before[c] ? after[c] - before[c] : 0;
+            if (delta < perf->overhead[c]) perf->overhead[c] = delta;
+        }
+        if (elapsed / 2 < perf->overhead_ns) perf->overhead_ns = elapsed / 2;
+    }
+}
+
+perf_t* perf_create(hypervisor_t* hv, uint32_t sample_period) {
+    perf_t* perf = calloc(1, sizeof(perf_t));
+    if (!perf) return NULL;
+
+    perf_open_group(hv, perf);
+    perf->guest = PERF_HOST;
+    perf->phase = PERF_PHASE_SCHED;
+    perf->sample_period = sample_period;
+    perf->countdown = sample_period;
+    perf_calibrate(perf);
+    perf_read(perf, perf->last);
+    perf->last_ns = hypervisor_time_ns();
+    return perf;
+}
+
+void perf_destroy(perf_t* perf) {
+    if (!perf) return;
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+        if (perf->fds[c] >= 0) close(perf->fds[c]);
+    }
+    free(perf);
+}
+
+/* ============ ATTRIBUTION ============ */
+
+/* Charge everything since the last reading to the open phase; the deltas
+   are left in `delta` and the elapsed time is returned */
+static uint64_t perf_close_phase(perf_t* perf, uint64_t delta[PERF_NR_COUNTERS]) {
+    uint64_t now[PERF_NR_COUNTERS];
+    perf_read(perf, now);
+    uint64_t now_ns = hypervisor_time_ns();
+
+    perf_bucket_t* bucket = &perf->buckets[perf->guest][perf->phase];
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+        /* Scaled estimates can step backwards slightly */
+        delta[c] = now[c] > perf->last[c] ? now[c] - perf->last[c] : 0;
+        bucket->count[c] += delta[c];
+        perf->last[c] = now[c];
+    }
+    uint64_t elapsed = now_ns - perf->last_ns;
+    bucket->ns += elapsed;
+    perf->last_ns = now_ns;
+    return elapsed;
+}
+
+void perf_switch(perf_t* perf, uint32_t guest, perf_phase_t phase) {
+    uint64_t delta[PERF_NR_COUNTERS];
+    perf_close_phase(perf, delta);
+    perf->guest = guest < MAX_GUESTS ? guest : PERF_HOST;
+    perf->phase = phase;
+    perf->buckets[perf->guest][phase].entries++;
+}
+
+bool perf_sample_begin(perf_t* perf) {
+    if (perf->sample_period == 0 || --perf->countdown > 0) return false;
+    perf->countdown = perf->sample_period;
+
+    uint64_t delta[PERF_NR_COUNTERS];
+    perf_close_phase(perf, delta);
+    return true;
+}
+
+/* Blocks are straight-line code, so each executed instruction gets an equal
+   share; the remainder goes to the first */
+void perf_sample_end(perf_t* perf, const uint8_t* opcodes, uint32_t executed) {
+    uint64_t delta[PERF_NR_COUNTERS];
+    uint64_t ns = perf_close_phase(perf, delta);
+    if (executed == 0) return;
+
+    for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+        delta[c] = delta[c] > perf->overhead[c] ? delta[c] - perf->overhead[c] : 0;
+    }
+    ns = ns > perf->overhead_ns ? ns - perf->overhead_ns : 0;
+
+    perf->samples++;
+    for (uint32_t i = 0; i < executed; i++) {
+        perf_opcode_t* op = &perf->opcodes[opcodes[i]];
+        for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) {
+            op->count[c] += delta[c] / executed + (i == 0 ? delta[c] % executed : 0);
+        }
+        op->ns += ns / executed + (i == 0 ? ns % executed : 0);
+        op->executed++;
+    }
+}
+
+/* ============ PERF API ============ */
+
+bool hypervisor_perf_start(hypervisor_t* hv, uint32_t sample_period) {
+    if (hv->perf) {
+        hv->perf->sample_period = sample_period;
+        hv->perf->countdown = sample_period;
+        return true;
+    }
+
+    hv->perf = perf_create(hv, sample_period);
+    if (!hv->perf) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[PERF] Out of memory\n");
+        return false;
+    }
+    if (hv->perf->nr_open) {
+        hypervisor_log(hv, VISA_LOG_INFO, "[PERF] Counting %u host events on the execution thread\n",
+                       hv->perf->nr_open);
+    }
+    if (sample_period) {
+        hypervisor_log(hv, VISA_LOG_INFO, "[PERF] Sampling 1 block in %u for per-opcode costs\n", sample_period);
+    }
+    return true;
+}
+
+static double per_thousand(uint64_t count, uint64_t instructions) {
+    return instructions ? (double)count * 1000.0 / (double)instructions : 0.0;
+}
+
+/* One line of totals and one of phase shares (of cycles when counted,
+   otherwise of time) */
+static void report_row(hypervisor_t* hv, const perf_t* perf, const char* label, uint32_t row,
+                       uint64_t guest_instructions) {
+    const perf_bucket_t* buckets = perf->buckets[row];
+    perf_bucket_t total;
+    memset(&total, 0, sizeof(total));
+    for (uint32_t p = 0; p < PERF_NR_PHASES; p++) {
+        for (uint32_t c = 0; c < PERF_NR_COUNTERS; c++) total.count[c] += buckets[p].count[c];
+        total.ns += buckets[p].ns;
+    }
+    if (total.ns == 0) return;
+
+    bool counted = perf->nr_open && total.count[PERF_CYCLES];
+    log_line_t line = { "", 0 };
+    if (counted) {
+        uint64_t cycles = total.count[PERF_CYCLES];
+        uint64_t instructions = total.count[PERF_INSTRUCTIONS];
+        log_append(&line,
+                   "[PERF] %s: %.2fM cycles, IPC %.2f, %.2f branch misses and %.2f cache misses per 1K instructions",
+                   label, (double)cycles / 1e6, instructions ? (double)instructions / (double)cycles : 0.0,
+                   per_thousand(total.count[PERF_BRANCH_MISSES], instructions),
+                   per_thousand(total.count[PERF_CACHE_MISSES], instructions));
+        if (guest_instructions) {
+            log_append(&line, ", %.1f cycles per guest instruction", (double)cycles / (double)guest_instructions);
+        }
+    } else {
+        log_append(&line, "[PERF] %s: %.3f ms", label, (double)total.ns / 1e6);
+        if (guest_instructions) {
+            log_append(&line, ", %.1f ns per guest instruction", (double)total.ns / (double)guest_instructions);
+        }
+    }
+    hypervisor_log(hv, VISA_LOG_INFO, "%s\n", line.text);
+
+    log_line_t phases = { "[PERF]   ", 9 };
+    for (uint32_t p = 0; p < PERF_NR_PHASES; p++) {
+        uint64_t part = counted ? buckets[p].count[PERF_CYCLES] : buckets[p].ns;
+        uint64_t whole = counted ? total.count[PERF_CYCLES] : total.ns;
+        if (buckets[p].entries == 0 && part == 0) continue;
+        log_append(&phases, " %s %.1f%% (%llu)", phase_names[p], 100.0 * (double)part / (double)whole,
+                   (unsigned long long)buckets[p].entries);
+    }
+    hypervisor_log(hv, VISA_LOG_INFO, "%s\n", phases.text);
+}
+
+void hypervisor_perf_report(hypervisor_t* hv) {
+    perf_t* perf = hv->perf;
+    if (!perf) return;
+    perf_switch(perf, PERF_HOST, PERF_PHASE_SCHED);  /* Close whatever is open */
+
+    hypervisor_log(hv, VISA_LOG_INFO, "\n[PERF] Host %s per guest and phase (entries in parentheses):\n",
+                   perf->nr_open ? "counters" : "time");
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Guest VM %u", i);
+        report_row(hv, perf, label, i, hv->guests[i].instruction_count);
+    }
+    report_row(hv, perf, "Hypervisor", PERF_HOST, 0);
+
+    if (perf->samples == 0) return;
+    hypervisor_log(hv, VISA_LOG_INFO, "[PERF] Per-opcode cost from %llu sampled blocks (per guest instruction):\n",
+                   (unsigned long long)perf->samples);
+    for (uint32_t op = 0; op < 256; op++) {
+        const perf_opcode_t* entry = &perf->opcodes[op];
+        if (entry->executed == 0) continue;
+        double executed = (double)entry->executed;
+        log_line_t line = { "", 0 };
+        log_append(&line, "[PERF]   %-10s %8llu executed, %6.1f ns", isa_opcode_name((uint8_t)op),
+                   (unsigned long long)entry->executed, (double)entry->ns / executed);
+        if (perf->nr_open) {
+            log_append(&line, ", %7.1f cycles, %5.2f branch misses, %5.2f cache misses",
+                       (double)entry->count[PERF_CYCLES] / executed,
+                       (double)entry->count[PERF_BRANCH_MISSES] / executed,
+                       (double)entry->count[PERF_CACHE_MISSES] / executed);
+        }
+        hypervisor_log(hv, VISA_LOG_INFO, "%s\n", line.text);
+    }
+}
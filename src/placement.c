@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "../include/isa.h"
+
+/* ============ HOST TOPOLOGY ============ */
+
+bool placement_parse_cpus(const char* text, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    const char* p = text;
+    while (*p) {
+        char* end;
+        unsigned long first = strtoul(p, &end, 10);
+        if (end == p) return false;
+        unsigned long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first) return false;
+        }
+        if (last >= CPU_SETSIZE) return false;
+        for (unsigned long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+
+        if (*end == ',') end++;
+        else if (*end != '\0' && *end != '\n') return false;
+        p = end;
+        if (*p == '\n') break;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+static void read_topology(placement_t* placement) {
+    placement->nr_nodes = 0;
+    for (uint32_t node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        char path[64], line[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        FILE* file = fopen(path, "r");
+        if (!file) break;
+        bool ok = fgets(line, sizeof(line), file) != NULL &&
+                  placement_parse_cpus(line, &placement->node_cpus[node]);
+        fclose(file);
+        if (!ok) CPU_ZERO(&placement->node_cpus[node]);  /* Memory-only node */
+        placement->nr_nodes = node + 1;
+    }
+
+    if (placement->nr_nodes == 0) {
+        /* No NUMA information: one node holding every CPU we may run on */
+        placement->nr_nodes = 1;
+        sched_getaffinity(0, sizeof(cpu_set_t), &placement->node_cpus[0]);
+    }
+}
+
+void placement_init(placement_t* placement) {
+    memset(placement, 0, sizeof(*placement));
+    read_topology(placement);
+    placement->worker_node = -1;
+    placement->guest_node = PLACEMENT_NODE_NONE;
+}
+
+/* ============ THREAD PLACEMENT ============ */
+
+void placement_pin_helper(hypervisor_t* hv, pthread_t thread) {
+    const placement_t* placement = &hv->placement;
+    if (!placement->helpers_pinned) return;
+    int err = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &placement->helper_cpus);
+    if (err != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[PLACEMENT] Cannot pin helper thread: %s\n", strerror(err));
+    }
+}
+
+bool hypervisor_pin_worker(hypervisor_t* hv, const cpu_set_t* cpus) {
+    if (sched_setaffinity(0, sizeof(cpu_set_t), cpus) != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[PLACEMENT] sched_setaffinity: %s\n", strerror(errno));
+        return false;
+    }
+    hv->placement.worker_cpus = *cpus;
+    hv->placement.worker_pinned = true;
+    hv->placement.worker_node = -1;
+    return true;
+}
+
+/* Move the execution thread onto the guest's home node before its slice so
+   the vCPU runs next to its memory. An explicitly pinned worker stays put,
+   and back-to-back slices on one node never touch the affinity mask. */
+void hypervisor_place_vcpu(hypervisor_t* hv, guest_vm_t* guest) {
+    placement_t* placement = &hv->placement;
+    int32_t node = guest->home_node;
+    if (node < 0 || placement->worker_pinned || node == placement->worker_node) return;
+    if (CPU_COUNT(&placement->node_cpus[node]) == 0) return;
+
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &placement->node_cpus[node]) == 0) {
+        if (placement->worker_node >= 0) placement->node_switches++;
+        placement->worker_node = node;
+    }
+}
+
+/* ============ MEMORY PLACEMENT ============ */
+
+void placement_bind_memory(hypervisor_t* hv, void* addr, size_t size,
+                           int32_t node, bool huge_pages) {
+    const placement_t* placement = &hv->placement;
+    if (huge_pages && size >= PLACEMENT_HUGE_PAGE_SIZE &&
+        madvise(addr, size, MADV_HUGEPAGE) != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[PLACEMENT] madvise(MADV_HUGEPAGE): %s\n", strerror(errno));
+    }
+
+    /* Only one node: the default local policy already does the right thing */
+    if (node < 0 || placement->nr_nodes < 2) return;
+
+    unsigned long mask[PLACEMENT_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, addr, size, MPOL_PREFERRED, mask, PLACEMENT_MAX_NODES + 1, 0) != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[PLACEMENT] mbind: %s\n", strerror(errno));
+    }
+}
+
+int32_t placement_local_percent(const guest_vm_t* guest) {
+    if (guest->home_node < 0 || guest->resident_pages == 0) return -1;
+
+    uint32_t nr_pages = guest->memory_size / PAGE_SIZE;
+    void** pages = malloc(guest->resident_pages * sizeof(void*));
+    int* status = malloc(guest->resident_pages * sizeof(int));
+    uint32_t count = 0;
+    for (uint32_t page = 0; pages && status && page < nr_pages && count < guest->resident_pages; page++) {
+        uint8_t* backing = guest->memory_base + (size_t)page * PAGE_SIZE;
+        if (guest->ept[page].host_page == backing) pages[count++] = backing;
+    }
+
+    int32_t percent = -1;
+    /* move_pages with no target nodes only reports where each page lives */
+    if (count && syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) == 0) {
+        uint32_t local = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (status[i] == guest->home_node) local++;
+        }
+        percent = (int32_t)(local * 100 / count);
+    }
+    free(pages);
+    free(status);
+    return percent;
+}
+
+/* ============ HYPERVISOR INTERFACE ============ */
+
+/* Home node for the next guest; also advances the round-robin cursor */
+int32_t hypervisor_next_home_node(hypervisor_t* hv) {
+    placement_t* placement = &hv->placement;
+    if (placement->guest_node == PLACEMENT_NODE_AUTO) {
+        return (int32_t)(placement->next_auto_node++ % placement->nr_nodes);
+    }
+    return placement->guest_node;
+}
+
+void hypervisor_placement_report(hypervisor_t* hv) {
+    placement_t* placement = &hv->placement;
+    hypervisor_log(hv, VISA_LOG_INFO, "[PLACEMENT] %u NUMA node(s), worker %s, huge pages %s, %llu node switches\n",
+                   placement->nr_nodes, placement->worker_pinned ? "pinned" : "follows home nodes",
+                   placement->huge_pages ? "on" : "off", (unsigned long long)placement->node_switches);
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* guest = &hv->guests[i];
+        if (guest->home_node < 0 || guest->vm != guest) continue;
+        int32_t local = placement_local_percent(guest);
+        if (local >= 0) {
+            hypervisor_log(hv, VISA_LOG_INFO, "  Guest %u: home node %d, %d%% of resident pages local\n", i,
+                           guest->home_node, local);
+        } else {
+            hypervisor_log(hv, VISA_LOG_INFO, "  Guest %u: home node %d\n", i, guest->home_node);
+        }
+    }
+}
@@ -0,0 +1,641 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/isa.h"
+
+/* ============ LOG ENCODING ============ */
+
+static void put_u8(replay_t* replay, uint8_t value) {
+    fputc(value, replay->file);
+    replay->bytes++;
+}
+
+static void put_u32(replay_t* replay, uint32_t value) {
+    for (int i = 0; i < 4; i++) put_u8(replay, (uint8_t)(value >> (8 * i)));
+}
+
+static void put_u64(replay_t* replay, uint64_t value) {
+    put_u32(replay, (uint32_t)value);
+    put_u32(replay, (uint32_t)(value >> 32));
+}
+
+static void put_varint(replay_t* replay, uint32_t value) {
+    while (value >= 0x80) {
+        put_u8(replay, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    put_u8(replay, (uint8_t)value);
+}
+
+/* Readers set *ok to false on a truncated log and return 0 */
+static uint8_t get_u8(FILE* file, bool* ok) {
+    int c = fgetc(file);
+    if (c == EOF) {
+        *ok = false;
+        return 0;
+    }
+    return (uint8_t)c;
+}
+
+static uint32_t get_u32(FILE* file, bool* ok) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= (uint32_t)get_u8(file, ok) << (8 * i);
+    return value;
+}
+
+static uint64_t get_u64(FILE* file, bool* ok) {
+    uint64_t low = get_u32(file, ok);
+    return low | ((uint64_t)get_u32(file, ok) << 32);
+}
+
+static uint32_t get_varint(FILE* file, bool* ok) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35 && *ok; shift += 7) {
+        uint8_t byte = get_u8(file, ok);
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    *ok = false;
+    return 0;
+}
+
+uint32_t replay_fingerprint(const guest_vm_t* guest) {
+    const vcpu_t* vcpu = &guest->vcpu;
+    uint64_t hash = hypervisor_hash_bytes((const uint8_t*)vcpu->registers, sizeof(vcpu->registers));
+    hash ^= ((uint64_t)vcpu->pc << 32) | vcpu->sp;
+    hash *= 0x100000001B3ULL;
+    hash ^= ((uint64_t)vcpu->state << 8) | vcpu->priv;
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* ============ RECORDING HOOKS ============ */
+
+void replay_record_slice(replay_t* replay, const guest_vm_t* guest,
+                         uint32_t steps, bool preempted) {
+    if (replay->mode != REPLAY_MODE_RECORD) return;
+    put_u8(replay, REPLAY_EVENT_SLICE);
+    put_varint(replay, guest->vm_id);
+    put_varint(replay, steps);
+    put_u8(replay, preempted ? REPLAY_SLICE_PREEMPTED : 0);
+    put_u32(replay, replay_fingerprint(guest));
+    replay->events++;
+    replay->slices++;
+    replay->steps += steps;
+}
+
+void replay_record_resume(replay_t* replay, const guest_vm_t* guest, uint32_t value) {
+    if (replay->mode != REPLAY_MODE_RECORD) return;
+    put_u8(replay, REPLAY_EVENT_RESUME);
+    put_varint(replay, guest->vm_id);
+    put_varint(replay, value);
+    replay->events++;
+}
+
+void replay_record_state(replay_t* replay, const guest_vm_t* guest) {
+    if (replay->mode != REPLAY_MODE_RECORD) return;
+    put_u8(replay, REPLAY_EVENT_STATE);
+    put_varint(replay, guest->vm_id);
+    put_varint(replay, guest->vcpu.state);
+    replay->events++;
+}
+
+void replay_record_write(replay_t* replay, const guest_vm_t* guest, uint32_t guest_phys_addr,
+                         const uint8_t* data, uint32_t size) {
+    if (replay->mode != REPLAY_MODE_RECORD) return;
+    put_u8(replay, REPLAY_EVENT_WRITE);
+    put_varint(replay, guest->vm_id);
+    put_varint(replay, guest_phys_addr);
+    put_varint(replay, size);
+    fwrite(data, 1, size, replay->file);
+    replay->bytes += size;
+    replay->events++;
+}
+
+void replay_record_mmio_map(replay_t* replay, const guest_vm_t* guest, uint32_t base, uint32_t size) {
+    if (replay->mode != REPLAY_MODE_RECORD) return;
+    put_u8(replay, REPLAY_EVENT_MMIO_MAP);
+    put_varint(replay, guest->vm_id);
+    put_varint(replay, base);
+    put_varint(replay, size);
+    replay->events++;
+}
+
+void replay_record_grant(replay_t* replay, const guest_vm_t* guest, uint32_t op, uint32_t page,
+                         uint32_t nr_pages, const guest_vm_t* owner, uint32_t owner_page) {
+    if (replay->mode != REPLAY_MODE_RECORD) return;
+    put_u8(replay, REPLAY_EVENT_GRANT);
+    put_varint(replay, guest->vm_id);
+    put_varint(replay, op);
+    put_varint(replay, page);
+    put_varint(replay, nr_pages);
+    put_varint(replay, owner ? owner->vm_id : guest->vm_id);
+    put_varint(replay, owner_page);
+    replay->events++;
+}
+
+uint8_t replay_mmio_read(replay_t* replay, const guest_vm_t* guest, uint8_t value) {
+    if (replay->mode == REPLAY_MODE_RECORD) {
+        put_u8(replay, REPLAY_EVENT_MMIO_READ);
+        put_varint(replay, guest->vm_id);
+        put_u8(replay, value);
+        replay->events++;
+        return value;
+    }
+
+    if (replay->mmio_next == replay->mmio_count ||
+        replay->mmio_reads[replay->mmio_next] >> 8 != guest->vm_id) {
+        replay->mmio_mismatch = true;
+        return value;
+    }
+    return (uint8_t)replay->mmio_reads[replay->mmio_next++];
+}
+
+/* ============ SNAPSHOT ============ */
+/* Everything execution depends on: registers, VMCS, every page that is not
+   the zero page (merged and compressed pages are written out by content) and
+   the MMIO ranges */
+
+static void snapshot_guest(replay_t* replay, guest_vm_t* guest) {
+    vcpu_t* vcpu = &guest->vcpu;
+    vmcs_t* vmcs = &vcpu->vmcs;
+
+    pthread_mutex_lock(&guest->vm->mem_lock);
+    put_u32(replay, guest->vm->vm_id);
+    put_u32(replay, guest->ipi_pending);
+    put_u32(replay, guest->notify_pending);
+    put_u32(replay, guest->memory_size);
+    put_u64(replay, guest->image_hash);
+    put_u32(replay, guest->image_size);
+    put_u32(replay, guest->code_size);
+    put_u32(replay, guest->instruction_count);
+
+    for (uint32_t r = 0; r < REGISTER_COUNT; r++) put_u32(replay, vcpu->registers[r]);
+    put_u32(replay, vcpu->pc);
+    put_u32(replay, vcpu->sp);
+    put_u32(replay, vcpu->priv);
+    put_u32(replay, vcpu->state);
+    put_u32(replay, vcpu->last_exit_cause);
+    put_u32(replay, vcpu->guest_pgtbl_root);
+    put_u32(replay, vcpu->host_pgtbl_root);
+    put_u8(replay, vcpu->tlb_valid);
+    put_u32(replay, vcpu->ivt_base);
+    put_u32(replay, vcpu->irq_pending);
+    put_u8(replay, vcpu->irq_masked);
+    put_u32(replay, vcpu->timer_period);
+    put_u32(replay, vcpu->timer_next);
+    put_u32(replay, vcpu->timer_ticks);
+    for (uint32_t v = 0; v < IRQ_VECTORS; v++) {
+        put_u32(replay, vcpu->irq_info[v]);
+        put_u32(replay, vcpu->irq_delivered[v]);
+    }
+    put_u8(replay, vcpu->trap_acked);
+    put_u32(replay, vcpu->trap_acked_pc);
+    for (uint32_t b = 0; b < VMTRAPCFG_BITS; b++) {
+        put_u64(replay, vcpu->trap_inline[b]);
+        put_u64(replay, vcpu->trap_exits[b]);
+    }
+
+    put_u32(replay, vmcs->guest_rax);
+    put_u32(replay, vmcs->guest_rbx);
+    put_u32(replay, vmcs->guest_rcx);
+    put_u32(replay, vmcs->guest_rdx);
+    put_u32(replay, vmcs->guest_pc);
+    put_u32(replay, vmcs->guest_priv);
+    put_u32(replay, vmcs->guest_pgtbl_root);
+    put_u32(replay, vmcs->host_pgtbl_root);
+    put_u32(replay, vmcs->exit_cause);
+    put_u32(replay, vmcs->exit_qualification);
+    put_u32(replay, vmcs->trap_config);
+
+    /* Secondary vCPUs share the memory written out with their boot vCPU */
+    const uint8_t* zero_page = guest_memory_zero_page();
+    uint32_t nr_pages = guest->vm == guest ? guest->memory_size / PAGE_SIZE : 0;
+    uint32_t populated = 0;
+    for (uint32_t page = 0; page < nr_pages; page++) {
+        if (guest->ept[page].host_page != zero_page) populated++;
+    }
+    put_u32(replay, populated);
+    for (uint32_t page = 0; page < nr_pages; page++) {
+        if (guest->ept[page].host_page == zero_page) continue;
+        const uint8_t* data = guest->ept[page].present ? guest->ept[page].host_page
+                                                        : guest_memory_page_in(guest, page);
+        put_u32(replay, page);
+        fwrite(data, 1, PAGE_SIZE, replay->file);
+        replay->bytes += PAGE_SIZE;
+    }
+
+    const mmio_map_t* mmio = guest->vm == guest ? guest->mmio : NULL;
+    put_u32(replay, mmio ? mmio->count : 0);
+    for (uint32_t i = 0; mmio && i < mmio->count; i++) {
+        put_u32(replay, mmio->regions[i].base);
+        put_u32(replay, mmio->regions[i].size);
+    }
+    pthread_mutex_unlock(&guest->vm->mem_lock);
+}
+
+static bool restore_guest(hypervisor_t* hv, FILE* file) {
+    bool ok = true;
+    uint32_t vm_id = get_u32(file, &ok);
+    uint32_t ipi_pending = get_u32(file, &ok);
+    uint32_t notify_pending = get_u32(file, &ok);
+    uint32_t memory_size = get_u32(file, &ok);
+    if (!ok || hv->guest_count >= MAX_GUESTS || vm_id > hv->guest_count) return false;
+
+    guest_vm_t* guest = &hv->guests[hv->guest_count];
+    guest_vm_t* vm = &hv->guests[vm_id];
+    if (vm != guest && (vm->vm != vm || vm->nr_vcpus == MAX_VCPUS || vm->memory_size != memory_size)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&vm->mem_lock);
+    if (vm == guest) {
+        guest->home_node = PLACEMENT_NODE_NONE;
+        guest_vcpu_attach(guest, guest);
+        if (!guest_memory_init(guest, memory_size)) {
+            pthread_mutex_unlock(&vm->mem_lock);
+            return false;
+        }
+    } else {
+        guest_vcpu_attach(vm, guest);
+    }
+    uint32_t guest_id = __atomic_fetch_add(&hv->guest_count, 1, __ATOMIC_RELEASE);
+
+    vcpu_t* vcpu = &guest->vcpu;
+    vmcs_t* vmcs = &vcpu->vmcs;
+    guest->vm_id = guest_id;
+    guest->ipi_pending = ipi_pending;
+    guest->notify_pending = notify_pending;
+    guest->image_hash = get_u64(file, &ok);
+    guest->image_size = get_u32(file, &ok);
+    guest->code_size = get_u32(file, &ok);
+    guest->instruction_count = get_u32(file, &ok);
+    guest->quantum_instructions = DEFAULT_TIME_QUANTUM;
+    guest->sched.weight = SCHED_DEFAULT_WEIGHT;
+    guest->sched.queue_index = -1;
+    guest->wait.timer_index = -1;
+
+    vcpu->guest_id = guest_id;
+    for (uint32_t r = 0; r < REGISTER_COUNT; r++) vcpu->registers[r] = get_u32(file, &ok);
+    vcpu->pc = get_u32(file, &ok);
+    vcpu->sp = get_u32(file, &ok);
+    ok = ok && vcpu->sp < vm->memory_size;  /* CALL and RET only check the low end */
+    vcpu->priv = (privilege_level_t)get_u32(file, &ok);
+    vcpu->state = (guest_state_t)get_u32(file, &ok);
+    vcpu->last_exit_cause = (vmcause_t)get_u32(file, &ok);
+    vcpu->guest_pgtbl_root = get_u32(file, &ok);
+    vcpu->host_pgtbl_root = get_u32(file, &ok);
+    vcpu->tlb_valid = get_u8(file, &ok) != 0;
+    vcpu->ivt_base = get_u32(file, &ok);
+    vcpu->irq_pending = get_u32(file, &ok);
+    vcpu->irq_masked = get_u8(file, &ok) != 0;
+    vcpu->timer_period = get_u32(file, &ok);
+    vcpu->timer_next = get_u32(file, &ok);
+    vcpu->timer_ticks = get_u32(file, &ok);
+    for (uint32_t v = 0; v < IRQ_VECTORS; v++) {
+        vcpu->irq_info[v] = get_u32(file, &ok);
+        vcpu->irq_delivered[v] = get_u32(file, &ok);
+    }
+    vcpu->trap_acked = get_u8(file, &ok) != 0;
+    vcpu->trap_acked_pc = get_u32(file, &ok);
+    for (uint32_t b = 0; b < VMTRAPCFG_BITS; b++) {
+        vcpu->trap_inline[b] = get_u64(file, &ok);
+        vcpu->trap_exits[b] = get_u64(file, &ok);
+    }
+
+    vmcs->vmcs_id = guest_id;
+    vmcs->guest_rax = get_u32(file, &ok);
+    vmcs->guest_rbx = get_u32(file, &ok);
+    vmcs->guest_rcx = get_u32(file, &ok);
+    vmcs->guest_rdx = get_u32(file, &ok);
+    vmcs->guest_pc = get_u32(file, &ok);
+    vmcs->guest_priv = (uint8_t)get_u32(file, &ok);
+    vmcs->guest_pgtbl_root = get_u32(file, &ok);
+    vmcs->host_pgtbl_root = get_u32(file, &ok);
+    vmcs->exit_cause = (vmcause_t)get_u32(file, &ok);
+    vmcs->exit_qualification = get_u32(file, &ok);
+    vmcs->trap_config = get_u32(file, &ok);
+
+    uint32_t populated = get_u32(file, &ok);
+    uint8_t page_data[PAGE_SIZE];
+    for (uint32_t i = 0; i < populated && ok; i++) {
+        uint32_t page = get_u32(file, &ok);
+        if (!ok || page >= guest->memory_size / PAGE_SIZE ||
+            fread(page_data, 1, PAGE_SIZE, file) != PAGE_SIZE) {
+            ok = false;
+            break;
+        }
+        guest_memory_write(guest, page * PAGE_SIZE, page_data, PAGE_SIZE);
+    }
+
+    /* Device ranges come back without their devices */
+    uint32_t nr_regions = get_u32(file, &ok);
+    for (uint32_t i = 0; i < nr_regions && ok; i++) {
+        uint32_t base = get_u32(file, &ok);
+        uint32_t size = get_u32(file, &ok);
+        ok = ok && vm == guest && size != 0 && (uint64_t)base + size <= guest->memory_size &&
+             guest_mmio_map(guest, base, size, NULL, NULL);
+    }
+    if (vm == guest) {
+        guest->verify = hv->verify;
+        guest_verify_image(guest);
+    }
+    pthread_mutex_unlock(&vm->mem_lock);
+
+    hypervisor_log(hv, VISA_LOG_INFO,
+                   "[REPLAY] Restored Guest VM %u (%u KB memory, %u pages, PC=0x%X, %u instructions)\n", guest_id,
+                   guest->memory_size / 1024, populated, vcpu->pc, guest->instruction_count);
+    return ok;
+}
+
+/* ============ RECORD ============ */
+
+bool hypervisor_record_start(hypervisor_t* hv, const char* path) {
+    if (hv->replay) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[RECORD] A recording or replay is already active\n");
+        return false;
+    }
+
+    /* Snapshots hold memory by content, which would split shared pages */
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        const grant_table_t* grants = hv->guests[i].vm == &hv->guests[i] ? hv->guests[i].grants : NULL;
+        if (grants && (grants->pages_granted || grants->pages_mapped)) {
+            hypervisor_log(hv, VISA_LOG_ERROR,
+                           "[RECORD] Guest VM %u shares granted pages; start recording before any grant\n", i);
+            return false;
+        }
+    }
+
+    replay_t* replay = calloc(1, sizeof(replay_t));
+    char* buffer = malloc(REPLAY_BUFFER_SIZE);
+    FILE* file = fopen(path, "wb");
+    if (!replay || !buffer || !file) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[RECORD] Cannot open %s for writing\n", path);
+        if (file) fclose(file);
+        free(buffer);
+        free(replay);
+        return false;
+    }
+    setvbuf(file, buffer, _IOFBF, REPLAY_BUFFER_SIZE);
+
+    replay->mode = REPLAY_MODE_RECORD;
+    replay->file = file;
+    replay->buffer = buffer;
+
+    put_u32(replay, REPLAY_MAGIC);
+    put_u32(replay, REPLAY_VERSION);
+    put_u32(replay, hv->guest_count);
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        snapshot_guest(replay, &hv->guests[i]);
+    }
+
+    hypervisor_log(hv, VISA_LOG_INFO, "[RECORD] Recording %u guests to %s (snapshot %llu KB)\n",
+                   hv->guest_count, path, (unsigned long long)(replay->bytes / 1024));
+    replay->bytes = 0;  /* Report the event stream separately from the snapshot */
+    hv->replay = replay;
+    return true;
+}
+
+static void replay_close(replay_t* replay) {
+    fclose(replay->file);
+    free(replay->buffer);
+    free(replay);
+}
+
+void hypervisor_record_stop(hypervisor_t* hv) {
+    replay_t* replay = hv->replay;
+    if (!replay) return;
+    hv->replay = NULL;
+
+    if (replay->mode == REPLAY_MODE_RECORD) {
+        put_u8(replay, REPLAY_EVENT_END);
+        hypervisor_log(hv, VISA_LOG_INFO, "[RECORD] %llu events (%llu slices, %llu steps) in %llu bytes, "
+                       "%.1f bytes per slice\n",
+                       (unsigned long long)replay->events, (unsigned long long)replay->slices,
+                       (unsigned long long)replay->steps, (unsigned long long)replay->bytes,
+                       replay->slices ? (double)replay->bytes / (double)replay->slices : 0.0);
+    }
+    replay_close(replay);
+}
+
+/* ============ REPLAY ============ */
+
+static guest_vm_t* replay_guest(hypervisor_t* hv, uint32_t vm_id) {
+    return vm_id < hv->guest_count ? &hv->guests[vm_id] : NULL;
+}
+
+bool hypervisor_replay(hypervisor_t* hv, const char* path) {
+    if (hv->replay || hv->guest_count != 0) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[REPLAY] Replay needs a hypervisor with no guests\n");
+        return false;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[REPLAY] Cannot open %s\n", path);
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t magic = get_u32(file, &ok);
+    uint32_t version = get_u32(file, &ok);
+    uint32_t nr_guests = get_u32(file, &ok);
+    if (!ok || magic != REPLAY_MAGIC || version != REPLAY_VERSION || nr_guests > MAX_GUESTS) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[REPLAY] %s is not a version %u recording\n", path, REPLAY_VERSION);
+        fclose(file);
+        return false;
+    }
+    for (uint32_t i = 0; i < nr_guests && ok; i++) {
+        ok = restore_guest(hv, file);
+    }
+    if (!ok) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[REPLAY] %s: truncated or corrupt snapshot\n", path);
+        fclose(file);
+        return false;
+    }
+
+    /* Hooks fired by the replayed resumes must not record anything */
+    replay_t* replay = calloc(1, sizeof(replay_t));
+    if (!replay) {
+        fclose(file);
+        return false;
+    }
+    replay->mode = REPLAY_MODE_REPLAY;
+    replay->file = file;
+    hv->replay = replay;
+
+    hypervisor_log(hv, VISA_LOG_INFO, "[REPLAY] Replaying %s\n\n", path);
+
+    bool done = false, diverged = false;
+    while (ok && !done) {
+        uint8_t type = get_u8(file, &ok);
+        if (!ok) break;
+
+        switch (type) {
+            case REPLAY_EVENT_END:
+                done = true;
+                break;
+
+            case REPLAY_EVENT_SLICE: {
+                guest_vm_t* guest = replay_guest(hv, get_varint(file, &ok));
+                uint32_t steps = get_varint(file, &ok);
+                uint8_t flags = get_u8(file, &ok);
+                uint32_t fingerprint = get_u32(file, &ok);
+                if (!ok || !guest) {
+                    ok = false;
+                    break;
+                }
+
+                uint32_t start_steps = guest->steps;
+                if (guest->vcpu.state == GUEST_RUNNING) {
+                    hypervisor_run_slice_exact(hv, guest, steps,
+                                               (flags & REPLAY_SLICE_PREEMPTED) != 0);
+                }
+                uint32_t executed = guest->steps - start_steps;
+                if (replay->mmio_mismatch || replay->mmio_next != replay->mmio_count) {
+                    hypervisor_log(hv, VISA_LOG_ERROR,
+                                   "[REPLAY] Divergence at event %llu: guest %u made %u MMIO reads, "
+                                   "recording has %u%s\n", (unsigned long long)replay->events, guest->vm_id,
+                                   replay->mmio_next, replay->mmio_count, replay->mmio_mismatch ? " (ran out)" : "");
+                    diverged = true;
+                    ok = false;
+                    break;
+                }
+                replay->mmio_next = replay->mmio_count = 0;
+                if (executed != steps || replay_fingerprint(guest) != fingerprint) {
+                    hypervisor_log(hv, VISA_LOG_ERROR, "[REPLAY] Divergence at event %llu: guest %u ran %u of %u "
+                                   "steps (PC=0x%X, fingerprint %08X, recorded %08X)\n",
+                                   (unsigned long long)replay->events, guest->vm_id, executed, steps,
+                                   guest->vcpu.pc, replay_fingerprint(guest), fingerprint);
+                    diverged = true;
+                    ok = false;
+                    break;
+                }
+                replay->slices++;
+                replay->steps += executed;
+                break;
+            }
+
+            case REPLAY_EVENT_RESUME: {
+                guest_vm_t* guest = replay_guest(hv, get_varint(file, &ok));
+                uint32_t value = get_varint(file, &ok);
+                if (!ok || !guest) {
+                    ok = false;
+                    break;
+                }
+                hypervisor_resume_guest(hv, guest, value);
+                break;
+            }
+
+            case REPLAY_EVENT_STATE: {
+                guest_vm_t* guest = replay_guest(hv, get_varint(file, &ok));
+                uint32_t state = get_varint(file, &ok);
+                if (!ok || !guest || state > GUEST_PAUSED) {
+                    ok = false;
+                    break;
+                }
+                guest->vcpu.state = (guest_state_t)state;
+                break;
+            }
+
+            case REPLAY_EVENT_WRITE: {
+                guest_vm_t* guest = replay_guest(hv, get_varint(file, &ok));
+                uint32_t addr = get_varint(file, &ok);
+                uint32_t size = get_varint(file, &ok);
+                if (!ok || !guest || size == 0 || size > PAGE_SIZE || addr / PAGE_SIZE != (addr + size - 1) / PAGE_SIZE ||
+                    addr + size > guest->memory_size) {
+                    ok = false;
+                    break;
+                }
+                uint8_t data[PAGE_SIZE];
+                if (fread(data, 1, size, file) != size) {
+                    ok = false;
+                    break;
+                }
+                pthread_mutex_lock(&guest->vm->mem_lock);
+                guest_memory_write(guest, addr, data, size);
+                pthread_mutex_unlock(&guest->vm->mem_lock);
+                break;
+            }
+
+            case REPLAY_EVENT_MMIO_MAP: {
+                guest_vm_t* guest = replay_guest(hv, get_varint(file, &ok));
+                uint32_t base = get_varint(file, &ok);
+                uint32_t size = get_varint(file, &ok);
+                if (!ok || !guest || size == 0 || (uint64_t)base + size > guest->memory_size) {
+                    ok = false;
+                    break;
+                }
+                pthread_mutex_lock(&guest->vm->mem_lock);
+                ok = guest_mmio_map(guest->vm, base, size, NULL, NULL);
+                pthread_mutex_unlock(&guest->vm->mem_lock);
+                break;
+            }
+
+            case REPLAY_EVENT_GRANT: {
+                guest_vm_t* guest = replay_guest(hv, get_varint(file, &ok));
+                uint32_t op = get_varint(file, &ok);
+                uint32_t page = get_varint(file, &ok);
+                uint32_t nr_pages = get_varint(file, &ok);
+                guest_vm_t* owner = replay_guest(hv, get_varint(file, &ok));
+                uint32_t owner_page = get_varint(file, &ok);
+                if (!ok || !guest || !owner || op > GRANT_OP_UNMAP || nr_pages == 0 ||
+                    (uint64_t)page + nr_pages > guest->memory_size / PAGE_SIZE ||
+                    (uint64_t)owner_page + nr_pages > owner->memory_size / PAGE_SIZE) {
+                    ok = false;
+                    break;
+                }
+                guest = guest->vm;
+                owner = owner->vm;
+                pthread_mutex_lock(&guest->mem_lock);
+                if (owner != guest) pthread_mutex_lock(&owner->mem_lock);
+                guest_grant_apply(guest, (grant_op_t)op, page, nr_pages, owner, owner_page);
+                if (owner != guest) pthread_mutex_unlock(&owner->mem_lock);
+                pthread_mutex_unlock(&guest->mem_lock);
+                break;
+            }
+
+            case REPLAY_EVENT_MMIO_READ: {
+                uint32_t vm_id = get_varint(file, &ok);
+                uint8_t value = get_u8(file, &ok);
+                if (!ok || !replay_guest(hv, vm_id)) {
+                    ok = false;
+                    break;
+                }
+                if (replay->mmio_count == replay->mmio_capacity) {
+                    uint32_t capacity = replay->mmio_capacity ? replay->mmio_capacity * 2 : 256;
+                    uint32_t* reads = realloc(replay->mmio_reads, capacity * sizeof(uint32_t));
+                    if (!reads) {
+                        ok = false;
+                        break;
+                    }
+                    replay->mmio_reads = reads;
+                    replay->mmio_capacity = capacity;
+                }
+                replay->mmio_reads[replay->mmio_count++] = vm_id << 8 | value;
+                break;
+            }
+
+            default:
+                ok = false;
+                break;
+        }
+        if (!done) replay->events++;
+    }
+
+    if (!done && !diverged) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[REPLAY] %s: corrupt event %llu\n", path,
+                       (unsigned long long)replay->events);
+    } else if (ok) {
+        hypervisor_log(hv, VISA_LOG_INFO,
+                       "\n[REPLAY] Replayed %llu events (%llu slices, %llu steps) bit-exactly\n",
+                       (unsigned long long)replay->events, (unsigned long long)replay->slices,
+                       (unsigned long long)replay->steps);
+    }
+
+    hv->replay = NULL;
+    fclose(file);
+    free(replay->mmio_reads);
+    free(replay);
+    return ok && done;
+}
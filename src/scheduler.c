@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ ROUND-ROBIN POLICY ============ */
+/* FIFO ring; every runnable guest gets its own configured quantum in turn */
+
+static void rr_enqueue(scheduler_t* sched, guest_vm_t* guest) {
+    uint32_t slot = (sched->head + sched->nr_queued) % sched->capacity;
+    sched->queue[slot] = guest;
+    guest->sched.queue_index = (int32_t)slot;
+    sched->nr_queued++;
+}
+
+static guest_vm_t* rr_pick_next(scheduler_t* sched) {
+    if (sched->nr_queued == 0) return NULL;
+
+    guest_vm_t* guest = sched->queue[sched->head];
+    sched->head = (sched->head + 1) % sched->capacity;
+    sched->nr_queued--;
+    guest->sched.queue_index = -1;
+    return guest;
+}
+
+static uint64_t rr_slice_ns(scheduler_t* sched __attribute__((unused)),
+                            guest_vm_t* guest __attribute__((unused))) {
+    return 0;
+}
+
+static void rr_account(scheduler_t* sched __attribute__((unused)),
+                       guest_vm_t* guest __attribute__((unused)),
+                       uint64_t ran_ns __attribute__((unused))) {
+}
+
+static void rr_remove(scheduler_t* sched, guest_vm_t* guest) {
+    /* Close the gap by shifting later entries towards the head */
+    uint32_t pos = ((uint32_t)guest->sched.queue_index + sched->capacity - sched->head) % sched->capacity;
+    for (uint32_t i = pos; i + 1 < sched->nr_queued; i++) {
+        uint32_t to = (sched->head + i) % sched->capacity;
+        uint32_t from = (sched->head + i + 1) % sched->capacity;
+        sched->queue[to] = sched->queue[from];
+        sched->queue[to]->sched.queue_index = (int32_t)to;
+    }
+    sched->nr_queued--;
+    guest->sched.queue_index = -1;
+}
+
+/* ============ WEIGHTED FAIR-SHARE POLICY ============ */
+/* Binary min-heap keyed on vruntime: O(log n) enqueue and pick */
+
+static void heap_swap(scheduler_t* sched, uint32_t a, uint32_t b) {
+    guest_vm_t* tmp = sched->queue[a];
+    sched->queue[a] = sched->queue[b];
+    sched->queue[b] = tmp;
+    sched->queue[a]->sched.queue_index = (int32_t)a;
+    sched->queue[b]->sched.queue_index = (int32_t)b;
+}
+
+static void heap_sift_up(scheduler_t* sched, uint32_t i) {
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (sched->queue[parent]->sched.vruntime <= sched->queue[i]->sched.vruntime) break;
+        heap_swap(sched, parent, i);
+        i = parent;
+    }
+}
+
+static void heap_sift_down(scheduler_t* sched, uint32_t i) {
+    for (;;) {
+        uint32_t left = 2 * i + 1;
+        uint32_t right = left + 1;
+        uint32_t smallest = i;
+
+        if (left < sched->nr_queued &&
+            sched->queue[left]->sched.vruntime < sched->queue[smallest]->sched.vruntime) {
+            smallest = left;
+        }
+        if (right < sched->nr_queued &&
+            sched->queue[right]->sched.vruntime < sched->queue[smallest]->sched.vruntime) {
+            smallest = right;
+        }
+        if (smallest == i) break;
+
+        heap_swap(sched, i, smallest);
+        i = smallest;
+    }
+}
+
+static void fair_enqueue(scheduler_t* sched, guest_vm_t* guest) {
+    uint32_t i = sched->nr_queued++;
+    sched->queue[i] = guest;
+    guest->sched.queue_index = (int32_t)i;
+    heap_sift_up(sched, i);
+}
+
+static void fair_remove_at(scheduler_t* sched, uint32_t i) {
+    guest_vm_t* guest = sched->queue[i];
+    uint32_t last = --sched->nr_queued;
+
+    if (i != last) {
+        sched->queue[i] = sched->queue[last];
+        sched->queue[i]->sched.queue_index = (int32_t)i;
+        heap_sift_down(sched, i);
+        heap_sift_up(sched, i);
+    }
+    guest->sched.queue_index = -1;
+}
+
+static guest_vm_t* fair_pick_next(scheduler_t* sched) {
+    if (sched->nr_queued == 0) return NULL;
+
+    guest_vm_t* guest = sched->queue[0];
+    fair_remove_at(sched, 0);
+
+    if (guest->sched.vruntime > sched->min_vruntime) {
+        sched->min_vruntime = guest->sched.vruntime;
+    }
+    return guest;
+}
+
+static uint64_t fair_slice_ns(scheduler_t* sched, guest_vm_t* guest) {
+    /* Stretch the latency period once each guest would drop below the minimum
+       granularity, then split it in proportion to weight */
+    uint64_t period = SCHED_LATENCY_NS;
+    if ((uint64_t)sched->nr_running * SCHED_MIN_GRANULARITY_NS > period) {
+        period = (uint64_t)sched->nr_running * SCHED_MIN_GRANULARITY_NS;
+    }
+
+    uint64_t total = sched->total_weight ? sched->total_weight : guest->sched.weight;
+    uint64_t slice = period * guest->sched.weight / total;
+    return slice < SCHED_MIN_GRANULARITY_NS ? SCHED_MIN_GRANULARITY_NS : slice;
+}
+
+static void fair_account(scheduler_t* sched __attribute__((unused)), guest_vm_t* guest, uint64_t ran_ns) {
+    guest->sched.vruntime += ran_ns * SCHED_DEFAULT_WEIGHT / guest->sched.weight;
+}
+
+static const sched_ops_t round_robin_ops = {
+    .name = "round-robin",
+    .enqueue = rr_enqueue,
+    .pick_next = rr_pick_next,
+    .slice_ns = rr_slice_ns,
+    .account = rr_account,
+};
+
+static const sched_ops_t fair_share_ops = {
+    .name = "fair-share",
+    .enqueue = fair_enqueue,
+    .pick_next = fair_pick_next,
+    .slice_ns = fair_slice_ns,
+    .account = fair_account,
+};
+
+/* ============ SCHEDULER CORE ============ */
+
+const sched_ops_t* scheduler_ops_for(sched_policy_t policy) {
+    return policy == SCHED_POLICY_FAIR_SHARE ? &fair_share_ops : &round_robin_ops;
+}
+
+bool scheduler_init(scheduler_t* sched, sched_policy_t policy, uint32_t capacity) {
+    memset(sched, 0, sizeof(*sched));
+    sched->queue = (guest_vm_t**)calloc(capacity, sizeof(guest_vm_t*));
+    sched->throttled = (guest_vm_t**)calloc(capacity, sizeof(guest_vm_t*));
+    if (!sched->queue || !sched->throttled) {
+        scheduler_destroy(sched);
+        return false;
+    }
+
+    sched->capacity = capacity;
+    sched->policy = policy;
+    sched->ops = scheduler_ops_for(policy);
+    return true;
+}
+
+void scheduler_destroy(scheduler_t* sched) {
+    free(sched->queue);
+    free(sched->throttled);
+    sched->queue = NULL;
+    sched->throttled = NULL;
+}
+
+static void queue_guest(scheduler_t* sched, guest_vm_t* guest) {
+    /* A guest returning from sleep must not bank unbounded credit */
+    if (guest->sched.vruntime < sched->min_vruntime) {
+        guest->sched.vruntime = sched->min_vruntime;
+    }
+    sched->ops->enqueue(sched, guest);
+}
+
+void scheduler_enqueue(scheduler_t* sched, guest_vm_t* guest) {
+    if (guest->sched.queue_index >= 0 || guest->sched.throttled) return;
+
+    sched->nr_running++;
+    sched->total_weight += guest->sched.weight;
+    queue_guest(sched, guest);
+}
+
+void scheduler_remove(scheduler_t* sched, guest_vm_t* guest) {
+    if (guest->sched.throttled) {
+        for (uint32_t i = 0; i < sched->nr_throttled; i++) {
+            if (sched->throttled[i] == guest) {
+                sched->throttled[i] = sched->throttled[--sched->nr_throttled];
+                break;
+            }
+        }
+        guest->sched.throttled = false;
+        return;  /* Throttled guests are already out of the runnable set */
+    }
+
+    if (guest->sched.queue_index < 0) return;
+
+    if (sched->policy == SCHED_POLICY_FAIR_SHARE) {
+        fair_remove_at(sched, (uint32_t)guest->sched.queue_index);
+    } else {
+        rr_remove(sched, guest);
+    }
+    sched->nr_running--;
+    sched->total_weight -= guest->sched.weight;
+}
+
+bool scheduler_take(scheduler_t* sched, guest_vm_t* guest) {
+    if (guest->sched.queue_index < 0) return false;
+
+    if (sched->policy == SCHED_POLICY_FAIR_SHARE) {
+        fair_remove_at(sched, (uint32_t)guest->sched.queue_index);
+    } else {
+        rr_remove(sched, guest);
+    }
+    return true;
+}
+
+static void refill_cap_quota(scheduler_t* sched, uint64_t now_ns) {
+    if (now_ns - sched->cap_period_start_ns < SCHED_CAP_PERIOD_NS) return;
+
+    /* Entities notice the new period lazily in scheduler_account() */
+    sched->cap_period_start_ns = now_ns;
+    sched->cap_period++;
+
+    for (uint32_t i = 0; i < sched->nr_throttled; i++) {
+        guest_vm_t* guest = sched->throttled[i];
+        guest->sched.throttled = false;
+        scheduler_enqueue(sched, guest);
+    }
+    sched->nr_throttled = 0;
+}
+
+guest_vm_t* scheduler_pick_next(scheduler_t* sched, uint64_t now_ns, uint64_t* wait_ns) {
+    if (sched->cap_period_start_ns == 0) {
+        sched->cap_period_start_ns = now_ns;
+    }
+    refill_cap_quota(sched, now_ns);
+
+    guest_vm_t* guest = sched->ops->pick_next(sched);
+    if (!guest && wait_ns) {
+        *wait_ns = sched->nr_throttled
+            ? sched->cap_period_start_ns + SCHED_CAP_PERIOD_NS - now_ns
+            : 0;
+    }
+    return guest;
+}
+
+void scheduler_account(scheduler_t* sched, guest_vm_t* guest, uint64_t ran_ns, bool runnable) {
+    guest->sched.total_runtime_ns += ran_ns;
+    sched->ops->account(sched, guest, ran_ns);
+
+    bool over_cap = false;
+    if (guest->sched.cpu_cap) {
+        if (guest->sched.cap_period != sched->cap_period) {
+            guest->sched.cap_period = sched->cap_period;
+            guest->sched.cap_used_ns = 0;
+        }
+        guest->sched.cap_used_ns += ran_ns;
+        over_cap = guest->sched.cap_used_ns >= SCHED_CAP_PERIOD_NS * guest->sched.cpu_cap / 100;
+    }
+
+    if (!runnable || over_cap) {
+        sched->nr_running--;
+        sched->total_weight -= guest->sched.weight;
+
+        if (runnable) {
+            guest->sched.throttled = true;
+            sched->throttled[sched->nr_throttled++] = guest;
+        }
+        return;
+    }
+
+    queue_guest(sched, guest);
+}
+
+/* ============ HYPERVISOR RUN LOOP ============ */
+
+void hypervisor_set_scheduler(hypervisor_t* hv, sched_policy_t policy) {
+    /* Rebuild the run queue under the new policy, keeping runnable guests */
+    scheduler_t* sched = &hv->scheduler;
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        scheduler_remove(sched, &hv->guests[i]);
+    }
+
+    sched->policy = policy;
+    sched->ops = scheduler_ops_for(policy);
+    sched->head = 0;
+    sched->nr_queued = 0;
+    sched->nr_running = 0;
+    sched->total_weight = 0;
+
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        if (hv->guests[i].vcpu.state == GUEST_RUNNING) {
+            scheduler_enqueue(sched, &hv->guests[i]);
+        }
+    }
+}
+
+void hypervisor_set_sched_params(hypervisor_t* hv, uint32_t guest_id, uint32_t weight, uint32_t cpu_cap) {
+    if (guest_id == 0 || guest_id > hv->guest_count) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[HYPERVISOR] Invalid guest ID\n");
+        return;
+    }
+
+    guest_vm_t* guest = &hv->guests[guest_id - 1];
+    bool queued = guest->sched.queue_index >= 0;
+    if (queued) scheduler_remove(&hv->scheduler, guest);
+
+    guest->sched.weight = weight ? weight : SCHED_DEFAULT_WEIGHT;
+    guest->sched.cpu_cap = cpu_cap > 100 ? 100 : cpu_cap;
+
+    if (queued) scheduler_enqueue(&hv->scheduler, guest);
+}
+
+uint32_t hypervisor_run(hypervisor_t* hv) {
+    scheduler_t* sched = &hv->scheduler;
+    uint32_t total_ticks = 0;
+
+    hypervisor_log(hv, VISA_LOG_INFO, "[SCHEDULER] Starting preemptive %s execution\n\n", sched->ops->name);
+
+    for (;;) {
+        hypervisor_poll_events(hv);
+
+        uint64_t wait_ns = 0;
+        guest_vm_t* guest = scheduler_pick_next(sched, hypervisor_time_ns(), &wait_ns);
+
+        if (!guest) {
+            if (wait_ns == 0 && hv->waitq.nr_waiters == 0) break;  /* Every guest has stopped */
+
+            /* Nothing runnable: sleep until a wakeup, timer or cap refill */
+            if (!hypervisor_idle_wait(hv, wait_ns)) {
+                hypervisor_log(hv, VISA_LOG_WARN, "[SCHEDULER] Deadlock: %u guests blocked with no pending wakeup\n",
+                               hv->waitq.nr_waiters);
+                break;
+            }
+            continue;
+        }
+
+        hypervisor_log(hv, VISA_LOG_DEBUG, "[TICK %u] Running Guest VM %u time slice...\n", total_ticks, guest->vm_id);
+
+        /* The scheduler slice can only shorten the guest's own quantum */
+        uint64_t slice_ns = sched->ops->slice_ns(sched, guest);
+        uint64_t quantum_ns = guest->quantum_ns;
+        if (slice_ns && (quantum_ns == 0 || slice_ns < quantum_ns)) {
+            quantum_ns = slice_ns;
+        }
+
+        hypervisor_place_vcpu(hv, guest);
+
+        if (hv->spmd && hypervisor_run_lockstep(hv, guest, quantum_ns)) {
+            total_ticks++;
+            continue;
+        }
+
+        uint32_t start_count = guest->instruction_count;
+        uint64_t start_ns = hypervisor_time_ns();
+        vmcause_t cause = hypervisor_run_slice_budget(hv, guest, guest->quantum_instructions, quantum_ns);
+        uint64_t ran_ns = hypervisor_time_ns() - start_ns;
+
+        hypervisor_log(hv, VISA_LOG_DEBUG, "  [Guest %u completed %u instructions this slice, total: %u%s]\n",
+                       guest->vm_id, guest->instruction_count - start_count, guest->instruction_count,
+                       cause == VMCAUSE_TIMER ? ", preempted" : "");
+
+        bool runnable = hypervisor_handle_exit(hv, guest, cause);
+        scheduler_account(sched, guest, ran_ns, runnable);
+        total_ticks++;
+    }
+
+    hypervisor_log(hv, VISA_LOG_INFO, "\n[SCHEDULER] All guests stopped after %u time slices\n\n", total_ticks);
+    return total_ticks;
+}
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+/* ============ BATCH SETUP / TEARDOWN ============ */
+
+static uint32_t* spmd_column(spmd_batch_t* batch, uint32_t reg) {
+    return &batch->regs[reg * batch->stride];
+}
+
+bool spmd_batch_init(spmd_batch_t* batch, guest_vm_t** guests, uint32_t count) {
+    memset(batch, 0, sizeof(*batch));
+    batch->nr_lanes = count;
+    batch->stride = (count + SPMD_LANE_ALIGN - 1) / SPMD_LANE_ALIGN * SPMD_LANE_ALIGN;
+
+    batch->lanes = (guest_vm_t**)calloc(count, sizeof(guest_vm_t*));
+    batch->regs = (uint32_t*)calloc((size_t)REGISTER_COUNT * batch->stride, sizeof(uint32_t));
+    batch->pc = (uint32_t*)calloc(batch->stride, sizeof(uint32_t));
+    batch->sp = (uint32_t*)calloc(batch->stride, sizeof(uint32_t));
+    batch->mask = (uint32_t*)calloc(batch->stride, sizeof(uint32_t));
+    batch->taken = (uint32_t*)calloc(batch->stride, sizeof(uint32_t));
+    batch->retired = (uint32_t*)calloc(batch->stride, sizeof(uint32_t));
+    batch->live = (uint8_t*)calloc(batch->stride, sizeof(uint8_t));
+    if (!batch->lanes || !batch->regs || !batch->pc || !batch->sp || !batch->mask ||
+        !batch->taken || !batch->retired || !batch->live) {
+        spmd_batch_destroy(batch);
+        return false;
+    }
+
+    /* Transpose each guest's register file into the lane columns */
+    batch->code_size = UINT32_MAX;
+    for (uint32_t lane = 0; lane < count; lane++) {
+        guest_vm_t* guest = guests[lane];
+        batch->lanes[lane] = guest;
+        for (uint32_t r = 0; r < REGISTER_COUNT; r++) {
+            spmd_column(batch, r)[lane] = guest->vcpu.registers[r];
+        }
+        batch->pc[lane] = guest->vcpu.pc;
+        batch->sp[lane] = guest->vcpu.sp;
+        batch->live[lane] = 1;
+        if (guest->code_size < batch->code_size) batch->code_size = guest->code_size;
+    }
+    batch->nr_live = count;
+    return true;
+}
+
+void spmd_batch_destroy(spmd_batch_t* batch) {
+    free(batch->lanes);
+    free(batch->regs);
+    free(batch->pc);
+    free(batch->sp);
+    free(batch->mask);
+    free(batch->taken);
+    free(batch->retired);
+    free(batch->live);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/* Copy one lane back into its guest and take it out of lockstep */
+static void spmd_retire_lane(spmd_batch_t* batch, uint32_t lane) {
+    guest_vm_t* guest = batch->lanes[lane];
+
+    for (uint32_t r = 0; r < REGISTER_COUNT; r++) {
+        guest->vcpu.registers[r] = spmd_column(batch, r)[lane];
+    }
+    guest->vcpu.pc = batch->pc[lane];
+    guest->vcpu.sp = batch->sp[lane];
+    guest->instruction_count += batch->retired[lane];
+    guest->steps += batch->retired[lane];  /* Lanes never take trap exits */
+    batch->retired[lane] = 0;
+
+    batch->live[lane] = 0;
+    batch->mask[lane] = 0;
+    batch->nr_live--;
+}
+
+/* Hand a lane to the scalar engine at its current PC */
+static void spmd_eject_lane(spmd_batch_t* batch, uint32_t lane) {
+    spmd_retire_lane(batch, lane);
+    batch->lanes[lane]->spmd_ejected = true;
+    batch->ejected++;
+}
+
+static void spmd_eject_group(spmd_batch_t* batch) {
+    for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+        if (batch->mask[lane]) spmd_eject_lane(batch, lane);
+    }
+}
+
+/* ============ LOCKSTEP EXECUTION ============ */
+
+static bool spmd_lane_capable(const guest_vm_t* guest) {
+    return guest->vcpu.state == GUEST_RUNNING && !guest->spmd_ejected && guest->vm->nr_vcpus == 1 &&
+           !guest->vm->mmio && !guest->vm->grants && !guest->vcpu.ivt_base && !guest->vcpu.timer_period &&
+           !(guest->vcpu.vmcs.trap_config & VMTRAPCFG_PAGE_FAULT);
+}
+
+/* Instructions that can run in lockstep; everything else (exits, privileged
+   and virtualization instructions) ejects the group to the scalar engine */
+static bool spmd_supported(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOV:
+        case OP_LOAD: case OP_STORE:
+        case OP_JMP: case OP_JEQ: case OP_JNE: case OP_CALL: case OP_RET:
+        case OP_MOVI: case OP_ADDI: case OP_SUBI: case OP_MULI: case OP_DIVI:
+        case OP_HALT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* dst = op(a, b) on group lanes, blended so other lanes keep their value */
+#define SPMD_BLEND_LOOP(n, mask, dst, expr)                       \
+    for (uint32_t i = 0; i < (n); i++) {                          \
+        uint32_t m = (mask)[i];                                   \
+        (dst)[i] = (m & (expr)) | (~m & (dst)[i]);                \
+    }
+
+/* Select the lanes at the lowest PC; returns the group size */
+static uint32_t spmd_select_group(spmd_batch_t* batch, uint32_t* group_pc) {
+    uint32_t min_pc = UINT32_MAX;
+    for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+        if (batch->live[lane] && batch->pc[lane] < min_pc) min_pc = batch->pc[lane];
+    }
+
+    uint32_t size = 0;
+    for (uint32_t lane = 0; lane < batch->stride; lane++) {
+        uint32_t in_group = batch->live[lane] && batch->pc[lane] == min_pc;
+        batch->mask[lane] = 0u - in_group;
+        size += in_group;
+    }
+
+    *group_pc = min_pc;
+    return size;
+}
+
+static void spmd_branch(spmd_batch_t* batch, uint32_t target, bool on_equal,
+                        const uint32_t* a, const uint32_t* b, uint32_t group_size) {
+    uint32_t taken = 0;
+    for (uint32_t lane = 0; lane < batch->stride; lane++) {
+        uint32_t t = batch->mask[lane] & (0u - (uint32_t)((a[lane] == b[lane]) == on_equal));
+        batch->taken[lane] = t;
+        taken += t & 1;
+    }
+    SPMD_BLEND_LOOP(batch->stride, batch->taken, batch->pc, target);
+
+    if (taken != 0 && taken != group_size) {
+        batch->splits++;
+    }
+}
+
+uint64_t spmd_batch_run(spmd_batch_t* batch, uint64_t max_steps, uint64_t deadline_ns) {
+    uint64_t start_steps = batch->steps;
+    uint32_t n = batch->stride;
+    uint32_t prev_group = 0;
+
+    while (batch->nr_live > 0 && (max_steps == 0 || batch->steps - start_steps < max_steps)) {
+        /* The clock is read as often as the scalar engine reads it: once a block */
+        if (deadline_ns && (batch->steps - start_steps) % MAX_BLOCK_INSTRUCTIONS == 0 &&
+            batch->steps != start_steps && hypervisor_time_ns() >= deadline_ns) {
+            break;
+        }
+
+        uint32_t pc;
+        uint32_t group_size = spmd_select_group(batch, &pc);
+        if (prev_group && group_size > prev_group) {
+            batch->merges++;
+        }
+        prev_group = group_size;
+
+        /* Decode once for the whole group from any member's (shared) code */
+        guest_vm_t* leader = NULL;
+        for (uint32_t lane = 0; lane < batch->nr_lanes && !leader; lane++) {
+            if (batch->mask[lane]) leader = batch->lanes[lane];
+        }
+
+        uint32_t guest_phys_addr = guest_translate_address(leader, pc);
+        if (guest_phys_addr == 0xFFFFFFFF || guest_phys_addr + INSTRUCTION_SIZE > leader->memory_size) {
+            spmd_eject_group(batch);  /* Scalar engine raises the page fault */
+            continue;
+        }
+
+        instruction_t instr;
+        instr.opcode = guest_read8(leader, guest_phys_addr);
+        instr.rd = guest_read8(leader, guest_phys_addr + 1);
+        instr.rs1 = guest_read8(leader, guest_phys_addr + 2);
+        instr.rs2 = guest_read8(leader, guest_phys_addr + 3);
+
+        if (!spmd_supported(instr.opcode)) {
+            spmd_eject_group(batch);
+            continue;
+        }
+
+        batch->steps++;
+        batch->lane_instructions += group_size;
+        for (uint32_t lane = 0; lane < n; lane++) {
+            batch->pc[lane] += batch->mask[lane] & INSTRUCTION_SIZE;
+            batch->retired[lane] += batch->mask[lane] & 1;
+        }
+
+        /* Register operands are uniform across the group: validate them once */
+        bool rd_ok = instr.rd < REGISTER_COUNT;
+        bool rs1_ok = instr.rs1 < REGISTER_COUNT;
+        bool rs2_ok = instr.rs2 < REGISTER_COUNT;
+        uint32_t* d = rd_ok ? spmd_column(batch, instr.rd) : NULL;
+        const uint32_t* a = rs1_ok ? spmd_column(batch, instr.rs1) : NULL;
+        const uint32_t* b = rs2_ok ? spmd_column(batch, instr.rs2) : NULL;
+        const uint32_t* mask = batch->mask;
+        uint32_t imm = instr.rs2;
+
+        switch (instr.opcode) {
+            case OP_ADD:
+                if (rd_ok && rs1_ok && rs2_ok) SPMD_BLEND_LOOP(n, mask, d, a[i] + b[i]);
+                break;
+            case OP_SUB:
+                if (rd_ok && rs1_ok && rs2_ok) SPMD_BLEND_LOOP(n, mask, d, a[i] - b[i]);
+                break;
+            case OP_MUL:
+                if (rd_ok && rs1_ok && rs2_ok) SPMD_BLEND_LOOP(n, mask, d, a[i] * b[i]);
+                break;
+            case OP_DIV:
+                if (rd_ok && rs1_ok && rs2_ok) {
+                    for (uint32_t i = 0; i < n; i++) {
+                        if (mask[i] && b[i] != 0) d[i] = a[i] / b[i];
+                    }
+                }
+                break;
+            case OP_MOV:
+                if (rd_ok && rs1_ok) SPMD_BLEND_LOOP(n, mask, d, a[i]);
+                break;
+
+            case OP_MOVI:
+                if (rd_ok) SPMD_BLEND_LOOP(n, mask, d, imm);
+                break;
+            case OP_ADDI:
+                if (rd_ok && rs1_ok) SPMD_BLEND_LOOP(n, mask, d, a[i] + imm);
+                break;
+            case OP_SUBI:
+                if (rd_ok && rs1_ok) SPMD_BLEND_LOOP(n, mask, d, a[i] - imm);
+                break;
+            case OP_MULI:
+                if (rd_ok && rs1_ok) SPMD_BLEND_LOOP(n, mask, d, a[i] * imm);
+                break;
+            case OP_DIVI:
+                if (rd_ok && rs1_ok && imm != 0) SPMD_BLEND_LOOP(n, mask, d, a[i] / imm);
+                break;
+
+            /* Memory is per guest: gather/scatter lane by lane */
+            case OP_LOAD:
+                if (rd_ok && rs1_ok) {
+                    for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+                        if (!mask[lane]) continue;
+                        guest_vm_t* guest = batch->lanes[lane];
+                        uint32_t addr = guest_translate_address(guest, a[lane]);
+                        if (addr != 0xFFFFFFFF) d[lane] = guest_read8(guest, addr);
+                    }
+                }
+                break;
+
+            case OP_STORE:
+                if (rs1_ok && rs2_ok) {
+                    for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+                        if (!mask[lane]) continue;
+                        guest_vm_t* guest = batch->lanes[lane];
+                        uint32_t addr = guest_translate_address(guest, a[lane]);
+                        if (addr == 0xFFFFFFFF) continue;
+
+                        if (addr < batch->code_size || guest->ept[addr / PAGE_SIZE].code) {
+                            /* Writing code would break the shared decode: replay the
+                               store on the scalar engine, which handles SMC */
+                            batch->pc[lane] = pc;
+                            batch->retired[lane]--;
+                            spmd_eject_lane(batch, lane);
+                            continue;
+                        }
+                        guest_write8(guest, addr, (uint8_t)b[lane]);
+                    }
+                }
+                break;
+
+            /* Branch targets are instruction indices in rd, as in the scalar engine */
+            case OP_JMP:
+                SPMD_BLEND_LOOP(n, mask, batch->pc, instr.rd * INSTRUCTION_SIZE);
+                break;
+            case OP_JEQ:
+                if (rs1_ok && rs2_ok) spmd_branch(batch, instr.rd * INSTRUCTION_SIZE, true, a, b, group_size);
+                break;
+            case OP_JNE:
+                if (rs1_ok && rs2_ok) spmd_branch(batch, instr.rd * INSTRUCTION_SIZE, false, a, b, group_size);
+                break;
+
+            case OP_CALL:
+                for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+                    if (!mask[lane] || batch->sp[lane] <= 3) continue;
+                    guest_vm_t* guest = batch->lanes[lane];
+                    uint32_t sp = batch->sp[lane];
+                    uint32_t return_addr = batch->pc[lane];
+                    guest_write8(guest, sp - 3, (return_addr >> 24) & 0xFF);
+                    guest_write8(guest, sp - 2, (return_addr >> 16) & 0xFF);
+                    guest_write8(guest, sp - 1, (return_addr >> 8) & 0xFF);
+                    guest_write8(guest, sp, return_addr & 0xFF);
+                    batch->sp[lane] = sp - 4;
+
+                    if (instr.rd != 0) {
+                        batch->pc[lane] = instr.rd * INSTRUCTION_SIZE;
+                    } else if (rs1_ok) {
+                        batch->pc[lane] = a[lane];
+                    }
+                }
+                break;
+
+            case OP_RET:
+                for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+                    if (!mask[lane] || batch->sp[lane] + 4 >= batch->lanes[lane]->memory_size) continue;
+                    guest_vm_t* guest = batch->lanes[lane];
+                    uint32_t saved_sp = batch->sp[lane] + 4;
+                    batch->pc[lane] = ((uint32_t)guest_read8(guest, saved_sp - 3) << 24) |
+                                      ((uint32_t)guest_read8(guest, saved_sp - 2) << 16) |
+                                      ((uint32_t)guest_read8(guest, saved_sp - 1) << 8) |
+                                      ((uint32_t)guest_read8(guest, saved_sp));
+                    batch->sp[lane] = saved_sp;
+                }
+                break;
+
+            case OP_HALT:
+                for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+                    if (!mask[lane]) continue;
+                    spmd_retire_lane(batch, lane);
+                    batch->lanes[lane]->vcpu.state = GUEST_STOPPED;
+                }
+                break;
+        }
+    }
+
+    /* Step budget exhausted: hand the remaining lanes back, still runnable */
+    for (uint32_t lane = 0; lane < batch->nr_lanes; lane++) {
+        if (batch->live[lane]) spmd_retire_lane(batch, lane);
+    }
+
+    return batch->steps - start_steps;
+}
+
+/* ============ HYPERVISOR BATCH MODE ============ */
+
+uint32_t hypervisor_run_lockstep(hypervisor_t* hv, guest_vm_t* leader, uint64_t nanoseconds) {
+    scheduler_t* sched = &hv->scheduler;
+    guest_vm_t* group[MAX_GUESTS];
+    uint32_t count = 0;
+
+    /* SMP guests share memory between vCPUs, and lanes have no MMIO dispatch,
+       interrupt delivery or fault exits, so none of these run as a lane */
+    if (!spmd_lane_capable(leader)) return 0;
+
+    /* Queued guests with the leader's image and PC join it */
+    group[count++] = leader;
+    for (uint32_t i = 0; i < hv->guest_count; i++) {
+        guest_vm_t* guest = &hv->guests[i];
+        if (guest != leader && guest->sched.queue_index >= 0 && spmd_lane_capable(guest) &&
+            guest->image_hash == leader->image_hash &&
+            guest->image_size == leader->image_size &&
+            guest->vcpu.pc == leader->vcpu.pc) {
+            group[count++] = guest;
+        }
+    }
+    if (count < SPMD_MIN_LANES) return 0;
+
+    spmd_batch_t batch;
+    if (!spmd_batch_init(&batch, group, count)) {
+        hypervisor_log(hv, VISA_LOG_ERROR, "[SPMD] Out of memory for %u-lane batch\n", count);
+        return 0;
+    }
+
+    /* No lane may retire more than its own quantum: one dispatch retires at
+       most one instruction per lane */
+    uint32_t quantum = 0;
+    uint32_t start_steps[MAX_GUESTS];
+    for (uint32_t lane = 0; lane < count; lane++) {
+        guest_vm_t* guest = group[lane];
+        if (lane > 0) scheduler_take(sched, guest);
+        if (guest->quantum_instructions && (quantum == 0 || guest->quantum_instructions < quantum)) {
+            quantum = guest->quantum_instructions;
+        }
+        start_steps[lane] = guest->steps;
+        pthread_mutex_lock(&guest->mem_lock);
+    }
+
+    /* A batch does one guest's dispatch for every lane; it is charged to
+       the hypervisor row rather than split across guests */
+    uint64_t start_ns = hypervisor_time_ns();
+    if (hv->perf) perf_switch(hv->perf, PERF_HOST, PERF_PHASE_DISPATCH);
+    spmd_batch_run(&batch, quantum, nanoseconds ? start_ns + nanoseconds : 0);
+    if (hv->perf) perf_switch(hv->perf, PERF_HOST, PERF_PHASE_SCHED);
+    uint64_t end_ns = hypervisor_time_ns();
+    for (uint32_t lane = 0; lane < count; lane++) {
+        __atomic_store_n(&group[lane]->last_run_ns, end_ns, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&group[lane]->mem_lock);
+    }
+
+    /* Lanes share no state, so each replays as one scalar slice */
+    for (uint32_t lane = 0; hv->replay && lane < count; lane++) {
+        replay_record_slice(hv->replay, group[lane], group[lane]->steps - start_steps[lane], false);
+    }
+    hypervisor_log(hv, VISA_LOG_DEBUG, "[SPMD] Batch of %u guests: %llu dispatches for %llu guest instructions "
+                   "(%llu splits, %llu merges, %u ejected)\n", count, (unsigned long long)batch.steps,
+                   (unsigned long long)batch.lane_instructions, (unsigned long long)batch.splits,
+                   (unsigned long long)batch.merges, batch.ejected);
+
+    /* Each lane pays an equal share of the batch; halted lanes leave the run
+       queue, the rest (ejected lanes included) go back on it */
+    for (uint32_t lane = 0; lane < count; lane++) {
+        scheduler_account(sched, group[lane], (end_ns - start_ns) / count,
+                          group[lane]->vcpu.state == GUEST_RUNNING);
+    }
+
+    spmd_batch_destroy(&batch);
+    return count;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include "../include/isa.h"
+
+/* ============ INSTRUCTION RULES ============ */
+/* Operand roles per opcode, matching what execute_block reads. An instruction
+   whose operands all pass needs none of the executor's range checks. */
+#define OPERAND_RD 0x01
+#define OPERAND_RS1 0x02
+#define OPERAND_RS2 0x04
+#define OPERAND_TARGET 0x08     /* rd is an instruction index */
+#define OPERAND_UNKNOWN -1
+
+static int operand_roles(uint8_t opcode, uint8_t rd) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+        case OP_CAS: case OP_FADD:
+            return OPERAND_RD | OPERAND_RS1 | OPERAND_RS2;
+        case OP_MOV: case OP_LOAD:
+        case OP_ADDI: case OP_SUBI: case OP_MULI: case OP_DIVI:
+            return OPERAND_RD | OPERAND_RS1;
+        case OP_STORE:
+            return OPERAND_RS1 | OPERAND_RS2;
+        case OP_JMP:
+            return OPERAND_TARGET;
+        case OP_JEQ: case OP_JNE:
+            return OPERAND_TARGET | OPERAND_RS1 | OPERAND_RS2;
+        case OP_CALL:
+            return rd != 0 ? OPERAND_TARGET : OPERAND_RS1;  /* call LABEL / call rN */
+        case OP_MOVI:
+        case OP_SYSCALL: case OP_HYPERCALL: case OP_IPI:
+        case OP_LIVT: case OP_STIMER:
+        case OP_VMENTER: case OP_VMRESUME: case OP_VMCAUSE:
+        case OP_VMTRAPCFG: case OP_LDPGTR: case OP_LDHPTR:
+            return OPERAND_RD;
+        case OP_RET: case OP_FENCE: case OP_IRET: case OP_TLBFLUSHV: case OP_HALT:
+            return 0;
+        default:
+            return OPERAND_UNKNOWN;
+    }
+}
+
+verify_status_t verify_instruction(const uint8_t* bytes, uint32_t code_size) {
+    uint8_t opcode = bytes[0], rd = bytes[1], rs1 = bytes[2], rs2 = bytes[3];
+    int roles = operand_roles(opcode, rd);
+    if (roles == OPERAND_UNKNOWN) return VERIFY_BAD_OPCODE;
+
+    if (((roles & OPERAND_RD) && rd >= REGISTER_COUNT) ||
+        ((roles & OPERAND_RS1) && rs1 >= REGISTER_COUNT) ||
+        ((roles & OPERAND_RS2) && rs2 >= REGISTER_COUNT)) {
+        return VERIFY_BAD_REGISTER;
+    }
+    if ((roles & OPERAND_TARGET) && (uint32_t)rd * INSTRUCTION_SIZE + INSTRUCTION_SIZE > code_size) {
+        return VERIFY_BAD_TARGET;
+    }
+    if (opcode == OP_DIVI && rs2 == 0) return VERIFY_BAD_IMMEDIATE;
+    return VERIFY_OK;
+}
+
+const char* verify_status_name(verify_status_t status) {
+    switch (status) {
+        case VERIFY_OK: return "ok";
+        case VERIFY_BAD_OPCODE: return "unknown opcode";
+        case VERIFY_BAD_REGISTER: return "register out of range";
+        case VERIFY_BAD_IMMEDIATE: return "divide by immediate zero";
+        case VERIFY_BAD_TARGET: return "target outside code";
+        default: return "?";
+    }
+}
+
+/* ============ PAGES ============ */
+
+/* Check every whole instruction slot of a page that lies in the code section.
+   A page that passes is write-protected, so no write can land on it unseen. */
+bool guest_verify_page(guest_vm_t* vm, uint32_t page, bool report) {
+    vm = vm->vm;
+    ept_entry_t* entry = &vm->ept[page];
+    entry->reverify = false;
+    if (entry->verified) return true;
+
+    uint32_t start = page * PAGE_SIZE;
+    if (start >= vm->code_size || entry->mmio || entry->grant) return false;
+    uint32_t end = vm->code_size - start < PAGE_SIZE ? vm->code_size : start + PAGE_SIZE;
+
+    const uint8_t* data = entry->present ? entry->host_page : guest_memory_page_in(vm, page);
+    vm->verify_runs++;
+    for (uint32_t addr = start; addr + INSTRUCTION_SIZE <= end; addr += INSTRUCTION_SIZE) {
+        const uint8_t* instr = data + addr % PAGE_SIZE;
+        verify_status_t status = verify_instruction(instr, vm->code_size);
+        if (status != VERIFY_OK) {
+            vm->verify_failures++;
+            if (report) {
+                hypervisor_log(vm->hv, VISA_LOG_WARN,
+                               "[VERIFY] Guest VM %u: %s at 0x%X (%s r%u r%u r%u); page %u runs checked\n", vm->vm_id,
+                               verify_status_name(status), addr, isa_opcode_name(instr[0]), instr[1], instr[2],
+                               instr[3], page);
+            }
+            return false;
+        }
+    }
+
+    entry->verified = true;
+    entry->writable = false;
+    vm->verified_pages++;
+    return true;
+}
+
+void guest_verify_image(guest_vm_t* vm) {
+    vm = vm->vm;
+    if (!vm->verify) return;
+    for (uint32_t page = 0; page * PAGE_SIZE < vm->code_size; page++) {
+        guest_verify_page(vm, page, true);
+    }
+}
+
+/* The caller is about to change the page. Blocks already decoded from it keep
+   running unchecked: they are copies of the instructions that passed. */
+void guest_verify_withdraw(guest_vm_t* vm, uint32_t page) {
+    vm = vm->vm;
+    ept_entry_t* entry = &vm->ept[page];
+    if (!entry->verified) return;
+    entry->verified = false;
+    entry->reverify = ++entry->verify_writes < VERIFY_MAX_REWRITES;
+    vm->verified_pages--;
+}
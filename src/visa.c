@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../include/isa.h"
+
+typedef char visa_register_count_matches[(VISA_REGISTER_COUNT == REGISTER_COUNT) ? 1 : -1];
+
+/* ============ INSTANCES ============ */
+
+visa_status_t visa_create(const visa_config_t* config, visa_t** out) {
+    if (!out) return VISA_ERR_INVALID;
+    visa_config_t quiet = {0};
+    *out = hypervisor_create_with(config ? config : &quiet);
+    return *out ? VISA_OK : VISA_ERR_NO_MEMORY;
+}
+
+void visa_destroy(visa_t* visa) {
+    hypervisor_destroy(visa);
+}
+
+const char* visa_last_error(const visa_t* visa) {
+    return visa ? visa->last_error : "";
+}
+
+const char* visa_status_string(visa_status_t status) {
+    switch (status) {
+        case VISA_OK: return "ok";
+        case VISA_ERR_INVALID: return "invalid argument";
+        case VISA_ERR_NO_MEMORY: return "out of memory";
+        case VISA_ERR_LIMIT: return "guest limit reached";
+        case VISA_ERR_IMAGE: return "bad guest image";
+        case VISA_ERR_IO: return "cannot read file";
+        case VISA_ERR_DEADLOCK: return "guests deadlocked";
+        default: return "?";
+    }
+}
+
+/* ============ GUESTS ============ */
+
+static guest_vm_t* visa_guest(visa_t* visa, uint32_t guest_id) {
+    if (!visa || guest_id == 0 || guest_id > visa->guest_count) return NULL;
+    return &visa->guests[guest_id - 1];
+}
+
+visa_status_t visa_load_file(visa_t* visa, const char* path, uint32_t memory_size, uint32_t* guest_id) {
+    if (!visa || !path || !guest_id) return VISA_ERR_INVALID;
+    visa_status_t status;
+    *guest_id = hypervisor_load_guest_file(visa, path, memory_size, &status);
+    return status;
+}
+
+visa_status_t visa_load_image(visa_t* visa, const void* image, size_t size, uint32_t memory_size,
+                              uint32_t* guest_id) {
+    if (!visa || !image || !guest_id) return VISA_ERR_INVALID;
+    visa_status_t status;
+    *guest_id = hypervisor_load_guest_buffer(visa, "image", image, size, false, memory_size, &status);
+    return status;
+}
+
+visa_status_t visa_load_source(visa_t* visa, const char* source, uint32_t memory_size, uint32_t* guest_id) {
+    if (!visa || !source || !guest_id) return VISA_ERR_INVALID;
+    visa_status_t status;
+    *guest_id = hypervisor_load_guest_buffer(visa, "source", (const uint8_t*)source, strlen(source), true,
+                                             memory_size, &status);
+    return status;
+}
+
+visa_status_t visa_set_quantum(visa_t* visa, uint32_t guest_id, uint32_t instructions, uint64_t nanoseconds) {
+    if (!visa_guest(visa, guest_id)) return VISA_ERR_INVALID;
+    hypervisor_set_quantum(visa, guest_id, instructions, nanoseconds);
+    return VISA_OK;
+}
+
+visa_status_t visa_guest_info(visa_t* visa, uint32_t guest_id, visa_guest_info_t* info) {
+    guest_vm_t* guest = visa_guest(visa, guest_id);
+    if (!guest || !info) return VISA_ERR_INVALID;
+    info->state = guest->vcpu.state;
+    info->pc = guest->vcpu.pc;
+    info->last_exit_cause = guest->vcpu.last_exit_cause;
+    info->instructions = guest->instruction_count;
+    memcpy(info->registers, guest->vcpu.registers, sizeof(info->registers));
+    return VISA_OK;
+}
+
+visa_status_t visa_read_memory(visa_t* visa, uint32_t guest_id, uint32_t addr, void* buf, size_t size) {
+    guest_vm_t* guest = visa_guest(visa, guest_id);
+    if (!guest || !buf || size > UINT32_MAX) return VISA_ERR_INVALID;
+    return hypervisor_copy_from_guest(guest, addr, buf, (uint32_t)size) ? VISA_OK : VISA_ERR_INVALID;
+}
+
+visa_status_t visa_write_memory(visa_t* visa, uint32_t guest_id, uint32_t addr, const void* buf, size_t size) {
+    guest_vm_t* guest = visa_guest(visa, guest_id);
+    if (!guest || !buf || size > UINT32_MAX) return VISA_ERR_INVALID;
+    return hypervisor_copy_to_guest(visa, guest, addr, buf, (uint32_t)size) ? VISA_OK : VISA_ERR_INVALID;
+}
+
+/* ============ EXECUTION ============ */
+
+visa_status_t visa_run(visa_t* visa) {
+    if (!visa) return VISA_ERR_INVALID;
+    hypervisor_run(visa);
+    for (uint32_t i = 0; i < visa->guest_count; i++) {
+        if (visa->guests[i].vcpu.state != GUEST_STOPPED) return VISA_ERR_DEADLOCK;
+    }
+    return VISA_OK;
+}
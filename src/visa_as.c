@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/assembler.h"
+
+static void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--bin] <input.isa> [output]\n", prog);
+    fprintf(stderr, "  Writes a vISA object (.vobj) by default, or a raw code image with --bin\n");
+}
+
+static char* read_source(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    size_t capacity = 4096, length = 0;
+    char* text = malloc(capacity);
+    size_t n;
+    while (text && (n = fread(text + length, 1, capacity - length - 1, file)) > 0) {
+        length += n;
+        if (capacity - length == 1) {
+            char* grown = realloc(text, capacity * 2);
+            if (!grown) {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+            capacity *= 2;
+        }
+    }
+    fclose(file);
+    if (text) text[length] = '\0';
+    return text;
+}
+
+/* input.isa -> input<ext> */
+static char* default_output(const char* input, const char* ext) {
+    size_t len = strlen(input);
+    if (len > 4 && strcmp(input + len - 4, ".isa") == 0) len -= 4;
+    char* out = malloc(len + strlen(ext) + 1);
+    if (!out) return NULL;
+    memcpy(out, input, len);
+    strcpy(out + len, ext);
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    bool raw = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--bin") == 0) {
+        raw = true;
+        arg++;
+    }
+    if (arg >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char* input = argv[arg];
+    char* output = arg + 1 < argc ? strdup(argv[arg + 1])
+                                  : default_output(input, raw ? ".bin" : ".vobj");
+    char* source = read_source(input);
+    if (!source || !output) {
+        fprintf(stderr, "Error: cannot read %s\n", input);
+        free(source);
+        free(output);
+        return 1;
+    }
+
+    vobj_image_t image;
+    char error[128];
+    if (!visa_assemble(source, &image, error, sizeof(error))) {
+        fprintf(stderr, "Error: %s: %s\n", input, error);
+        free(source);
+        free(output);
+        return 1;
+    }
+    free(source);
+
+    if (raw && (image.data_size || image.bss_size || image.entry)) {
+        fprintf(stderr, "Error: --bin images cannot carry data, bss or an entry point\n");
+        vobj_free(&image);
+        free(output);
+        return 1;
+    }
+
+    uint8_t* encoded = NULL;
+    const uint8_t* bytes = image.code;
+    size_t size = image.code_size;
+    if (!raw) {
+        if (!vobj_encode(&image, &encoded, &size)) {
+            fprintf(stderr, "Error: out of memory\n");
+            vobj_free(&image);
+            free(output);
+            return 1;
+        }
+        bytes = encoded;
+    }
+
+    FILE* file = fopen(output, "wb");
+    bool ok = file && fwrite(bytes, 1, size, file) == size;
+    if (file && fclose(file) != 0) ok = false;
+
+    if (ok) {
+        printf("Assembled %s -> %s (%zu bytes)\n", input, output, size);
+    } else {
+        fprintf(stderr, "Error: cannot write %s\n", output);
+    }
+
+    free(encoded);
+    vobj_free(&image);
+    free(output);
+    return ok ? 0 : 1;
+}
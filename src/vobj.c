@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/vobj.h"
+#include "../include/isa.h"
+
+/* ============ LITTLE-ENDIAN FIELD ACCESS ============ */
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t* p) {
+    return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+/* ============ SYMBOL TABLE ENCODING ============ */
+
+static void encode_symbol(uint8_t* p, const vobj_symbol_t* sym) {
+    memset(p, 0, VOBJ_SYMBOL_SIZE);
+    memcpy(p, sym->name, strnlen(sym->name, VOBJ_SYMBOL_NAME_MAX - 1));
+    put32(p + VOBJ_SYMBOL_NAME_MAX, sym->value);
+    p[VOBJ_SYMBOL_NAME_MAX + 4] = sym->section;
+}
+
+static void decode_symbol(const uint8_t* p, vobj_symbol_t* sym) {
+    memcpy(sym->name, p, VOBJ_SYMBOL_NAME_MAX);
+    sym->name[VOBJ_SYMBOL_NAME_MAX - 1] = '\0';
+    sym->value = get32(p + VOBJ_SYMBOL_NAME_MAX);
+    sym->section = p[VOBJ_SYMBOL_NAME_MAX + 4];
+}
+
+/* ============ OBJECT API ============ */
+
+bool vobj_is_object(const uint8_t* buf, size_t size) {
+    return size >= VOBJ_HEADER_SIZE && get32(buf) == VOBJ_MAGIC;
+}
+
+uint32_t vobj_data_base(const vobj_image_t* image) {
+    return VOBJ_ALIGN(image->code_size);
+}
+
+uint32_t vobj_bss_base(const vobj_image_t* image) {
+    return VOBJ_ALIGN(vobj_data_base(image) + image->data_size);
+}
+
+/* Summed in 64 bits: the sizes come from the file header and must not wrap */
+uint64_t vobj_memory_size(const vobj_image_t* image) {
+    uint64_t bss_base = ((uint64_t)vobj_data_base(image) + image->data_size + 3) & ~(uint64_t)3;
+    return bss_base + image->bss_size;
+}
+
+bool vobj_encode(vobj_image_t* image, uint8_t** out, size_t* out_size) {
+    size_t payload = (size_t)image->code_size + image->data_size +
+                     (size_t)image->symbol_count * VOBJ_SYMBOL_SIZE;
+    uint8_t* buf = calloc(1, VOBJ_HEADER_SIZE + payload);
+    if (!buf) return false;
+
+    uint8_t* p = buf + VOBJ_HEADER_SIZE;
+    if (image->code_size) memcpy(p, image->code, image->code_size);
+    p += image->code_size;
+    if (image->data_size) memcpy(p, image->data, image->data_size);
+    p += image->data_size;
+    for (uint32_t i = 0; i < image->symbol_count; i++, p += VOBJ_SYMBOL_SIZE) {
+        encode_symbol(p, &image->symbols[i]);
+    }
+
+    image->content_hash = hypervisor_hash_bytes(buf + VOBJ_HEADER_SIZE, payload);
+
+    put32(buf + 0, VOBJ_MAGIC);
+    put16(buf + 4, VOBJ_VERSION);
+    put16(buf + 6, 0);                      /* flags */
+    put32(buf + 8, image->entry);
+    put32(buf + 12, image->code_size);
+    put32(buf + 16, image->data_size);
+    put32(buf + 20, image->bss_size);
+    put32(buf + 24, image->symbol_count);
+    put32(buf + 28, 0);                     /* reserved */
+    put64(buf + 32, image->content_hash);
+
+    *out = buf;
+    *out_size = VOBJ_HEADER_SIZE + payload;
+    return true;
+}
+
+bool vobj_decode(const uint8_t* buf, size_t size, vobj_image_t* image, char* error, size_t error_size) {
+    memset(image, 0, sizeof(*image));
+
+    if (!vobj_is_object(buf, size)) {
+        snprintf(error, error_size, "not a vISA object");
+        return false;
+    }
+    if (get16(buf + 4) != VOBJ_VERSION) {
+        snprintf(error, error_size, "unsupported object version %u", get16(buf + 4));
+        return false;
+    }
+
+    image->entry = get32(buf + 8);
+    image->code_size = get32(buf + 12);
+    image->data_size = get32(buf + 16);
+    image->bss_size = get32(buf + 20);
+    image->symbol_count = get32(buf + 24);
+    image->content_hash = get64(buf + 32);
+
+    uint64_t payload = (uint64_t)image->code_size + image->data_size +
+                       (uint64_t)image->symbol_count * VOBJ_SYMBOL_SIZE;
+    if (payload != size - VOBJ_HEADER_SIZE) {
+        snprintf(error, error_size, "section sizes do not match file size");
+        return false;
+    }
+    if (hypervisor_hash_bytes(buf + VOBJ_HEADER_SIZE, (size_t)payload) != image->content_hash) {
+        snprintf(error, error_size, "content hash mismatch");
+        return false;
+    }
+    if (image->code_size % INSTRUCTION_SIZE != 0 || image->entry % INSTRUCTION_SIZE != 0 ||
+        (image->code_size > 0 && image->entry >= image->code_size)) {
+        snprintf(error, error_size, "bad code section or entry point");
+        return false;
+    }
+    if (vobj_memory_size(image) > GUEST_MAX_MEMORY_SIZE) {
+        snprintf(error, error_size, "sections exceed the largest guest memory");
+        return false;
+    }
+
+    const uint8_t* p = buf + VOBJ_HEADER_SIZE;
+    image->code = p;
+    image->data = p + image->code_size;
+    p += image->code_size + image->data_size;
+
+    if (image->symbol_count > 0) {
+        image->symbols = calloc(image->symbol_count, sizeof(vobj_symbol_t));
+        if (!image->symbols) {
+            snprintf(error, error_size, "out of memory");
+            return false;
+        }
+        for (uint32_t i = 0; i < image->symbol_count; i++, p += VOBJ_SYMBOL_SIZE) {
+            decode_symbol(p, &image->symbols[i]);
+        }
+    }
+    return true;
+}
+
+void vobj_free(vobj_image_t* image) {
+    if (image->owns_sections) {
+        free((void*)image->code);
+        free((void*)image->data);
+    }
+    free(image->symbols);
+    memset(image, 0, sizeof(*image));
+}
+
+const vobj_symbol_t* vobj_find_symbol(const vobj_symbol_t* symbols, uint32_t count, uint32_t addr) {
+    const vobj_symbol_t* best = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        if (symbols[i].value <= addr && (!best || symbols[i].value > best->value)) {
+            best = &symbols[i];
+        }
+    }
+    return best;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+#include "../include/isa.h"
+
+/* ============ WAIT QUEUE STORAGE ============ */
+
+static uint32_t waitq_bucket(wait_event_t event, uint32_t key) {
+    return ((key * 2654435761u) ^ (uint32_t)event) % WAITQ_BUCKETS;
+}
+
+bool waitq_init(waitq_t* waitq, uint32_t capacity) {
+    memset(waitq, 0, sizeof(*waitq));
+    waitq->event_fd = -1;
+    waitq->epoll_fd = -1;
+    waitq->timer_fd = -1;
+
+    waitq->timers = (guest_vm_t**)calloc(capacity, sizeof(guest_vm_t*));
+    if (!waitq->timers) return false;
+    waitq->capacity = capacity;
+
+    pthread_mutex_init(&waitq->lock, NULL);
+
+#ifdef __linux__
+    /* event_fd carries cross-thread wakeups; the timerfd is armed for the
+       earliest WAIT_TIMER deadline so idle sleeps have ns precision */
+    waitq->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    waitq->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    waitq->timer_fd = timer_fd;
+    if (waitq->event_fd < 0 || waitq->epoll_fd < 0 || timer_fd < 0) {
+        waitq_destroy(waitq);
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = waitq->event_fd;
+    epoll_ctl(waitq->epoll_fd, EPOLL_CTL_ADD, waitq->event_fd, &ev);
+    ev.data.fd = timer_fd;
+    epoll_ctl(waitq->epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+#endif
+    return true;
+}
+
+void waitq_destroy(waitq_t* waitq) {
+#ifdef __linux__
+    if (waitq->timer_fd >= 0) close(waitq->timer_fd);
+    if (waitq->event_fd >= 0) close(waitq->event_fd);
+    if (waitq->epoll_fd >= 0) close(waitq->epoll_fd);
+#endif
+    pthread_mutex_destroy(&waitq->lock);
+    free(waitq->timers);
+    free(waitq->pending);
+    waitq->timers = NULL;
+    waitq->pending = NULL;
+}
+
+/* ============ TIMER HEAP ============ */
+
+static void timer_swap(waitq_t* waitq, uint32_t a, uint32_t b) {
+    guest_vm_t* tmp = waitq->timers[a];
+    waitq->timers[a] = waitq->timers[b];
+    waitq->timers[b] = tmp;
+    waitq->timers[a]->wait.timer_index = (int32_t)a;
+    waitq->timers[b]->wait.timer_index = (int32_t)b;
+}
+
+static void timer_sift_up(waitq_t* waitq, uint32_t i) {
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (waitq->timers[parent]->wait.deadline_ns <= waitq->timers[i]->wait.deadline_ns) break;
+        timer_swap(waitq, parent, i);
+        i = parent;
+    }
+}
+
+static void timer_sift_down(waitq_t* waitq, uint32_t i) {
+    for (;;) {
+        uint32_t left = 2 * i + 1;
+        uint32_t right = left + 1;
+        uint32_t earliest = i;
+
+        if (left < waitq->nr_timers &&
+            waitq->timers[left]->wait.deadline_ns < waitq->timers[earliest]->wait.deadline_ns) {
+            earliest = left;
+        }
+        if (right < waitq->nr_timers &&
+            waitq->timers[right]->wait.deadline_ns < waitq->timers[earliest]->wait.deadline_ns) {
+            earliest = right;
+        }
+        if (earliest == i) break;
+
+        timer_swap(waitq, i, earliest);
+        i = earliest;
+    }
+}
+
+static void timer_remove(waitq_t* waitq, guest_vm_t* guest) {
+    uint32_t i = (uint32_t)guest->wait.timer_index;
+    uint32_t last = --waitq->nr_timers;
+
+    if (i != last) {
+        waitq->timers[i] = waitq->timers[last];
+        waitq->timers[i]->wait.timer_index = (int32_t)i;
+        timer_sift_down(waitq, i);
+        timer_sift_up(waitq, i);
+    }
+    guest->wait.timer_index = -1;
+}
+
+uint64_t waitq_next_deadline(const waitq_t* waitq) {
+    return waitq->nr_timers ? waitq->timers[0]->wait.deadline_ns : 0;
+}
+
+/* ============ PARK / WAKE ============ */
+
+static void waitq_unlink(waitq_t* waitq, guest_vm_t* guest) {
+    if (guest->wait.event == WAIT_TIMER) {
+        timer_remove(waitq, guest);
+    } else {
+        guest_vm_t** link = &waitq->buckets[waitq_bucket(guest->wait.event, guest->wait.key)];
+        while (*link && *link != guest) {
+            link = &(*link)->wait.next;
+        }
+        if (*link) *link = guest->wait.next;
+        guest->wait.next = NULL;
+    }
+
+    guest->wait.event = WAIT_NONE;
+    waitq->nr_waiters--;
+}
+
+static void resume_woken_guest(hypervisor_t* hv, guest_vm_t* guest, uint32_t result) {
+    /* Continue a suspended exit handler, which may park the guest again;
+       otherwise deliver the wakeup result in r0 and re-enter the guest */
+    if (hv->perf) perf_switch(hv->perf, guest->vm_id, PERF_PHASE_EXIT);
+    if (!hypervisor_resume_handler(hv, guest, result)) {
+        hypervisor_resume_guest(hv, guest, result);
+    }
+    if (hv->perf) perf_switch(hv->perf, PERF_HOST, PERF_PHASE_SCHED);
+    if (guest->vcpu.state == GUEST_RUNNING) scheduler_enqueue(&hv->scheduler, guest);
+    hv->waitq.wakeups++;
+}
+
+void hypervisor_block_guest(hypervisor_t* hv, guest_vm_t* guest, wait_event_t event, uint32_t key) {
+    waitq_t* waitq = &hv->waitq;
+    uint32_t bucket = waitq_bucket(event, key);
+
+    guest->vcpu.state = GUEST_BLOCKED;
+    guest->wait.event = event;
+    guest->wait.key = key;
+    guest->wait.next = waitq->buckets[bucket];
+    waitq->buckets[bucket] = guest;
+    waitq->nr_waiters++;
+}
+
+void hypervisor_sleep_guest(hypervisor_t* hv, guest_vm_t* guest, uint64_t deadline_ns) {
+    waitq_t* waitq = &hv->waitq;
+
+    guest->vcpu.state = GUEST_BLOCKED;
+    guest->wait.event = WAIT_TIMER;
+    guest->wait.key = guest->vm_id;
+    guest->wait.deadline_ns = deadline_ns;
+
+    uint32_t i = waitq->nr_timers++;
+    waitq->timers[i] = guest;
+    guest->wait.timer_index = (int32_t)i;
+    timer_sift_up(waitq, i);
+    waitq->nr_waiters++;
+}
+
+uint32_t hypervisor_wake(hypervisor_t* hv, wait_event_t event, uint32_t key, uint32_t result) {
+    waitq_t* waitq = &hv->waitq;
+    uint32_t woken = 0;
+
+    if (event == WAIT_TIMER) {
+        /* Timer waits are keyed by guest id: cancel that guest's sleep */
+        for (uint32_t i = 0; i < waitq->nr_timers; i++) {
+            guest_vm_t* guest = waitq->timers[i];
+            if (guest->wait.key == key) {
+                waitq_unlink(waitq, guest);
+                resume_woken_guest(hv, guest, result);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    guest_vm_t* guest = waitq->buckets[waitq_bucket(event, key)];
+    while (guest) {
+        guest_vm_t* next = guest->wait.next;
+        if (guest->wait.event == event && guest->wait.key == key) {
+            waitq_unlink(waitq, guest);
+            resume_woken_guest(hv, guest, result);
+            woken++;
+        }
+        guest = next;
+    }
+    return woken;
+}
+
+/* ============ CROSS-THREAD WAKEUPS ============ */
+
+static void signal_event_fd(waitq_t* waitq) {
+#ifdef __linux__
+    uint64_t one = 1;
+    if (write(waitq->event_fd, &one, sizeof(one)) < 0) {
+        /* Counter saturated: a wakeup is already pending */
+    }
+#else
+    (void)waitq;
+#endif
+}
+
+void hypervisor_post_wakeup(hypervisor_t* hv, wait_event_t event, uint32_t key, uint32_t result) {
+    waitq_t* waitq = &hv->waitq;
+
+    pthread_mutex_lock(&waitq->lock);
+    if (waitq->nr_pending == waitq->pending_capacity) {
+        uint32_t capacity = waitq->pending_capacity ? waitq->pending_capacity * 2 : 64;
+        wait_wakeup_t* grown = (wait_wakeup_t*)realloc(waitq->pending, capacity * sizeof(wait_wakeup_t));
+        if (!grown) {
+            pthread_mutex_unlock(&waitq->lock);
+            hypervisor_log(hv, VISA_LOG_ERROR, "[WAITQ] Dropped wakeup (event %d, key %u): out of memory\n",
+                           event, key);
+            return;
+        }
+        waitq->pending = grown;
+        waitq->pending_capacity = capacity;
+    }
+    waitq->pending[waitq->nr_pending].event = event;
+    waitq->pending[waitq->nr_pending].key = key;
+    waitq->pending[waitq->nr_pending].result = result;
+    /* Paired with the unlocked peek in hypervisor_poll_events */
+    __atomic_store_n(&waitq->nr_pending, waitq->nr_pending + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&waitq->lock);
+
+    signal_event_fd(waitq);
+}
+
+void hypervisor_async_begin(hypervisor_t* hv) {
+    pthread_mutex_lock(&hv->waitq.lock);
+    hv->waitq.nr_async++;
+    pthread_mutex_unlock(&hv->waitq.lock);
+}
+
+void hypervisor_async_complete(hypervisor_t* hv, wait_event_t event, uint32_t key, uint32_t result) {
+    pthread_mutex_lock(&hv->waitq.lock);
+    hv->waitq.nr_async--;
+    pthread_mutex_unlock(&hv->waitq.lock);
+
+    hypervisor_post_wakeup(hv, event, key, result);
+}
+
+uint32_t hypervisor_poll_events(hypervisor_t* hv) {
+    waitq_t* waitq = &hv->waitq;
+    uint32_t woken = 0;
+
+    /* Expired sleeps */
+    if (waitq->nr_timers) {
+        uint64_t now = hypervisor_time_ns();
+        while (waitq->nr_timers && waitq->timers[0]->wait.deadline_ns <= now) {
+            guest_vm_t* guest = waitq->timers[0];
+            waitq_unlink(waitq, guest);
+            resume_woken_guest(hv, guest, 0);
+            woken++;
+        }
+    }
+
+    /* Wakeups posted by other host threads; swap the batch out under the lock */
+    if (__atomic_load_n(&waitq->nr_pending, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&waitq->lock);
+        wait_wakeup_t* batch = waitq->pending;
+        uint32_t count = waitq->nr_pending;
+        waitq->pending = NULL;
+        waitq->nr_pending = 0;
+        waitq->pending_capacity = 0;
+        pthread_mutex_unlock(&waitq->lock);
+
+        for (uint32_t i = 0; i < count; i++) {
+            woken += hypervisor_wake(hv, batch[i].event, batch[i].key, batch[i].result);
+        }
+        free(batch);
+    }
+
+    return woken;
+}
+
+bool hypervisor_idle_wait(hypervisor_t* hv, uint64_t max_wait_ns) {
+    waitq_t* waitq = &hv->waitq;
+
+    pthread_mutex_lock(&waitq->lock);
+    bool external = waitq->nr_async > 0 || waitq->nr_pending > 0;
+    pthread_mutex_unlock(&waitq->lock);
+
+    uint64_t now = hypervisor_time_ns();
+    uint64_t deadline = waitq_next_deadline(waitq);
+    if (max_wait_ns && (deadline == 0 || now + max_wait_ns < deadline)) {
+        deadline = now + max_wait_ns;
+    }
+
+    if (deadline == 0 && !external) {
+        return false;  /* Nothing can ever wake the blocked guests */
+    }
+
+    if (hv->perf) perf_switch(hv->perf, PERF_HOST, PERF_PHASE_IDLE);
+#ifdef __linux__
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (deadline) {
+        its.it_value.tv_sec = (time_t)(deadline / 1000000000ULL);
+        its.it_value.tv_nsec = (long)(deadline % 1000000000ULL);
+    }
+    timerfd_settime(waitq->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+
+    struct epoll_event events[2];
+    int ready = epoll_wait(waitq->epoll_fd, events, 2, -1);
+    for (int i = 0; i < ready; i++) {
+        uint64_t count;
+        if (read(events[i].data.fd, &count, sizeof(count)) < 0) {
+            /* Spurious readiness; nothing to drain */
+        }
+    }
+#else
+    /* No eventfd/epoll: poll in short sleeps */
+    uint64_t sleep_ns = 1000000ULL;
+    if (deadline && deadline > now && deadline - now < sleep_ns) sleep_ns = deadline - now;
+    struct timespec ts = { 0, (long)sleep_ns };
+    nanosleep(&ts, NULL);
+#endif
+    if (hv->perf) perf_switch(hv->perf, PERF_HOST, PERF_PHASE_SCHED);
+
+    waitq->idle_ns += hypervisor_time_ns() - now;
+    return true;
+}